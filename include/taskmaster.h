@@ -9,6 +9,10 @@
 #include <unistd.h>
 
 #define TM_LOGFILE "./taskmaster.log"
+#define TM_LOG_MAXBYTES (10 * 1024 * 1024) /* taskmaster log rotation size */
+#define TM_LOG_BACKUPS (5) /* compressed backups of the taskmaster log kept */
+#define TM_JOURNALFILE "./taskmaster.journal" /* lifecycle events journal */
+#define TM_SNAPSHOTFILE "./taskmaster.snapshot" /* compiled config cache */
 
 #define handle_error(msg) \
   do {                    \
@@ -45,7 +49,15 @@ typedef enum e_autorestart {
   autorestart_max
 } t_autorestart;
 
+/* rotation policy of a program log file */
+typedef struct s_log_rotate {
+  uint64_t maxbytes; /* size above which the file is rotated (0: never) */
+  uint8_t backups;   /* how many rotated files are kept (file.1 ... file.N) */
+  bool compress;     /* backups are compressed in background (file.N.lz) */
+} t_log_rotate;
+
 /* data of a program fetch in config file */
+/* pointers are shared blocks (see shared.h), compared by address */
 typedef struct s_pgm_usr {
   char *name; /* pgm name */
   char **cmd; /* launch command */
@@ -55,6 +67,8 @@ typedef struct s_pgm_usr {
   } env;
   char *std_out;    /* which file processus logs out (default /dev/null) */
   char *std_err;    /* which file processus logs err (default /dev/null) */
+  t_log_rotate out_rotate; /* rotation policy of std_out */
+  t_log_rotate err_rotate; /* rotation policy of std_err */
   char *workingdir; /* working directory of processus */
   struct s_exit_code {
     int16_t *array_val; /* array of expected exit codes */
@@ -70,6 +84,9 @@ typedef struct s_pgm_usr {
                                 launched. in ms*/
   uint32_t stoptime;         /* time allowed to a processus to stop before it is
                               killed. in ms*/
+  uint16_t max_unavailable;  /* procs a rolling reload may stop before their
+                                replacements are started */
+  uint16_t max_surge;        /* procs a rolling reload may run above numprocs */
 } t_pgm_usr;
 
 typedef enum e_proc_state {
@@ -79,11 +96,38 @@ typedef enum e_proc_state {
   PROC_ST_MAX,
 } t_proc_state;
 
+/* resources of a process, sampled from /proc (proc_sample.h) */
+typedef struct s_proc_res {
+  bool sampled;       /* sampled while it runs */
+  uint32_t n;         /* samples taken */
+  int64_t at;         /* ms of the last sample */
+  int64_t due;        /* ms the next sample is due */
+  uint64_t cpu_ticks; /* utime + stime at the last sample */
+  float cpu;          /* % of a CPU used since the previous sample */
+  float cpu_avg;
+  uint64_t rss_kb;
+  float rss_avg; /* kB */
+  uint32_t threads;
+  uint32_t fds;
+  uint64_t vcsw;  /* voluntary context switches */
+  uint64_t ivcsw; /* involuntary context switches */
+} t_proc_res;
+
+/* the child's exec is seen when the close-on-exec end of a pipe hits EOF */
+typedef struct s_proc_exec {
+  int32_t fd;     /* read end of the pipe until the exec is seen, or -1 */
+  int64_t forked; /* us of the fork */
+} t_proc_exec;
+
 typedef struct s_process {
   pid_t pid;           /* processus pid */
   int32_t restart_cnt; /* how many times the processus restarted */
   int32_t w_status;    /* waitpid() status of processus */
   t_proc_state state;  /* state of processus*/
+  int64_t since;       /* ms the processus entered its state (metrics.h) */
+  int64_t reaped;      /* us its last exit was reaped, to time the restart */
+  t_proc_res res;
+  t_proc_exec exec;
   int32_t updated; /* flag to notify wether the proc has been updated or not */
   struct s_process *next;
 } t_process;
@@ -93,9 +137,39 @@ typedef enum e_pgm_event {
   PGM_EV_RESTART,
   PGM_EV_ADD,
   PGM_EV_DEL,
+  PGM_EV_ROLL,
   PGM_MAX_EV,
 } t_pgm_event;
 
+/* how many procs of a program exited with a code or were killed by a signal */
+typedef struct s_metrics_exit {
+  bool signaled; /* val is a signal number, otherwise an exit code */
+  uint8_t val;
+  uint64_t cnt;
+} t_metrics_exit;
+
+/* latencies measured for each program (hist.h) */
+typedef enum e_lat_stage {
+  LAT_FORK_EXEC, /* fork() to execve() of the child */
+  LAT_READY,     /* fork() to starttime passed, on a successful start */
+  LAT_STOP,      /* stop signal to exit */
+  LAT_RESPAWN,   /* exit reaped to restarted proc execve() */
+  LAT_NB,
+} t_lat_stage;
+
+/* counters of a program, kept up to date along its lifecycle (metrics.h) */
+typedef struct s_pgm_metrics {
+  uint64_t spawns;                 /* procs forked, restarts included */
+  uint64_t restarts;               /* procs forked again after an exit */
+  uint64_t start_failures;         /* start timers fired short of numprocs */
+  uint32_t st_cnt[PROC_ST_MAX];    /* procs in each state */
+  int64_t st_since[PROC_ST_MAX];   /* sum of the ms they entered it */
+  int64_t st_ms[PROC_ST_MAX];      /* ms spent in it by procs which left it */
+  t_metrics_exit *exits;
+  uint16_t exit_nb;
+  struct s_hist *lat[LAT_NB]; /* NULL until a first latency is measured */
+} t_pgm_metrics;
+
 /* data of a program dynamically filled at runtime for taskmaster operations */
 typedef struct s_pgm_private {
   struct log {
@@ -107,6 +181,13 @@ typedef struct s_pgm_private {
   t_pgm_event ev;   /* event affected to the pgm */
   int32_t proc_cnt; /* count of active processus */
   t_process *proc_head;
+  int32_t exec_cnt; /* procs whose exec isn't seen yet */
+  uint64_t hard_fp;   /* fingerprint of the fields which need a restart */
+  uint64_t soft_fp;   /* fingerprint of the fields applied on the fly */
+  struct s_pgm *roll_from; /* pgm this one replaces by a rolling reload */
+  struct s_pgm *roll_to;   /* pgm replacing this one by a rolling reload */
+  int32_t roll_cnt;        /* procs count the current rolling batch aims at */
+  t_pgm_metrics metrics;
   struct s_pgm *next; /* next link of the linked list */
 } t_pgm_private;
 
@@ -120,6 +201,9 @@ typedef enum e_timer_ev {
   NO_TIMER_EV,
   TIMER_EV_START,
   TIMER_EV_STOP,
+  TIMER_EV_LOGROTATE,
+  TIMER_EV_KILL,
+  TIMER_EV_SAMPLE,
   MAX_TIMER_EV_NB,
 } t_timer_ev;
 
@@ -127,13 +211,37 @@ typedef struct s_timer {
   t_pgm *pgm;   /* pgm concerned by the timer */
   time_t time;  /* time when the timer much trigger */
   int32_t type; /* type of action to achieve (is it timing a start or a stop) */
+  int64_t due;  /* monotonic us it is due at, to measure its drift */
   struct s_timer *next;
 } t_timer;
 
+/* programs indexed by name */
+typedef struct s_pgm_map {
+  struct s_pgm **slots;
+  uint32_t mask; /* number of slots - 1 */
+} t_pgm_map;
+
+/* what a reload does to a program, decided by pgm_join() */
+typedef enum e_pgm_diff {
+  PGM_DIFF_NONE, /* unchanged */
+  PGM_DIFF_ADD,  /* not running yet */
+  PGM_DIFF_DEL,  /* not in the new configuration */
+  PGM_DIFF_SOFT, /* updated in place, numprocs included */
+  PGM_DIFF_HARD, /* restarted */
+} t_pgm_diff;
+
+/* called by pgm_join() with a running pgm, a new one or both & the decision
+ * about them. Returns true if pgm_new has been moved out of its list */
+typedef bool (*t_pgm_join_cb)(t_pgm *pgm, t_pgm *pgm_new, t_pgm_diff diff,
+                              void *arg);
+
 typedef struct s_tm_node {
   char *tm_name;            /* taskmaster name (argv[0]) */
   char *config_file_name;   /* configuration file name */
   FILE *config_file_stream; /* configuration file stream */
+  const char *log_sink;     /* syslog socket logs are shipped to (-s) */
+  bool no_watch;            /* don't reload on config file changes (-n) */
+  const char *metrics_path; /* socket metrics are served on (-m) */
   t_pgm *head;              /* head of list of programs */
   t_timer *timer_hd;        /* head of list of timer  */
   uint32_t pgm_nb;          /* number of programs */
@@ -143,12 +251,49 @@ typedef struct s_tm_node {
 
 /* parsing.c */
 uint8_t load_config_file(t_tm_node *node);
+uint8_t load_config_buffer(t_tm_node *node, const char *buf, size_t len);
 uint8_t sanitize_config(t_tm_node *node);
 uint8_t fulfill_config(t_tm_node *node);
+uint8_t load_config(t_tm_node *node);
 
 /* run_client.c */
 uint8_t run_client(t_tm_node *node);
 
+/* log_rotate.c */
+void log_backup_name(char *buf, const char *path, uint8_t idx, const char *ext);
+void log_pending_name(char *buf, const char *path);
+int32_t log_shift_backups(const char *path, uint8_t backups, const char *ext);
+int32_t log_cut(int32_t fd, const char *backup);
+int32_t log_open_live(int32_t fd);
+int32_t log_backup(int32_t fd, const char *path, uint8_t backups);
+int32_t log_rotate(int32_t fd, const char *path, const t_log_rotate *rot);
+int32_t log_rotate_check(int32_t fd, const char *path, const t_log_rotate *rot);
+int32_t log_reopen(int32_t *fd, const char *path, const t_log_rotate *rot);
+void log_rotated_cb(const char *rotated, const char *logfile, int backups);
+int32_t log_rotate_cmp(const t_log_rotate *r1, const t_log_rotate *r2);
+
+/* lz_worker.c */
+int32_t lz_worker_start(void);
+void lz_worker_stop(void);
+int32_t lz_worker_push(const char *src, const char *path, uint8_t backups);
+int32_t lz_worker_rotate(int32_t fd, const char *path,
+                         const t_log_rotate *rot);
+
+/* pgm_hash.c */
+uint64_t tm_hash_bytes(const void *data, size_t len);
+uint64_t tm_hash_str(const char *str);
+void pgm_fingerprint(t_pgm *pgm);
+int32_t pgm_map_init(t_pgm_map *map, t_pgm *head);
+t_pgm *pgm_map_get(const t_pgm_map *map, const char *name);
+void pgm_map_destroy(t_pgm_map *map);
+void pgm_join(t_pgm *running, const t_pgm_map *old_map, t_pgm **head,
+              const t_pgm_map *new_map, t_pgm_join_cb cb, void *arg);
+
+/* conf_watch.c */
+int32_t conf_watch_start(void);
+int32_t conf_watch_add(const char *path);
+void conf_watch_clear(void);
+
 /* debug.c */
 void print_pgm_list(t_pgm *pgm);
 
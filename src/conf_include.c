@@ -0,0 +1,256 @@
+#include "conf_include.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "ft_log.h"
+#include "parsing.h"
+#include "shared.h"
+#include "trace.h"
+
+#define CONF_INCLUDE_ORIGIN_MAX (4) /* files named for a duplicate program */
+
+/* an included file & the programs parsed from it */
+typedef struct s_conf_frag {
+  char *path;
+  uint64_t hash;   /* hash of the content the programs were parsed from */
+  t_pgm *head;     /* programs as the parser left them, not sanitized */
+  uint32_t pgm_nb;
+  bool parsed;     /* head & hash are set */
+  bool seen;       /* included by the current load */
+  struct s_conf_frag *next;
+} t_conf_frag;
+
+static struct {
+  char *config;    /* configuration file of the current load */
+  char *patterns[CONF_INCLUDE_PATTERN_MAX]; /* resolved include patterns */
+  uint32_t pattern_nb;
+  t_conf_frag *frags;
+} inc;
+
+static void include_err(const char *path, const char *msg) {
+  fprintf(stderr, "Include error: %s: %s\n", path, msg);
+  ft_log(FT_LOG_ERR, "Include error: %s: %s", path, msg);
+}
+
+/* ============================= program copy =============================== */
+
+static char *dup_str(const char *str) {
+  char *dup;
+
+  if (!str) return NULL;
+  if (!(dup = strdup(str))) handle_error("strdup");
+  return dup;
+}
+
+static t_pgm *clone_pgm(const t_pgm *src) {
+  const t_pgm_usr *usr = &src->usr;
+  t_pgm *pgm = calloc(1, sizeof(*pgm));
+
+  if (!pgm) handle_error("calloc");
+  pgm->usr = *usr;
+  pgm->usr.name = shr_ref(usr->name);
+  pgm->usr.cmd = shr_ref(usr->cmd);
+  pgm->usr.env.array_val = shr_ref(usr->env.array_val);
+  pgm->usr.std_out = shr_ref(usr->std_out);
+  pgm->usr.std_err = shr_ref(usr->std_err);
+  pgm->usr.workingdir = shr_ref(usr->workingdir);
+  pgm->usr.exitcodes.array_val = shr_ref(usr->exitcodes.array_val);
+  return pgm;
+}
+
+/* put a copy of the programs of frag in front of node programs, in the order
+ * the parser would have left them if they were written in place */
+static void splice_frag(t_tm_node *node, const t_conf_frag *frag) {
+  t_pgm *head = NULL, **tail = &head;
+
+  for (const t_pgm *pgm = frag->head; pgm; pgm = pgm->privy.next) {
+    *tail = clone_pgm(pgm);
+    tail = &(*tail)->privy.next;
+  }
+  *tail = node->head;
+  node->head = head;
+  node->pgm_nb += frag->pgm_nb;
+}
+
+/* ============================== file cache ================================ */
+
+static char *read_file(const char *path, size_t *len) {
+  struct stat statbuf;
+  char *buf = NULL;
+  ssize_t ret;
+  int32_t fd;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) return NULL;
+  if (fstat(fd, &statbuf) == -1 || !(buf = malloc(statbuf.st_size + 1)))
+    goto error;
+  *len = 0;
+  while ((ret = read(fd, buf + *len, statbuf.st_size - *len)) > 0) *len += ret;
+  if (ret == -1) goto error;
+  close(fd);
+  return buf;
+error:
+  free(buf);
+  close(fd);
+  return NULL;
+}
+
+static t_conf_frag *get_frag(const char *path) {
+  t_conf_frag *frag;
+
+  for (frag = inc.frags; frag; frag = frag->next)
+    if (!strcmp(frag->path, path)) return frag;
+  if (!(frag = calloc(1, sizeof(*frag)))) handle_error("calloc");
+  frag->path = dup_str(path);
+  frag->next = inc.frags;
+  inc.frags = frag;
+  return frag;
+}
+
+/* parse path again if its content changed, then add its programs to node */
+static uint8_t include_file(t_tm_node *node, const char *path) {
+  t_tm_node parsed = {.tm_name = node->tm_name, 0};
+  t_conf_frag *frag = get_frag(path);
+  uint64_t hash;
+  size_t len;
+  char *buf;
+
+  if (frag->seen) return EXIT_SUCCESS; /* matched by several patterns */
+  if (!(buf = read_file(path, &len))) {
+    include_err(path, strerror(errno));
+    return VALUE_ERROR;
+  }
+  hash = tm_hash_bytes(buf, len);
+  if (!frag->parsed || frag->hash != hash) {
+    if (load_config_buffer(&parsed, buf, len)) {
+      include_err(path, "rejected");
+      free(buf);
+      return VALUE_ERROR;
+    }
+    destroy_pgm_list(frag->head);
+    frag->head = parsed.head, frag->pgm_nb = parsed.pgm_nb, frag->hash = hash;
+    frag->parsed = true;
+    TM_TRACE(TRACE_RELOAD, "%s parsed, %u programs", path, frag->pgm_nb);
+  } else
+    TM_TRACE(TRACE_RELOAD, "%s unchanged, %u programs", path, frag->pgm_nb);
+  free(buf);
+  frag->seen = true;
+  splice_frag(node, frag);
+  return EXIT_SUCCESS;
+}
+
+/* ================================== API =================================== */
+
+static void conf_include_exit(void) {
+  t_conf_frag *next;
+
+  for (t_conf_frag *frag = inc.frags; frag; frag = next) {
+    next = frag->next;
+    destroy_pgm_list(frag->head);
+    free(frag->path);
+    free(frag);
+  }
+  for (uint32_t i = 0; i < inc.pattern_nb; i++) DESTROY_PTR(inc.patterns[i]);
+  DESTROY_PTR(inc.config);
+  inc.frags = NULL, inc.pattern_nb = 0;
+}
+
+void conf_include_begin(const char *config_file_name) {
+  if (!inc.config) atexit(conf_include_exit);
+  DESTROY_PTR(inc.config);
+  inc.config = dup_str(config_file_name);
+  for (uint32_t i = 0; i < inc.pattern_nb; i++) DESTROY_PTR(inc.patterns[i]);
+  inc.pattern_nb = 0;
+  for (t_conf_frag *frag = inc.frags; frag; frag = frag->next)
+    frag->seen = false;
+}
+
+uint8_t conf_include_load(t_tm_node *node, const char *pattern) {
+  char path[PATH_MAX], dir[PATH_MAX];
+  uint8_t ret = EXIT_SUCCESS;
+  glob_t gl;
+  int32_t err;
+
+  if (!*pattern) return MISSING_ERROR;
+  if (inc.pattern_nb == CONF_INCLUDE_PATTERN_MAX) {
+    include_err(pattern, "too many include patterns");
+    return VALUE_ERROR;
+  }
+  strncpy(dir, inc.config, PATH_MAX - 1)[PATH_MAX - 1] = 0;
+  if (*pattern == '/')
+    snprintf(path, PATH_MAX, "%s", pattern);
+  else
+    snprintf(path, PATH_MAX, "%s/%s", dirname(dir), pattern);
+  inc.patterns[inc.pattern_nb++] = dup_str(path);
+
+  err = glob(path, GLOB_ERR, NULL, &gl);
+  if (err == GLOB_NOMATCH) return EXIT_SUCCESS; /* empty conf.d */
+  if (err) {
+    include_err(path, strerror(err == GLOB_NOSPACE ? ENOMEM : errno));
+    return VALUE_ERROR;
+  }
+  for (size_t i = 0; !ret && i < gl.gl_pathc; i++)
+    ret = include_file(node, gl.gl_pathv[i]);
+  globfree(&gl);
+  return ret;
+}
+
+void conf_include_end(bool loaded) {
+  t_conf_frag **link = &inc.frags, *frag;
+
+  while ((frag = *link)) {
+    if (frag->seen || !loaded) {
+      link = &frag->next;
+      continue;
+    }
+    *link = frag->next;
+    destroy_pgm_list(frag->head);
+    free(frag->path);
+    free(frag);
+  }
+}
+
+void conf_include_origin(const char *config, const char *name, uint32_t cnt,
+                         char *buf, size_t size) {
+  const char *files[CONF_INCLUDE_ORIGIN_MAX];
+  uint32_t file_nb = 0, frag_cnt, len = 0;
+
+  for (t_conf_frag *frag = inc.frags; frag; frag = frag->next) {
+    if (!frag->seen) continue;
+    frag_cnt = 0;
+    for (const t_pgm *pgm = frag->head; pgm; pgm = pgm->privy.next)
+      frag_cnt += pgm->usr.name == name;
+    if (!frag_cnt) continue;
+    if (file_nb < CONF_INCLUDE_ORIGIN_MAX) { /* in the order first included */
+      memmove(files + 1, files, file_nb++ * sizeof(*files));
+      files[0] = frag->path;
+    }
+    cnt -= frag_cnt < cnt ? frag_cnt : cnt;
+  }
+  if (cnt && file_nb < CONF_INCLUDE_ORIGIN_MAX) files[file_nb++] = config;
+  if (file_nb == 1) {
+    snprintf(buf, size, "defined more than once in %s", files[0]);
+    return;
+  }
+  len = snprintf(buf, size, "defined in %s", files[0]);
+  for (uint32_t i = 1; i < file_nb && len < size; i++)
+    len += snprintf(buf + len, size - len, "%s%s",
+                    i + 1 < file_nb ? ", " : " & ", files[i]);
+}
+
+bool conf_include_used(void) { return inc.pattern_nb > 0; }
+
+int32_t conf_include_watch(void) {
+  int32_t ret;
+
+  if (!inc.config) return EXIT_FAILURE;
+  conf_watch_clear();
+  ret = conf_watch_add(inc.config);
+  for (uint32_t i = 0; i < inc.pattern_nb; i++)
+    if (conf_watch_add(inc.patterns[i])) ret = EXIT_FAILURE;
+  return ret;
+}
@@ -0,0 +1,44 @@
+#ifndef CONF_INCLUDE_H
+#define CONF_INCLUDE_H
+
+#include "taskmaster.h"
+
+/*
+ * Configuration fragments.
+ * The top-level configuration file may pull other files with
+ * 'include: <glob>' (or a sequence of globs), relative patterns being
+ * resolved from the directory of the configuration file. Each matched file
+ * holds its own 'programs' map and is parsed into its own program set, kept
+ * in a cache along with the hash of its content. A load only runs the yaml
+ * parser on files whose content changed since they were last parsed: the
+ * programs of the others are copied from the cache. A load runs on the reload
+ * thread, loads never overlap.
+ */
+
+#define CONF_INCLUDE_PATTERN_MAX (64) /* include patterns of a config file */
+
+/* start a load of config_file_name: forget the include patterns of the
+ * previous load & mark every cached file as unused */
+void conf_include_begin(const char *config_file_name);
+
+/* add to node the programs of every file matching pattern. Returns a
+ * t_config_error */
+uint8_t conf_include_load(t_tm_node *node, const char *pattern);
+
+/* end a load: if it went through, drop the cached files it didn't include */
+void conf_include_end(bool loaded);
+
+/* write to buf the files defining the program name, cnt times in the
+ * programs of the current load: the included files which do, then config,
+ * the configuration file, for the others */
+void conf_include_origin(const char *config, const char *name, uint32_t cnt,
+                         char *buf, size_t size);
+
+/* true if the last load included files */
+bool conf_include_used(void);
+
+/* watch the configuration file & the include patterns of the last load.
+ * Main thread only, once the load is over */
+int32_t conf_include_watch(void);
+
+#endif
@@ -0,0 +1,154 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <libgen.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <time.h>
+
+#include "ft_log.h"
+#include "taskmaster.h"
+#include "trace.h"
+
+/*
+ * Automatic reload on configuration changes.
+ * The directories of the watched files are watched with inotify, so that
+ * atomic renames of editors & config-management agents are caught as well as
+ * in place writes. The name of a watched file may be a glob pattern, to catch
+ * files of an include directory being created or removed.
+ * The inotify fd is O_ASYNC: SIGIO is raised as soon as events are queued.
+ * Each relevant event (re)arms a one-shot debounce timer which raises SIGHUP
+ * once the files have been quiet for CONF_WATCH_DEBOUNCE_MS, so that bursts of
+ * writes trigger a single reload through the usual SIGHUP path.
+ */
+
+#define CONF_WATCH_MAX (256) /* files watched */
+#define CONF_WATCH_DEBOUNCE_MS (500)
+#define CONF_WATCH_MASK \
+  (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM)
+
+typedef struct s_watched {
+  int32_t wd;       /* watch descriptor of the directory of the file */
+  char *name;       /* name (or pattern) of the file in its directory */
+} t_watched;
+
+static struct {
+  int32_t fd; /* inotify fd, 0 if not started */
+  timer_t debounce;
+  t_watched files[CONF_WATCH_MAX];
+  uint32_t nb;
+} watch;
+
+static bool is_watched(int32_t wd, const char *name) {
+  for (uint32_t i = 0; i < watch.nb; i++)
+    if (watch.files[i].wd == wd && !strcmp(watch.files[i].name, name))
+      return true;
+  return false;
+}
+
+static bool is_matched(int32_t wd, const char *name) {
+  for (uint32_t i = 0; i < watch.nb; i++)
+    if (watch.files[i].wd == wd &&
+        !fnmatch(watch.files[i].name, name, FNM_PERIOD))
+      return true;
+  return false;
+}
+
+/* drain inotify events & push the debounce deadline back if any concerns a
+ * watched file */
+static void sigio_handler(int signb) {
+  UNUSED_PARAM(signb);
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct itimerspec delay = {
+      .it_value = {.tv_sec = CONF_WATCH_DEBOUNCE_MS / 1000,
+                   .tv_nsec = (CONF_WATCH_DEBOUNCE_MS % 1000) * 1000000}};
+  const struct inotify_event *ev;
+  bool changed = false;
+  ssize_t len;
+  int32_t saved_errno = errno;
+
+  while ((len = read(watch.fd, buf, sizeof(buf))) > 0) {
+    for (char *ptr = buf; ptr < buf + len; ptr += sizeof(*ev) + ev->len) {
+      ev = (const struct inotify_event *)ptr;
+      if (ev->len && is_matched(ev->wd, ev->name)) changed = true;
+    }
+  }
+  if (changed) {
+    TM_TRACE(TRACE_RELOAD, "config changed, reload in %d ms",
+             CONF_WATCH_DEBOUNCE_MS);
+    timer_settime(watch.debounce, 0, &delay, NULL);
+  }
+  errno = saved_errno;
+}
+
+/* block SIGIO while the watched files are updated, old gets the former mask */
+static void block_sigio(sigset_t *old) {
+  sigset_t set;
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGIO);
+  sigprocmask(SIG_BLOCK, &set, old);
+}
+
+int32_t conf_watch_add(const char *path) {
+  char dir[PATH_MAX], base[PATH_MAX];
+  int32_t wd, ret = EXIT_FAILURE;
+  sigset_t old;
+
+  if (!watch.fd || watch.nb == CONF_WATCH_MAX) return EXIT_FAILURE;
+  strncpy(dir, path, PATH_MAX - 1)[PATH_MAX - 1] = 0;
+  strncpy(base, path, PATH_MAX - 1)[PATH_MAX - 1] = 0;
+  wd = inotify_add_watch(watch.fd, dirname(dir), CONF_WATCH_MASK);
+  if (wd == -1) return EXIT_FAILURE;
+  block_sigio(&old);
+  if (is_watched(wd, basename(base)))
+    ret = EXIT_SUCCESS;
+  else if ((watch.files[watch.nb].name = strdup(basename(base)))) {
+    watch.files[watch.nb++].wd = wd;
+    ret = EXIT_SUCCESS;
+  }
+  sigprocmask(SIG_SETMASK, &old, NULL);
+  return ret;
+}
+
+/* forget every watched file, the directories watches are kept */
+void conf_watch_clear(void) {
+  sigset_t old;
+
+  block_sigio(&old);
+  for (uint32_t i = 0; i < watch.nb; i++) DESTROY_PTR(watch.files[i].name);
+  watch.nb = 0;
+  sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+static void conf_watch_exit(void) {
+  conf_watch_clear();
+  if (watch.fd > 0) close(watch.fd);
+  timer_delete(watch.debounce);
+}
+
+/* must be called once the SIGHUP handler is set */
+int32_t conf_watch_start(void) {
+  struct sigevent sev = {.sigev_notify = SIGEV_SIGNAL, .sigev_signo = SIGHUP};
+  struct sigaction act = {.sa_handler = sigio_handler, .sa_flags = SA_RESTART};
+  int32_t fd;
+
+  if (watch.fd) return EXIT_SUCCESS;
+  if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) return EXIT_FAILURE;
+  if (timer_create(CLOCK_MONOTONIC, &sev, &watch.debounce) == -1) {
+    close(fd);
+    return EXIT_FAILURE;
+  }
+  sigemptyset(&act.sa_mask);
+  sigaction(SIGIO, &act, NULL);
+  if (fcntl(fd, F_SETOWN, getpid()) == -1 ||
+      fcntl(fd, F_SETFL, O_ASYNC | O_NONBLOCK) == -1) {
+    close(fd);
+    timer_delete(watch.debounce);
+    return EXIT_FAILURE;
+  }
+  watch.fd = fd;
+  atexit(conf_watch_exit);
+  return EXIT_SUCCESS;
+}
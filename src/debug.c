@@ -14,6 +14,10 @@ void print_pgm_list(t_pgm *head) {
         printf("env: (%p)\n", pgm->env.array_val);
         for (uint32_t i = 0; pgm->env.array_val && i < pgm->env.array_size; i++)
             printf("\t(%s)\n", pgm->env.array_val[i]);
+        printf("stdout rotate: %lu bytes, %d backups\n",
+               (unsigned long)pgm->out_rotate.maxbytes, pgm->out_rotate.backups);
+        printf("stderr rotate: %lu bytes, %d backups\n",
+               (unsigned long)pgm->err_rotate.maxbytes, pgm->err_rotate.backups);
         printf("exitcodes: (%p)\n", pgm->exitcodes.array_val);
         for (uint32_t i = 0; i < pgm->exitcodes.array_size; i++)
             printf("\t(%d)\n", pgm->exitcodes.array_val[i]);
@@ -1,26 +1,22 @@
+#include "shared.h"
 #include "taskmaster.h"
 
 static void destroy_pgm_user_attributes(t_pgm_usr *pgm) {
-  DESTROY_PTR(pgm->name);
-  if (pgm->cmd) {
-    for (uint32_t i = 0; pgm->cmd[i]; i++) DESTROY_PTR(pgm->cmd[i]);
-    DESTROY_PTR(pgm->cmd);
-  }
-  if (pgm->env.array_val) {
-    for (uint32_t i = 0; i < pgm->env.array_size; i++)
-      DESTROY_PTR(pgm->env.array_val[i]);
-    DESTROY_PTR(pgm->env.array_val);
-  }
-  DESTROY_PTR(pgm->std_out);
-  DESTROY_PTR(pgm->std_err);
-  DESTROY_PTR(pgm->workingdir);
-  DESTROY_PTR(pgm->exitcodes.array_val);
+  shr_unref(pgm->name);
+  shr_unref(pgm->cmd);
+  shr_unref(pgm->env.array_val);
+  shr_unref(pgm->std_out);
+  shr_unref(pgm->std_err);
+  shr_unref(pgm->workingdir);
+  shr_unref(pgm->exitcodes.array_val);
   bzero(pgm, sizeof(*pgm));
 }
 
 static void destroy_pgm_private_attributes(t_pgm_private *pgm) {
   if (pgm->log.out > 0) close(pgm->log.out);
   if (pgm->log.err > 0) close(pgm->log.err);
+  free(pgm->metrics.exits);
+  for (int32_t i = 0; i < LAT_NB; i++) free(pgm->metrics.lat[i]);
   bzero(pgm, sizeof(*pgm));
 }
 
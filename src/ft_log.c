@@ -2,9 +2,14 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -15,12 +20,45 @@
 #define FT_LOGFILE_FLAGS (O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC)
 #define DFL_PGM_NAME "unknown"
 
+#define SINK_BATCH (64)       /* records queued before a sendmmsg() */
+#define SINK_RETRY_SEC (5)    /* delay between two reconnection attempts */
+#define SINK_FACILITY LOG_DAEMON
+#define SINK_HDR_LEN (256)    /* RFC5424 header, up to the message */
+
+typedef struct s_sink_rec {
+    int level;
+    struct timespec ts;
+    size_t len;
+    char msg[BUF_LOG_LEN];
+} t_sink_rec;
+
 static char *ident;
 static int log_fd;
 static char log_filename[128];
+static size_t log_size;                 /* current size of the log file */
+static unsigned long long log_written;  /* bytes written & sent, ever */
+static size_t rotate_maxbytes;          /* rotate log file above this size */
+static int rotate_backups;              /* how many old log files are kept */
+static ft_log_rotate_cb rotate_cb;      /* user handling of the old file */
+static __thread ft_log_capture_cb capture_cb; /* records of this thread */
+static __thread void *capture_arg;
+
+static struct {
+    int on;                         /* records go to the socket first */
+    int fd;                         /* connected datagram socket or -1 */
+    struct sockaddr_un addr;
+    time_t retry;                   /* next reconnection attempt */
+    char host[64];
+    unsigned int cnt;               /* records queued */
+    t_sink_rec queue[SINK_BATCH];
+} sink = {.fd = -1};
+
+static void write_file(int level, time_t sec, const char *msg, size_t len);
 
 /* atexit() callback, cleanup before exit */
 static void ft_log_exit() {
+    ft_log_flush();
+    if (sink.fd != -1) close(sink.fd);
     if (ident) free(ident);
     if (log_fd) close(log_fd);
 }
@@ -64,28 +102,221 @@ int ft_openlog(char *identity, const char *logfile) {
     return EXIT_SUCCESS;
 }
 
-void ft_log(int level, const char *format, ...) {
-    time_t curtime;
+int ft_log_rotate(size_t maxbytes, int backups, ft_log_rotate_cb on_rotate) {
+    struct stat statbuf;
+
+    if (log_fd <= 0 || fstat(log_fd, &statbuf) == -1) return EXIT_FAILURE;
+    log_size = statbuf.st_size;
+    rotate_maxbytes = maxbytes;
+    rotate_backups = backups;
+    rotate_cb = on_rotate;
+    return EXIT_SUCCESS;
+}
+
+/* rename the log file as <log>.1 (shifting older ones), or as a pending name
+ * given to rotate_cb, then continue on a fresh file. The new file replaces
+ * log_fd with dup2() so that log_fd is always valid. */
+static void rotate_logfile() {
+    static unsigned int cnt;
+    char old[sizeof(log_filename) + 16], new[sizeof(log_filename) + 16];
+    int fd;
+
+    log_size = 0;
+    if (!rotate_backups) {
+        ftruncate(log_fd, 0);
+        return;
+    }
+    if (rotate_cb) {
+        snprintf(new, sizeof(new), "%s.rot%u", log_filename, cnt++);
+    } else {
+        for (int i = rotate_backups - 1; i > 0; i--) {
+            snprintf(old, sizeof(old), "%s.%d", log_filename, i);
+            snprintf(new, sizeof(new), "%s.%d", log_filename, i + 1);
+            rename(old, new);
+        }
+        snprintf(new, sizeof(new), "%s.1", log_filename);
+    }
+    if (rename(log_filename, new) == -1) return;
+    fd = open(log_filename, FT_LOGFILE_FLAGS, FT_LOGFILE_PERM);
+    if (fd == -1) return;
+    dup2(fd, log_fd);
+    close(fd);
+    if (rotate_cb) rotate_cb(new, log_filename, rotate_backups);
+}
+
+/* ================================== sink ================================== */
+
+static int sink_connect() {
+    sink.fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sink.fd == -1) return EXIT_FAILURE;
+    if (connect(sink.fd, (struct sockaddr *)&sink.addr, sizeof(sink.addr))) {
+        close(sink.fd);
+        sink.fd = -1;
+        sink.retry = time(NULL) + SINK_RETRY_SEC;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int ft_log_sink(const char *sockpath) {
+    if (!sockpath || strlen(sockpath) >= sizeof(sink.addr.sun_path))
+        return EXIT_FAILURE;
+    sink.addr.sun_family = AF_UNIX;
+    strcpy(sink.addr.sun_path, sockpath);
+    if (gethostname(sink.host, sizeof(sink.host)) || !*sink.host)
+        strcpy(sink.host, "-");
+    sink.on = 1;
+    return sink_connect();
+}
+
+/* <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA */
+static size_t sink_header(char *buf, const t_sink_rec *rec) {
     struct tm loctime;
     size_t len;
-    va_list args;
-    char buf[BUF_LOG_LEN] = {0};
+    char zone[8];
+
+    localtime_r(&rec->ts.tv_sec, &loctime);
+    strftime(zone, sizeof(zone), "%z", &loctime); /* +hhmm -> +hh:mm */
+    len = snprintf(buf, SINK_HDR_LEN, "<%d>1 ", SINK_FACILITY | rec->level);
+    len += strftime(buf + len, SINK_HDR_LEN - len, "%FT%T", &loctime);
+    len += snprintf(buf + len, SINK_HDR_LEN - len,
+                    ".%06ld%.3s:%s %s %s %d - - ", rec->ts.tv_nsec / 1000,
+                    zone, zone + 3, sink.host, ident, getpid());
+    return len < SINK_HDR_LEN ? len : SINK_HDR_LEN - 1;
+}
+
+/* the queue is shared with the signal handlers which log: every signal is
+ * blocked while it is filled or flushed */
+static void sink_lock(sigset_t *old) {
+    sigset_t all;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, old);
+}
+
+static void sink_unlock(const sigset_t *old) {
+    pthread_sigmask(SIG_SETMASK, old, NULL);
+}
+
+/* send the records queued in one sendmmsg() call. Records which couldn't be
+ * sent, because the collector is gone or its socket is full, are written to
+ * the log file instead. */
+static void sink_flush() {
+    struct mmsghdr msgs[SINK_BATCH] = {0};
+    struct iovec iov[SINK_BATCH][2];
+    char hdr[SINK_BATCH][SINK_HDR_LEN];
+    unsigned int sent = 0, cnt = sink.cnt;
+    int ret;
+
+    if (!cnt) return;
+    sink.cnt = 0;
+    if (sink.fd == -1 && time(NULL) >= sink.retry) sink_connect();
+    for (unsigned int i = 0; sink.fd != -1 && i < cnt; i++) {
+        iov[i][0].iov_base = hdr[i];
+        iov[i][0].iov_len = sink_header(hdr[i], &sink.queue[i]);
+        iov[i][1].iov_base = sink.queue[i].msg;
+        iov[i][1].iov_len = sink.queue[i].len;
+        msgs[i].msg_hdr.msg_iov = iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+    while (sink.fd != -1 && sent < cnt) {
+        ret = sendmmsg(sink.fd, msgs + sent, cnt - sent, 0);
+        if (ret == -1 && errno == EINTR) continue;
+        if (ret <= 0) {
+            if (errno != EAGAIN) { /* collector is gone, reconnect later */
+                close(sink.fd);
+                sink.fd = -1;
+                sink.retry = time(NULL) + SINK_RETRY_SEC;
+            }
+            break;
+        }
+        for (int i = 0; i < ret; i++)
+            log_written += iov[sent + i][0].iov_len + iov[sent + i][1].iov_len;
+        sent += ret;
+    }
+    for (; sent < cnt; sent++)
+        write_file(sink.queue[sent].level, sink.queue[sent].ts.tv_sec,
+                   sink.queue[sent].msg, sink.queue[sent].len);
+}
+
+void ft_log_flush() {
+    sigset_t old;
+
+    if (!sink.cnt) return; /* a record queued by a handler flushes itself */
+    sink_lock(&old);
+    sink_flush();
+    sink_unlock(&old);
+}
+
+static void sink_push(int level, const char *msg, size_t len) {
+    t_sink_rec *rec;
+    sigset_t old;
+
+    sink_lock(&old);
+    rec = &sink.queue[sink.cnt++];
+    rec->level = level;
+    clock_gettime(CLOCK_REALTIME, &rec->ts);
+    memcpy(rec->msg, msg, len);
+    rec->len = len;
+    if (sink.cnt == SINK_BATCH || level <= FT_LOG_WARNING) sink_flush();
+    sink_unlock(&old);
+}
+
+/* ================================== log =================================== */
+
+/* write a record as 'time identity level : msg' to the log file */
+static void write_file(int level, time_t sec, const char *msg, size_t len) {
+    struct tm loctime;
+    size_t hdr_len;
+    char buf[BUF_LOG_LEN + 64];
     const char log_lvl[FT_LOGLVL_NB][32] = {"[EMERG]", "[ALERT]",   "[CRIT]",
                                             "[ERR]",   "[WARNING]", "[NOTICE]",
                                             "[INFO]",  "[DEBUG]"};
 
-    if (!ident)
-        if (ft_openlog(NULL, NULL)) return;
     if (log_fd == 0 || log_fd == -1) return;
-    if (level < 0 || level >= FT_LOGLVL_NB) level = FT_LOG_INFO;
-    curtime = time(NULL);
-    if (localtime_r(&curtime, &loctime) != &loctime) return;
-    len = strftime(buf, sizeof(buf), "%F, %T ", &loctime);
-    len += snprintf(buf + len, sizeof(buf) - len, "%s %s: ", ident,
-                    log_lvl[level]);
+    if (localtime_r(&sec, &loctime) != &loctime) return;
+    hdr_len = strftime(buf, sizeof(buf), "%F, %T ", &loctime);
+    hdr_len += snprintf(buf + hdr_len, sizeof(buf) - hdr_len, "%s %s: ", ident,
+                        log_lvl[level]);
+    if (hdr_len + len > sizeof(buf) - 1) len = sizeof(buf) - 1 - hdr_len;
+    memcpy(buf + hdr_len, msg, len);
+    len += hdr_len;
+    buf[len++] = '\n';
+    write(log_fd, buf, len);
+    log_size += len;
+    log_written += len;
+    if (rotate_maxbytes && log_size >= rotate_maxbytes) rotate_logfile();
+}
+
+unsigned long long ft_log_bytes(void) { return log_written; }
+
+void ft_log_capture(ft_log_capture_cb on_record, void *arg) {
+    capture_cb = on_record;
+    capture_arg = arg;
+}
+
+void ft_log(int level, const char *format, ...) {
+    va_list args;
+
     va_start(args, format);
-    len += vsnprintf(buf + len, sizeof(buf) - len, format, args);
+    ft_vlog(level, format, args);
     va_end(args);
-    len += snprintf(buf + len, sizeof(buf) - len, "\n");
-    write(log_fd, buf, len);
+}
+
+void ft_vlog(int level, const char *format, va_list args) {
+    char msg[BUF_LOG_LEN];
+    int len;
+
+    if (!ident)
+        if (ft_openlog(NULL, NULL)) return;
+    if (level < 0 || level >= FT_LOGLVL_NB) level = FT_LOG_INFO;
+    len = vsnprintf(msg, sizeof(msg), format, args);
+    if (len < 0) return;
+    if ((size_t)len > sizeof(msg) - 1) len = sizeof(msg) - 1; /* truncated */
+    if (capture_cb)
+        capture_cb(level, msg, len, capture_arg);
+    else if (sink.on)
+        sink_push(level, msg, len);
+    else
+        write_file(level, time(NULL), msg, len);
 }
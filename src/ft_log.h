@@ -1,6 +1,8 @@
 #ifndef FT_LOG_H
 #define FT_LOG_H
 
+#include <stdarg.h>
+#include <stddef.h>
 #include <syslog.h>
 
 #define FT_LOG_EMERG LOG_EMERG     /* 0 system is unusable */
@@ -18,6 +20,40 @@
  * logfile must be string literal */
 int ft_openlog(char *identity, const char *logfile);
 
+/* callback given the old log file 'rotated', the log file name and how many
+ * backups to keep. It must rename or remove 'rotated'. */
+typedef void (*ft_log_rotate_cb)(const char *rotated, const char *logfile,
+                                 int backups);
+
+/* Rotate the log file when it grows above maxbytes (0 disables rotation).
+ * Without on_rotate, old files are kept as <logfile>.1 ... <logfile>.backups.
+ * With it, the old file is renamed to a pending name and handed to on_rotate.
+ * Must be called after ft_openlog(). Returns 1 on error. */
+int ft_log_rotate(size_t maxbytes, int backups, ft_log_rotate_cb on_rotate);
+
+/* Ship records to the local datagram socket 'sockpath' (e.g. /dev/log) in
+ * RFC5424 format instead of the log file. Records are queued and sent by
+ * batches with sendmmsg(): when the queue is full, on a record of level
+ * FT_LOG_WARNING or more urgent, or on ft_log_flush(). While the socket is
+ * unavailable records fall back to the log file, and reconnection is retried
+ * every few seconds. Returns 1 if the socket couldn't be reached yet. */
+int ft_log_sink(const char *sockpath);
+
+/* send the records queued for the sink, if any */
+void ft_log_flush(void);
+
+/* bytes of records written to the log file or sent to the sink so far */
+unsigned long long ft_log_bytes(void);
+
+/* callback given a formatted record instead of the log */
+typedef void (*ft_log_capture_cb)(int level, const char *msg, size_t len,
+                                  void *arg);
+
+/* Hand the records logged by the calling thread to on_record instead of
+ * writing them, until called again with NULL. ft_log() isn't thread safe:
+ * other threads log through this, their owner replaying the records. */
+void ft_log_capture(ft_log_capture_cb on_record, void *arg);
+
 /* Logs at this format: 'time identity level : user_format' to the file given
  * in ft_openlog() by the user or to <identity>.log.
  * Main API function. ft_log() can try to initialize itself but it is better
@@ -25,4 +61,7 @@ int ft_openlog(char *identity, const char *logfile);
  * 'level' macros to use can be found in ft_log.h */
 void ft_log(int level, const char *format, ...);
 
+/* same as ft_log() with a va_list, for user wrappers */
+void ft_vlog(int level, const char *format, va_list args);
+
 #endif
@@ -0,0 +1,240 @@
+#include "ft_lz.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HASH_LOG (12)     /* hash table of 4096 entries */
+#define MIN_MATCH (4)     /* shortest match encoded */
+#define LAST_LITERALS (5) /* the last bytes of a block are always literals */
+#define MF_LIMIT (12)     /* no match can start in the last MF_LIMIT bytes */
+#define MAX_OFFSET (65535)
+#define RUN_MASK (15) /* 4 bits length fields of a token */
+
+/* ============================== block codec =============================== */
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash4(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - HASH_LOG);
+}
+
+/* write the part of a length which doesn't fit in the token */
+static uint8_t *write_len(uint8_t *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/* emit a sequence: token | literals length | literals | offset | match length.
+ * A sequence without offset (last one of the block) has match_len < 0 */
+static uint8_t *write_seq(uint8_t *op, const uint8_t *oend,
+                          const uint8_t *anchor, size_t lit, size_t offset,
+                          int64_t match_len) {
+    uint8_t *token = op++;
+
+    if (op + lit + (lit / 255) + 1 + 2 + (match_len / 255) + 1 > oend)
+        return NULL;
+    *token = (lit >= RUN_MASK ? RUN_MASK : lit) << 4;
+    if (lit >= RUN_MASK) op = write_len(op, lit - RUN_MASK);
+    memcpy(op, anchor, lit);
+    op += lit;
+    if (match_len < 0) return op;
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    *token |= (match_len >= RUN_MASK ? RUN_MASK : match_len);
+    if (match_len >= RUN_MASK) op = write_len(op, match_len - RUN_MASK);
+    return op;
+}
+
+size_t ft_lz_compress(const uint8_t *src, size_t len, uint8_t *dst,
+                      size_t cap) {
+    uint32_t table[1 << HASH_LOG] = {0};
+    const uint8_t *ip = src, *anchor = src, *iend = src + len, *ref, *mp;
+    const uint8_t *oend = dst + cap;
+    uint8_t *op = dst;
+    uint32_t seq, h;
+
+    while (len >= MF_LIMIT && ip < iend - MF_LIMIT) {
+        seq = read32(ip), h = hash4(seq);
+        ref = src + table[h];
+        table[h] = ip - src;
+        if (ref >= ip || ip - ref > MAX_OFFSET || read32(ref) != seq) {
+            ip++;
+            continue;
+        }
+        /* extend the match forward then backward */
+        mp = ip + MIN_MATCH;
+        for (const uint8_t *rp = ref + MIN_MATCH;
+             mp < iend - LAST_LITERALS && *mp == *rp; mp++, rp++)
+            ;
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) ip--, ref--;
+        op = write_seq(op, oend, anchor, ip - anchor, ip - ref,
+                       mp - ip - MIN_MATCH);
+        if (!op) return 0;
+        anchor = ip = mp;
+    }
+    op = write_seq(op, oend, anchor, iend - anchor, 0, -1);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+/* read the part of a length which didn't fit in the token */
+static int read_len(const uint8_t **ip, const uint8_t *iend, size_t *len) {
+    uint8_t b;
+
+    do {
+        if (*ip >= iend) return 1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+ssize_t ft_lz_decompress(const uint8_t *src, size_t len, uint8_t *dst,
+                         size_t cap) {
+    const uint8_t *ip = src, *iend = src + len, *ref;
+    uint8_t *op = dst, *oend = dst + cap, token;
+    size_t lit, offset, match_len;
+
+    while (ip < iend) {
+        token = *ip++;
+        lit = token >> 4;
+        if (lit == RUN_MASK && read_len(&ip, iend, &lit)) return -1;
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return -1;
+        memcpy(op, ip, lit);
+        op += lit, ip += lit;
+        if (ip == iend) break; /* last sequence has no match */
+
+        if (iend - ip < 2) return -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > (size_t)(op - dst)) return -1;
+        match_len = token & RUN_MASK;
+        if (match_len == RUN_MASK && read_len(&ip, iend, &match_len))
+            return -1;
+        match_len += MIN_MATCH;
+        if (match_len > (size_t)(oend - op)) return -1;
+        ref = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, ref, match_len);
+            op += match_len;
+        } else { /* overlapping match: repeat the pattern byte per byte */
+            while (match_len--) *op++ = *ref++;
+        }
+    }
+    return op - dst;
+}
+
+/* ================================ streams ================================= */
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = v, p[1] = v >> 8, p[2] = v >> 16, p[3] = v >> 24;
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* read until size bytes or EOF. Returns bytes read or -1 */
+static ssize_t read_full(int fd, uint8_t *buf, size_t size) {
+    size_t total = 0;
+    ssize_t rd;
+
+    while (total < size) {
+        rd = read(fd, buf + total, size - total);
+        if (rd == -1) return -1;
+        if (!rd) break;
+        total += rd;
+    }
+    return total;
+}
+
+static int write_full(int fd, const uint8_t *buf, size_t size) {
+    ssize_t wr;
+
+    while (size) {
+        wr = write(fd, buf, size);
+        if (wr <= 0) return 1;
+        buf += wr;
+        size -= wr;
+    }
+    return 0;
+}
+
+int ft_lz_compress_fd(int fd_in, int fd_out, void (*block_cb)(void *),
+                      void *arg) {
+    uint8_t *raw = malloc(FT_LZ_BLOCK_SZ), *comp;
+    uint8_t hdr[8] = FT_LZ_MAGIC;
+    ssize_t rd;
+    size_t comp_len;
+    int ret = 1;
+
+    comp = malloc(8 + FT_LZ_BOUND(FT_LZ_BLOCK_SZ));
+    if (!raw || !comp) goto end;
+    hdr[4] = FT_LZ_VERSION;
+    if (write_full(fd_out, hdr, FT_LZ_HEADER_SZ)) goto end;
+    while ((rd = read_full(fd_in, raw, FT_LZ_BLOCK_SZ)) > 0) {
+        comp_len = ft_lz_compress(raw, rd, comp + 8, rd);
+        if (!comp_len) { /* incompressible data, store it */
+            memcpy(comp + 8, raw, rd);
+            put32(comp, rd | FT_LZ_STORED);
+            comp_len = rd;
+        } else
+            put32(comp, comp_len);
+        put32(comp + 4, rd);
+        if (write_full(fd_out, comp, comp_len + 8)) goto end;
+        if (block_cb) block_cb(arg);
+    }
+    put32(hdr, 0); /* end of stream */
+    if (rd == -1 || write_full(fd_out, hdr, 4)) goto end;
+    ret = 0;
+end:
+    free(raw);
+    free(comp);
+    return ret;
+}
+
+int ft_lz_decompress_fd(int fd_in, int fd_out) {
+    uint8_t *raw = malloc(FT_LZ_BLOCK_SZ), *comp;
+    uint8_t hdr[8];
+    uint32_t block_len, raw_len;
+    int ret = 1;
+
+    comp = malloc(FT_LZ_BOUND(FT_LZ_BLOCK_SZ));
+    if (!raw || !comp) goto end;
+    if (read_full(fd_in, hdr, FT_LZ_HEADER_SZ) != FT_LZ_HEADER_SZ ||
+        memcmp(hdr, FT_LZ_MAGIC, 4) || hdr[4] != FT_LZ_VERSION)
+        goto end;
+    while (1) {
+        if (read_full(fd_in, hdr, 4) != 4) goto end;
+        if (!(block_len = get32(hdr))) break; /* end of stream */
+        if (read_full(fd_in, hdr + 4, 4) != 4) goto end;
+        raw_len = get32(hdr + 4);
+        if (raw_len > FT_LZ_BLOCK_SZ) goto end;
+        if (block_len & FT_LZ_STORED) {
+            if ((block_len & ~FT_LZ_STORED) != raw_len ||
+                read_full(fd_in, raw, raw_len) != raw_len)
+                goto end;
+        } else {
+            if (block_len > FT_LZ_BOUND(FT_LZ_BLOCK_SZ) ||
+                read_full(fd_in, comp, block_len) != block_len ||
+                ft_lz_decompress(comp, block_len, raw, FT_LZ_BLOCK_SZ) !=
+                    raw_len)
+                goto end;
+        }
+        if (write_full(fd_out, raw, raw_len)) goto end;
+    }
+    ret = 0;
+end:
+    free(raw);
+    free(comp);
+    return ret;
+}
@@ -0,0 +1,43 @@
+#ifndef FT_LZ_H
+#define FT_LZ_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+/*
+ * Small self-contained LZ77 compressor (LZ4-like block format).
+ * A stream is made of a header followed by independent blocks:
+ * 'TMLZ' version | { u32 block_len | u32 raw_len | data }... | u32 0
+ * The high bit of block_len flags a block stored without compression.
+ */
+
+#define FT_LZ_MAGIC "TMLZ"
+#define FT_LZ_VERSION (1)
+#define FT_LZ_HEADER_SZ (5)
+#define FT_LZ_BLOCK_SZ (64 * 1024) /* raw bytes per block */
+#define FT_LZ_STORED (0x80000000u) /* block_len flag: stored block */
+#define FT_LZ_EXT ".lz"            /* extension of compressed files */
+
+/* worst case size of a compressed block of n bytes */
+#define FT_LZ_BOUND(n) ((n) + ((n) / 255) + 16)
+
+/* Compress len bytes of src into dst of cap bytes.
+ * Returns the compressed size, or 0 if it doesn't fit in cap. */
+size_t ft_lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+/* Decompress a block of len bytes into dst of cap bytes.
+ * Returns the decompressed size, or -1 if the block is corrupted. */
+ssize_t ft_lz_decompress(const uint8_t *src, size_t len, uint8_t *dst,
+                         size_t cap);
+
+/* Compress the whole fd_in stream to fd_out. If block_cb isn't NULL it is
+ * called after each block, which lets the caller throttle the work.
+ * Returns 0 on success, 1 on error. */
+int ft_lz_compress_fd(int fd_in, int fd_out, void (*block_cb)(void *),
+                      void *arg);
+
+/* Decompress a stream made by ft_lz_compress_fd() block by block.
+ * Returns 0 on success, 1 on read/write error or corrupted stream. */
+int ft_lz_decompress_fd(int fd_in, int fd_out);
+
+#endif
@@ -295,6 +295,7 @@ static void rl_next_history_entry(t_readline_state *rl) {
 /* return code to avoid 0 initialization of rl_compl_idx at each refresh */
 #define RL_COMPLETION (4242)
 static char **rl_compl = NULL;   /* completion strings copied from user call */
+static void (*rl_compl_free)(void *) = NULL; /* frees a completion string */
 static int32_t rl_compl_sz = 0;  /* size of rl_compl */
 static int32_t rl_compl_idx = 0; /* idx to rl_compl of the current completion */
 static int32_t rl_compl_init = 0; /* is it the first tab press or not */
@@ -393,19 +394,23 @@ static void rl_completion(t_readline_state *rl, circular_buf_it iterator) {
 static void destroy_completion() {
   if (!rl_compl) return;
   for (int32_t i = 0; i < rl_compl_sz; i++) {
-    free(rl_compl[i]);
+    rl_compl_free(rl_compl[i]);
     rl_compl[i] = NULL;
   }
   free(rl_compl);
   rl_compl = NULL;
 }
 
-int32_t ft_readline_add_completion(char **cmds, size_t nb) {
+int32_t ft_readline_add_completion(char **cmds, size_t nb,
+                                   void (*str_free)(void *)) {
   if (!nb || !cmds) return EXIT_FAILURE;
-  if (rl_compl) destroy_completion();
+  if (rl_compl)
+    destroy_completion();
+  else
+    atexit(destroy_completion);
   rl_compl_sz = nb;
   rl_compl = cmds;
-  atexit(destroy_completion);
+  rl_compl_free = str_free ? str_free : free;
   return EXIT_SUCCESS;
 }
 
@@ -58,10 +58,12 @@ typedef struct readline_state {
 char *ft_readline(const char *prompt);
 
 /* ft_readline API function to add commands to completion engine.
- * cmds must be dynamically allocated and not free by the user.
+ * cmds must be dynamically allocated and not free by the user: its strings
+ * are released with str_free (free if NULL).
  * Implemented as a circular buffer.
  * returns 1 on error, 0 on success */
-int32_t ft_readline_add_completion(char **cmds, size_t nb);
+int32_t ft_readline_add_completion(char **cmds, size_t nb,
+                                   void (*str_free)(void *));
 
 /* API function to add a new entry in the ft_readline history. This is
  * implemented as a circular buffer. Does'nt add empty line, space-filled line
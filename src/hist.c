@@ -0,0 +1,49 @@
+#include "hist.h"
+
+#include <stdlib.h>
+
+static uint32_t bucket_idx(uint64_t us) {
+  uint32_t exp;
+
+  if (us < HIST_SUB_NB) return us;
+  exp = 63 - __builtin_clzll(us);
+  if (exp >= HIST_MAX_BITS) return HIST_BUCKETS - 1;
+  return (exp - HIST_SUB_BITS + 1) * HIST_SUB_NB +
+         ((us >> (exp - HIST_SUB_BITS)) - HIST_SUB_NB);
+}
+
+/* highest value falling in bucket idx */
+static uint64_t bucket_top(uint32_t idx) {
+  uint32_t shift;
+
+  if (idx < HIST_SUB_NB) return idx;
+  shift = idx / HIST_SUB_NB - 1;
+  return (((uint64_t)(idx % HIST_SUB_NB + HIST_SUB_NB + 1)) << shift) - 1;
+}
+
+void hist_record(t_hist **hist, int64_t us) {
+  t_hist *h = *hist;
+
+  if (!h && !(h = *hist = calloc(1, sizeof(*h)))) return;
+  if (us < 0) us = 0;
+  h->buckets[bucket_idx(us)]++;
+  h->cnt++;
+  h->sum += us;
+  if ((uint64_t)us > h->max) h->max = us;
+}
+
+uint64_t hist_quantile(const t_hist *hist, double p) {
+  uint64_t rank, seen = 0, top;
+
+  if (!hist || !hist->cnt) return 0;
+  rank = p * hist->cnt;
+  if (rank >= hist->cnt) rank = hist->cnt - 1;
+  for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen > rank) {
+      top = bucket_top(i);
+      return top < hist->max ? top : hist->max;
+    }
+  }
+  return hist->max;
+}
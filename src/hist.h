@@ -0,0 +1,34 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <inttypes.h>
+
+/*
+ * Log-bucketed latency histograms, in the manner of HdrHistogram.
+ * A value (in us) falls in the bucket of its power of two, split into
+ * 2^HIST_SUB_BITS linear sub-buckets: any value is known with a relative
+ * error under 1 / 2^HIST_SUB_BITS, whatever its magnitude, for a fixed size.
+ * Values below 2^HIST_SUB_BITS get a bucket each. Recording is a few shifts &
+ * an increment, a histogram being allocated along its first value.
+ */
+
+#define HIST_SUB_BITS (3)
+#define HIST_SUB_NB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS (40) /* values are capped to 2^40 us, about 12 days */
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_NB)
+
+typedef struct s_hist {
+  uint64_t cnt;
+  uint64_t sum; /* us */
+  uint64_t max; /* us */
+  uint32_t buckets[HIST_BUCKETS];
+} t_hist;
+
+/* add a value in us to *hist, which is allocated at the first one */
+void hist_record(t_hist **hist, int64_t us);
+
+/* highest value of the bucket where the p quantile (0 to 1) falls, in us.
+ * Never above the max recorded */
+uint64_t hist_quantile(const t_hist *hist, double p);
+
+#endif
@@ -0,0 +1,162 @@
+#include "journal.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "taskmaster.h"
+
+#define JOURNAL_FILE_SZ \
+  (JOURNAL_HDR_SZ + (JOURNAL_CAPACITY * sizeof(t_journal_rec)))
+
+_Static_assert(sizeof(t_journal_hdr) <= JOURNAL_HDR_SZ,
+               "journal header doesn't fit");
+_Static_assert(sizeof(t_journal_rec) == 64, "journal record must be 64 bytes");
+
+static t_journal_hdr *hdr; /* mapped header, NULL if journal is disabled */
+static t_journal_rec *ring;
+
+static const char ev_names[JRNL_EV_NB][16] = {
+    "\0",        "spawned\0",  "running\0", "start failed\0",
+    "exited\0",  "signaled\0", "stopped\0", "signal sent\0",
+    "restarted\0", "timer\0",  "reload\0", "scaled\0",
+};
+
+static const char reload_names[JRNL_RELOAD_ROLL + 1][8] = {
+    "\0", "soft\0", "hard\0", "add\0", "del\0", "rolling",
+};
+
+static const char timer_names[MAX_TIMER_EV_NB][16] = {
+    "\0", "start\0", "stop\0", "logrotate\0", "kill\0", "sample\0",
+};
+
+static uint64_t bloom_bit(const char *name) {
+  uint64_t h = 14695981039346656037ULL; /* FNV-1a */
+
+  for (uint32_t i = 0; i < JOURNAL_NAME_SZ - 1 && name[i]; i++)
+    h = (h ^ (uint8_t)name[i]) * 1099511628211ULL;
+  return 1ULL << (h % 64);
+}
+
+static int64_t now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void journal_reset(void) {
+  memset(hdr, 0, JOURNAL_FILE_SZ);
+  memcpy(hdr->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+  hdr->version = JOURNAL_VERSION;
+  hdr->capacity = JOURNAL_CAPACITY;
+  hdr->next_seq = 1;
+}
+
+int32_t journal_open(const char *path) {
+  int32_t fd;
+  void *map;
+
+  fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd == -1) return EXIT_FAILURE;
+  if (ftruncate(fd, JOURNAL_FILE_SZ) == -1) {
+    close(fd);
+    return EXIT_FAILURE;
+  }
+  map = mmap(NULL, JOURNAL_FILE_SZ, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return EXIT_FAILURE;
+  hdr = map;
+  ring = (t_journal_rec *)((char *)map + JOURNAL_HDR_SZ);
+  if (memcmp(hdr->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) ||
+      hdr->version != JOURNAL_VERSION || hdr->capacity != JOURNAL_CAPACITY ||
+      !hdr->next_seq)
+    journal_reset();
+  return EXIT_SUCCESS;
+}
+
+void journal_record(t_journal_ev ev, const char *pgm, pid_t pid,
+                    int32_t value) {
+  t_journal_rec *rec;
+  t_journal_chunk *chunk;
+  uint64_t seq, slot;
+
+  if (!hdr) return;
+  seq = __atomic_fetch_add(&hdr->next_seq, 1, __ATOMIC_RELAXED);
+  slot = seq % JOURNAL_CAPACITY;
+  rec = &ring[slot];
+  chunk = &hdr->index[slot / JOURNAL_CHUNK_SZ];
+
+  rec->seq = 0; /* unpublish the slot while it is rewritten */
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  rec->time_us = now_us();
+  rec->pid = pid, rec->value = value, rec->type = ev;
+  strncpy(rec->pgm, pgm ? pgm : "", JOURNAL_NAME_SZ - 1);
+  rec->pgm[JOURNAL_NAME_SZ - 1] = 0;
+  if (!(slot % JOURNAL_CHUNK_SZ) || !chunk->first_us) {
+    chunk->first_us = rec->time_us;
+    chunk->bloom = 0;
+  }
+  chunk->last_us = rec->time_us;
+  chunk->bloom |= bloom_bit(rec->pgm);
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  rec->seq = seq;
+}
+
+static void print_rec(FILE *out, const t_journal_rec *rec) {
+  char date[32];
+  time_t sec = rec->time_us / 1000000;
+  struct tm tm;
+
+  localtime_r(&sec, &tm);
+  strftime(date, sizeof(date), "%F %T", &tm);
+  fprintf(out, "%s.%06ld %s <%d> %s", date, (long)(rec->time_us % 1000000),
+          rec->pgm, rec->pid, ev_names[rec->type]);
+  if (rec->type == JRNL_RELOAD && rec->value <= JRNL_RELOAD_ROLL)
+    fprintf(out, " %s", reload_names[rec->value]);
+  else if (rec->type == JRNL_EXIT)
+    fprintf(out, " with status %d", rec->value);
+  else if (rec->type == JRNL_SIGNALED || rec->type == JRNL_STOPPED ||
+           rec->type == JRNL_SIGNAL)
+    fprintf(out, " %d (%s)", rec->value, sigabbrev_np(rec->value));
+  else if (rec->type == JRNL_TIMER && rec->value < MAX_TIMER_EV_NB)
+    fprintf(out, " %s", timer_names[rec->value]);
+  else
+    fprintf(out, " %d", rec->value);
+  fputc('\n', out);
+}
+
+/* walk records from the oldest to the newest, skipping whole chunks whose
+ * time range or bloom filter exclude the query. The chunk being written is
+ * always scanned: its index was reset but it still holds the oldest records */
+uint32_t journal_query(FILE *out, const char *pgm, int64_t since_us,
+                       int64_t until_us) {
+  uint64_t seq, end, slot, cur_chunk, bit = pgm ? bloom_bit(pgm) : 0;
+  t_journal_chunk *chunk;
+  t_journal_rec rec;
+  uint32_t cnt = 0;
+
+  if (!hdr) return 0;
+  end = hdr->next_seq;
+  seq = (end > JOURNAL_CAPACITY) ? end - JOURNAL_CAPACITY : 1;
+  cur_chunk = ((end - 1) % JOURNAL_CAPACITY) / JOURNAL_CHUNK_SZ;
+  while (seq < end) {
+    slot = seq % JOURNAL_CAPACITY;
+    chunk = &hdr->index[slot / JOURNAL_CHUNK_SZ];
+    if (slot / JOURNAL_CHUNK_SZ != cur_chunk &&
+        (chunk->last_us < since_us || chunk->first_us > until_us ||
+         (bit && !(chunk->bloom & bit)))) {
+      seq += JOURNAL_CHUNK_SZ - (slot % JOURNAL_CHUNK_SZ); /* next chunk */
+      continue;
+    }
+    rec = ring[slot];
+    seq++;
+    if (rec.seq != seq - 1) continue; /* torn or overwritten meanwhile */
+    if (rec.time_us < since_us || rec.time_us > until_us) continue;
+    if (pgm && strncmp(rec.pgm, pgm, JOURNAL_NAME_SZ - 1)) continue;
+    if (rec.type >= JRNL_EV_NB) continue;
+    print_rec(out, &rec);
+    cnt++;
+  }
+  return cnt;
+}
@@ -0,0 +1,87 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * Lifecycle event journal.
+ * Every state transition is written as a fixed-size record into a circular
+ * file mapped in memory (MAP_SHARED), so that the journal survives a crash of
+ * taskmaster. Writing a record only touches memory and is safe in signal
+ * handlers. A record is published by writing its sequence number last: a slot
+ * whose seq doesn't match the expected one is torn or overwritten.
+ * Records are grouped by chunks of JOURNAL_CHUNK_SZ slots. The header keeps
+ * for each chunk its time range and a 64 bits bloom filter of the program
+ * names it contains, so a query only scans chunks which may match.
+ */
+
+#define JOURNAL_MAGIC "TMJRNL"
+#define JOURNAL_VERSION (1)
+#define JOURNAL_CAPACITY (1 << 16) /* records in the ring */
+#define JOURNAL_CHUNK_SZ (256)     /* records per index entry */
+#define JOURNAL_CHUNK_NB (JOURNAL_CAPACITY / JOURNAL_CHUNK_SZ)
+#define JOURNAL_HDR_SZ (8192) /* header & index, page aligned */
+#define JOURNAL_NAME_SZ (36)  /* program name stored, truncated */
+
+typedef enum e_journal_ev {
+  JRNL_NO_EV,
+  JRNL_SPAWN,      /* process forked. value: restart count */
+  JRNL_RUNNING,    /* pgm successfully started. value: procs running */
+  JRNL_START_FAIL, /* pgm failed to start. value: procs running */
+  JRNL_EXIT,       /* process exited. value: exit status */
+  JRNL_SIGNALED,   /* process terminated by a signal. value: signal */
+  JRNL_STOPPED,    /* process stopped by a signal. value: signal */
+  JRNL_SIGNAL,     /* taskmaster signaled the pgm. value: signal */
+  JRNL_RESTART,    /* process restarted. value: restart count */
+  JRNL_TIMER,      /* timer fired. value: timer type */
+  JRNL_RELOAD,     /* reload decision. value: t_journal_reload */
+  JRNL_SCALE,      /* numprocs changed on the fly. value: new numprocs */
+  JRNL_EV_NB,
+} t_journal_ev;
+
+typedef enum e_journal_reload {
+  JRNL_RELOAD_SOFT = 1,
+  JRNL_RELOAD_HARD,
+  JRNL_RELOAD_ADD,
+  JRNL_RELOAD_DEL,
+  JRNL_RELOAD_ROLL,
+} t_journal_reload;
+
+typedef struct s_journal_rec {
+  int64_t time_us; /* CLOCK_REALTIME, in microseconds */
+  uint64_t seq;    /* sequence number, written last. 0: empty slot */
+  pid_t pid;       /* process or process group concerned */
+  int32_t value;   /* event dependant value */
+  uint16_t type;   /* t_journal_ev */
+  uint16_t reserved;
+  char pgm[JOURNAL_NAME_SZ]; /* program name */
+} t_journal_rec;
+
+typedef struct s_journal_chunk {
+  int64_t first_us; /* time of the first record of the chunk */
+  int64_t last_us;  /* time of the last record of the chunk */
+  uint64_t bloom;   /* bit (hash(pgm) % 64) set for each pgm recorded */
+} t_journal_chunk;
+
+typedef struct s_journal_hdr {
+  char magic[8];
+  uint32_t version;
+  uint32_t capacity;
+  uint64_t next_seq; /* seq of the next record, starts at 1 */
+  t_journal_chunk index[JOURNAL_CHUNK_NB];
+} t_journal_hdr;
+
+/* map the journal file, creating or resetting it if it isn't valid.
+ * Returns 1 on error, in which case records are silently dropped */
+int32_t journal_open(const char *path);
+
+/* append a record. Async-signal-safe */
+void journal_record(t_journal_ev ev, const char *pgm, pid_t pid, int32_t value);
+
+/* print records of pgm (or all if NULL) between since_us & until_us */
+uint32_t journal_query(FILE *out, const char *pgm, int64_t since_us,
+                       int64_t until_us);
+
+#endif
@@ -0,0 +1,217 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/falloc.h>
+#include <sys/stat.h>
+
+#include "ft_log.h"
+#include "taskmaster.h"
+
+/*
+ * Rotation of programs log files.
+ * Children inherit their std_out/std_err fds at fork and keep them for their
+ * whole lifetime, so the file can't be renamed under them. Instead the content
+ * is copied into the first backup and cut from the live file in place. As
+ * every log fd is opened with O_APPEND, children just continue to write at the
+ * new end of the file and never need a restart.
+ * The cut collapses the copied range out of the file where the filesystem
+ * supports it (ext4, xfs), so nothing written meanwhile is lost. Elsewhere the
+ * tail written during the copy is copied too, then the file is truncated: only
+ * what is written between the last size check and ftruncate() is lost.
+ * The copy is O(file size): the SIGALRM handler only queues it to lz_worker.c,
+ * which also compresses backups. Nothing is copied on the supervision thread.
+ */
+
+#define LOG_ROTATE_PERM (0644)
+#define LOG_ROTATE_CPY_SZ (1 << 20) /* bytes copied per copy_file_range() */
+#define LOG_ROTATE_TAIL_CPY (8)     /* tail copies before truncating anyway */
+
+void log_backup_name(char *buf, const char *path, uint8_t idx,
+                     const char *ext) {
+  snprintf(buf, PATH_MAX, "%s.%u%s", path, idx, ext);
+}
+
+/* name of a file not yet shifted into the backups, unique in the process */
+void log_pending_name(char *buf, const char *path) {
+  static uint32_t cnt;
+
+  snprintf(buf, PATH_MAX, "%s.rot%u", path,
+           __atomic_fetch_add(&cnt, 1, __ATOMIC_RELAXED));
+}
+
+/* shift path.N-1<ext> -> path.N<ext> ... path.1<ext> -> path.2<ext> */
+int32_t log_shift_backups(const char *path, uint8_t backups, const char *ext) {
+  char old[PATH_MAX], new[PATH_MAX];
+
+  for (uint8_t i = backups - 1; backups && i > 0; i--) {
+    log_backup_name(old, path, i, ext);
+    log_backup_name(new, path, i + 1, ext);
+    if (rename(old, new) == -1 && errno != ENOENT) return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/* fallback of copy_file_range() when it isn't supported by the filesystem */
+static int32_t copy_rw(int32_t fd_in, off_t *off, off_t end, int32_t fd_out) {
+  char buf[BUFSIZ];
+  ssize_t rd = 1;
+
+  while (*off < end && rd > 0) {
+    rd = end - *off < (off_t)sizeof(buf) ? end - *off : (off_t)sizeof(buf);
+    if ((rd = pread(fd_in, buf, rd, *off)) > 0 && write(fd_out, buf, rd) != rd)
+      return EXIT_FAILURE;
+    *off += rd > 0 ? rd : 0;
+  }
+  return (*off < end);
+}
+
+/* copy [*off, end) of fd_in at the end of fd_out, *off is moved past what was
+ * copied */
+static int32_t copy_range(int32_t fd_in, off_t *off, off_t end,
+                          int32_t fd_out) {
+  ssize_t cp = 1;
+
+  /* let the kernel do the copy, without bouncing data through userspace */
+  while (*off < end && cp > 0) {
+    cp = end - *off < LOG_ROTATE_CPY_SZ ? end - *off : LOG_ROTATE_CPY_SZ;
+    cp = copy_file_range(fd_in, off, fd_out, NULL, cp, 0);
+  }
+  if (cp == -1 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL))
+    return copy_rw(fd_in, off, end, fd_out);
+  return (*off < end);
+}
+
+/* Copy the content of the live log fd into backup (none if NULL) and cut it
+ * from fd. The copied range is collapsed out of the file, whole blocks only,
+ * so bytes written meanwhile stay. Without FALLOC_FL_COLLAPSE_RANGE the tail
+ * is copied until it stops growing, then the file is truncated. */
+int32_t log_cut(int32_t fd, const char *backup) {
+  int32_t fd_out = -1, ret = EXIT_FAILURE;
+  struct stat statbuf;
+  off_t off = 0, end;
+
+  if (fstat(fd, &statbuf) == -1) return EXIT_FAILURE;
+  if (backup && (fd_out = open(backup, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                               LOG_ROTATE_PERM)) == -1)
+    return EXIT_FAILURE;
+  /* the collapsed range must be block aligned & end before EOF */
+  end = (statbuf.st_size - 1) / statbuf.st_blksize * statbuf.st_blksize;
+  if (end > 0) {
+    if (fd_out != -1 && copy_range(fd, &off, end, fd_out)) goto end;
+    if (!fallocate(fd, FALLOC_FL_COLLAPSE_RANGE, 0, end)) {
+      ret = EXIT_SUCCESS;
+      goto end;
+    }
+  }
+  for (int32_t i = 0; fd_out != -1 && i < LOG_ROTATE_TAIL_CPY; i++) {
+    if (fstat(fd, &statbuf) == -1) goto end;
+    if (statbuf.st_size <= off) break;
+    if (copy_range(fd, &off, statbuf.st_size, fd_out)) goto end;
+  }
+  ret = ftruncate(fd, 0) == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
+end:
+  if (fd_out != -1 && close(fd_out) == -1) ret = EXIT_FAILURE;
+  return ret;
+}
+
+/* Open the file of the live log fd again to read & cut it: log fds are write
+ * only, and path may not be the same file anymore. */
+int32_t log_open_live(int32_t fd) {
+  char proc[64];
+
+  snprintf(proc, sizeof(proc), "/proc/self/fd/%d", fd);
+  return open(proc, O_RDWR | O_CLOEXEC);
+}
+
+/* cut the live log into the first backup, the old ones being shifted once the
+ * copy is done. Runs on lz_worker, or in place if the worker isn't there. */
+int32_t log_backup(int32_t fd, const char *path, uint8_t backups) {
+  char pending[PATH_MAX], first[PATH_MAX];
+
+  if (!backups) return log_cut(fd, NULL);
+  log_pending_name(pending, path);
+  if (log_cut(fd, pending)) {
+    unlink(pending);
+    return EXIT_FAILURE;
+  }
+  log_backup_name(first, path, 1, "");
+  if (log_shift_backups(path, backups, "") || rename(pending, first) == -1) {
+    unlink(pending);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/* Rotate the live log fd, the O_APPEND fd opened on path. Called from the
+ * SIGALRM handler & commands: the copy is queued to the worker, and only done
+ * here if the worker can't take it. */
+int32_t log_rotate(int32_t fd, const char *path, const t_log_rotate *rot) {
+  struct stat statbuf;
+  int32_t live, ret;
+
+  if (fstat(fd, &statbuf) == -1 || !S_ISREG(statbuf.st_mode))
+    return EXIT_SUCCESS; /* /dev/null, pipes... have nothing to rotate */
+  if ((live = log_open_live(fd)) == -1) goto error;
+  /* uncompressed in place, compression would stall the handler */
+  if ((ret = lz_worker_rotate(live, path, rot)))
+    ret = log_backup(live, path, rot->backups);
+  else
+    live = -1; /* owned by the worker now */
+  if (live != -1) close(live);
+  if (ret) goto error;
+  ft_log(FT_LOG_INFO, "%s rotated (%ld bytes)", path, (long)statbuf.st_size);
+  return EXIT_SUCCESS;
+error:
+  ft_log(FT_LOG_ERR, "failed to rotate %s: %s", path, strerror(errno));
+  return EXIT_FAILURE;
+}
+
+/* rotate the log file if it grew above its configured limit */
+int32_t log_rotate_check(int32_t fd, const char *path, const t_log_rotate *rot) {
+  struct stat statbuf;
+
+  if (!rot->maxbytes || fd <= 0) return EXIT_SUCCESS;
+  if (fstat(fd, &statbuf) == -1) return EXIT_FAILURE;
+  if ((uint64_t)statbuf.st_size < rot->maxbytes) return EXIT_SUCCESS;
+  return log_rotate(fd, path, rot);
+}
+
+/* Rotate now, whatever its size. If path has been moved or deleted by an
+ * external tool, a new file is created there and *fd is replaced by it so that
+ * next spawns log into it. */
+int32_t log_reopen(int32_t *fd, const char *path, const t_log_rotate *rot) {
+  struct stat fd_st, path_st;
+  int32_t new_fd;
+
+  if (*fd <= 0 || fstat(*fd, &fd_st) == -1) return EXIT_FAILURE;
+  if (stat(path, &path_st) == 0 && fd_st.st_dev == path_st.st_dev &&
+      fd_st.st_ino == path_st.st_ino)
+    return log_rotate(*fd, path, rot);
+
+  new_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, LOG_ROTATE_PERM);
+  if (new_fd == -1) {
+    ft_log(FT_LOG_ERR, "failed to reopen %s: %s", path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+  close(*fd);
+  *fd = new_fd;
+  ft_log(FT_LOG_INFO, "%s reopened", path);
+  return EXIT_SUCCESS;
+}
+
+/* ft_log rotation callback for the taskmaster log: 'rotated' is the old log
+ * file, renamed by ft_log. It becomes the compressed first backup. */
+void log_rotated_cb(const char *rotated, const char *logfile, int backups) {
+  char first[PATH_MAX];
+
+  if (!lz_worker_push(rotated, logfile, backups)) return;
+  log_shift_backups(logfile, backups, "");
+  log_backup_name(first, logfile, 1, "");
+  rename(rotated, first);
+}
+
+/* compare two rotation policies, returns 0 if they are the same */
+int32_t log_rotate_cmp(const t_log_rotate *r1, const t_log_rotate *r2) {
+  return (r1->maxbytes != r2->maxbytes || r1->backups != r2->backups ||
+          r1->compress != r2->compress);
+}
@@ -0,0 +1,244 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "ft_lz.h"
+#include "taskmaster.h"
+
+/*
+ * Background rotation & compression of log files.
+ * Rotation (on the supervision thread) queues a fd of the live log here, this
+ * worker cuts it into the first backup (see log_cut()), or into a pending file
+ * to compress. Pending files, also queued by the taskmaster log rotation, are
+ * compressed into <path>.1.lz, older compressed backups being shifted and the
+ * pending file removed. The worker is the only one to
+ * rename compressed backups, so jobs of a same log never race each other, and
+ * a log already queued for rotation isn't queued twice.
+ * The worker blocks every signal and throttles itself to LZ_WORKER_CPU_SHARE.
+ */
+
+#define LZ_WORKER_CPU_SHARE (25) /* max % of one cpu used by the worker */
+#define LZ_WORKER_NICE (19)
+
+typedef struct s_lz_job {
+  char *src;       /* pending file to compress, removed once done */
+  char *path;      /* log file the backup belongs to */
+  uint8_t backups; /* how many compressed backups of path are kept */
+  int32_t fd;      /* live log to rotate, -1 for a pending file */
+  bool compress;   /* the backup cut from fd is compressed */
+  dev_t dev;       /* file of fd, a same log is queued once */
+  ino_t ino;
+  struct s_lz_job *next;
+} t_lz_job;
+
+static struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  t_lz_job *head, *tail; /* FIFO of jobs */
+  t_lz_job *current;     /* job being processed */
+  bool running;          /* worker thread is alive */
+  bool stop;             /* drain the queue then exit */
+  struct timespec cpu;   /* thread cpu time at the end of the last block */
+} worker = {.lock = PTHREAD_MUTEX_INITIALIZER,
+            .cond = PTHREAD_COND_INITIALIZER};
+
+static int64_t ts_diff_ns(const struct timespec *a, const struct timespec *b) {
+  return (a->tv_sec - b->tv_sec) * 1000000000L + (a->tv_nsec - b->tv_nsec);
+}
+
+/* ft_lz_compress_fd() block callback: sleep long enough so that the cpu time
+ * spent on the last block stays under LZ_WORKER_CPU_SHARE of the wall time */
+static void throttle(void *arg) {
+  UNUSED_PARAM(arg);
+  struct timespec now, nap;
+  int64_t ns;
+
+  if (worker.stop) return; /* draining at exit, go as fast as possible */
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  ns = ts_diff_ns(&now, &worker.cpu);
+  ns = ns * (100 - LZ_WORKER_CPU_SHARE) / LZ_WORKER_CPU_SHARE;
+  nap.tv_sec = ns / 1000000000L, nap.tv_nsec = ns % 1000000000L;
+  while (nanosleep(&nap, &nap) == -1 && errno == EINTR)
+    ;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &worker.cpu);
+}
+
+static int32_t compress_file(const char *src, const char *dst) {
+  int32_t fd_in, fd_out, ret;
+
+  if ((fd_in = open(src, O_RDONLY | O_CLOEXEC)) == -1) return EXIT_FAILURE;
+  fd_out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_out == -1) {
+    close(fd_in);
+    return EXIT_FAILURE;
+  }
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &worker.cpu);
+  ret = ft_lz_compress_fd(fd_in, fd_out, throttle, NULL);
+  close(fd_in);
+  if (close(fd_out) == -1) ret = EXIT_FAILURE;
+  return ret;
+}
+
+/* compress job->src, cut from job->fd first for a rotation, then move it as
+ * first compressed backup of job->path. If compression fails, the backup is
+ * kept uncompressed. */
+static void process_job(t_lz_job *job) {
+  char dst[PATH_MAX], backup[PATH_MAX];
+
+  if (job->fd != -1) {
+    log_pending_name(dst, job->path);
+    if (log_cut(job->fd, dst) || !(job->src = strdup(dst))) {
+      unlink(dst);
+      return;
+    }
+  }
+  snprintf(dst, PATH_MAX, "%s%s", job->src, FT_LZ_EXT);
+  if (compress_file(job->src, dst)) {
+    unlink(dst);
+    log_shift_backups(job->path, job->backups, "");
+    log_backup_name(backup, job->path, 1, "");
+    rename(job->src, backup);
+    return;
+  }
+  log_shift_backups(job->path, job->backups, FT_LZ_EXT);
+  log_backup_name(backup, job->path, 1, FT_LZ_EXT);
+  rename(dst, backup);
+  unlink(job->src);
+}
+
+static void destroy_job(t_lz_job *job) {
+  if (job->fd != -1) close(job->fd);
+  free(job->src);
+  free(job->path);
+  free(job);
+}
+
+static void *worker_routine(void *arg) {
+  UNUSED_PARAM(arg);
+  t_lz_job *job;
+
+  setpriority(PRIO_PROCESS, gettid(), LZ_WORKER_NICE);
+  pthread_mutex_lock(&worker.lock);
+  while (1) {
+    while (!worker.head && !worker.stop)
+      pthread_cond_wait(&worker.cond, &worker.lock);
+    if (!(job = worker.head)) break; /* stop requested & queue drained */
+    worker.head = job->next;
+    if (!worker.head) worker.tail = NULL;
+    worker.current = job;
+    pthread_mutex_unlock(&worker.lock);
+    if (job->fd != -1 && !job->compress)
+      log_backup(job->fd, job->path, job->backups);
+    else
+      process_job(job);
+    pthread_mutex_lock(&worker.lock);
+    worker.current = NULL;
+    destroy_job(job);
+  }
+  pthread_mutex_unlock(&worker.lock);
+  return NULL;
+}
+
+/* launch the worker thread. Every signal is blocked before so that the thread
+ * inherits a full mask and signals are always handled by the main thread. */
+int32_t lz_worker_start(void) {
+  sigset_t all, old;
+
+  if (worker.running) return EXIT_SUCCESS;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  worker.running = !pthread_create(&worker.thread, NULL, worker_routine, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (!worker.running) return EXIT_FAILURE;
+  atexit(lz_worker_stop);
+  return EXIT_SUCCESS;
+}
+
+/* compress what is left in the queue and join the worker */
+void lz_worker_stop(void) {
+  if (!worker.running) return;
+  pthread_mutex_lock(&worker.lock);
+  worker.stop = true;
+  pthread_cond_signal(&worker.cond);
+  pthread_mutex_unlock(&worker.lock);
+  pthread_join(worker.thread, NULL);
+  worker.running = false;
+}
+
+/* true if the file of job is already queued for rotation */
+static bool rotation_queued(const t_lz_job *job) {
+  const t_lz_job *cur = worker.current;
+
+  if (cur && cur->fd != -1 && cur->dev == job->dev && cur->ino == job->ino)
+    return true;
+  for (cur = worker.head; cur; cur = cur->next)
+    if (cur->fd != -1 && cur->dev == job->dev && cur->ino == job->ino)
+      return true;
+  return false;
+}
+
+/* Callable from signal handlers: signals are blocked while the queue lock is
+ * held. job is freed if it's a rotation already queued. */
+static void enqueue(t_lz_job *job) {
+  sigset_t all, old;
+  bool queued;
+
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  pthread_mutex_lock(&worker.lock);
+  if (!(queued = job->fd != -1 && rotation_queued(job))) {
+    if (worker.tail)
+      worker.tail->next = job;
+    else
+      worker.head = job;
+    worker.tail = job;
+    pthread_cond_signal(&worker.cond);
+  }
+  pthread_mutex_unlock(&worker.lock);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (queued) destroy_job(job);
+}
+
+static t_lz_job *new_job(const char *src, const char *path, uint8_t backups) {
+  t_lz_job *job;
+
+  if (!worker.running || worker.stop) return NULL;
+  if (!(job = calloc(1, sizeof(*job)))) return NULL;
+  job->fd = -1, job->backups = backups;
+  job->src = src ? strdup(src) : NULL, job->path = strdup(path);
+  if ((src && !job->src) || !job->path) {
+    destroy_job(job);
+    return NULL;
+  }
+  return job;
+}
+
+/* queue src to be compressed as the first backup of path */
+int32_t lz_worker_push(const char *src, const char *path, uint8_t backups) {
+  t_lz_job *job = new_job(src, path, backups);
+
+  if (!job) return EXIT_FAILURE;
+  enqueue(job);
+  return EXIT_SUCCESS;
+}
+
+/* queue the live log fd of path to be rotated, a readable fd of the file
+ * (see log_open_live()). The worker owns it once queued. */
+int32_t lz_worker_rotate(int32_t fd, const char *path,
+                         const t_log_rotate *rot) {
+  t_lz_job *job;
+  struct stat statbuf;
+
+  if (fstat(fd, &statbuf) == -1) return EXIT_FAILURE;
+  if (!(job = new_job(NULL, path, rot->backups))) return EXIT_FAILURE;
+  job->fd = fd, job->compress = rot->compress && rot->backups;
+  job->dev = statbuf.st_dev, job->ino = statbuf.st_ino;
+  enqueue(job);
+  return EXIT_SUCCESS;
+}
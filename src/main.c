@@ -3,17 +3,22 @@
 #include <termio.h>
 
 #include "ft_log.h"
+#include "journal.h"
+#include "proc_sample.h"
 #include "taskmaster.h"
 
 static uint8_t usage(char *const *av) {
-  fprintf(stderr, "Usage: %s [-f filename]\n", av[0]);
+  fprintf(stderr,
+          "Usage: %s [-f filename] [-s syslog_socket] [-m metrics_socket] "
+          "[-p interval[,budget]] [-n]\n",
+          av[0]);
   return EXIT_FAILURE;
 }
 
 static uint8_t get_options(int ac, char *const *av, t_tm_node *node) {
   int32_t opt;
 
-  while ((opt = getopt(ac, av, "f:")) != -1) {
+  while ((opt = getopt(ac, av, "f:s:m:p:n")) != -1) {
     switch (opt) {
       case 'f':
         node->config_file_name = strdup(optarg);
@@ -23,6 +28,18 @@ static uint8_t get_options(int ac, char *const *av, t_tm_node *node) {
           return EXIT_FAILURE;
         }
         break;
+      case 's':
+        node->log_sink = optarg;
+        break;
+      case 'm':
+        node->metrics_path = optarg;
+        break;
+      case 'p':
+        if (proc_sample_config(optarg)) return usage(av);
+        break;
+      case 'n':
+        node->no_watch = true;
+        break;
       case '?':
       default:
         return usage(av);
@@ -85,9 +102,15 @@ int main(int ac, char **av) {
 
   if (get_options(ac, av, &node)) goto error;
   if (ft_openlog(node.tm_name, TM_LOGFILE)) goto_error("ft_openlog");
-  if (load_config_file(&node)) return EXIT_FAILURE;
-  if (sanitize_config(&node)) return EXIT_FAILURE;
-  if (fulfill_config(&node)) return EXIT_FAILURE;
+  if (node.log_sink && ft_log_sink(node.log_sink))
+    ft_log(FT_LOG_WARNING, "%s: %s, logging to %s until it is reachable",
+           node.log_sink, strerror(errno), TM_LOGFILE);
+  if (lz_worker_start()) goto_error("lz_worker_start");
+  ft_log_rotate(TM_LOG_MAXBYTES, TM_LOG_BACKUPS, log_rotated_cb);
+  if (journal_open(TM_JOURNALFILE))
+    ft_log(FT_LOG_WARNING, "%s: %s, events won't be journaled",
+           TM_JOURNALFILE, strerror(errno));
+  if (load_config(&node)) return EXIT_FAILURE;
   if (init_shell(&node)) return EXIT_FAILURE;
   run_client(&node);
   print_pgm_list(node.head);
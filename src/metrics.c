@@ -0,0 +1,544 @@
+#include "metrics.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "ft_log.h"
+#include "hist.h"
+#include "strbuf.h"
+
+t_tm_metrics tm_metrics;
+
+static struct {
+  char *path;
+  int32_t fd; /* listening socket */
+  pthread_t thread;
+  pthread_t main; /* thread rendering the metrics */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool want;  /* the thread waits for a rendering */
+  char *body; /* rendering handed to the thread */
+  size_t len;
+  bool running;
+  bool stop;
+} srv = {.fd = -1,
+         .lock = PTHREAD_MUTEX_INITIALIZER,
+         .cond = PTHREAD_COND_INITIALIZER};
+
+static const char st_names[PROC_ST_MAX][16] = {"starting", "running",
+                                               "terminating"};
+
+static const char lat_names[LAT_NB][16] = {"fork_exec", "ready", "stop",
+                                           "respawn"};
+
+static const char drift_names[DRIFT_NB][8] = {"late", "early"};
+
+static const double quantiles[] = {0.5, 0.9, 0.99};
+
+/* ============================ counters update ============================= */
+
+int64_t metrics_now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
+
+int64_t metrics_now_ms(void) { return metrics_now_us() / 1000L; }
+
+void metrics_lat(t_pgm *pgm, t_lat_stage stage, int64_t us) {
+  hist_record(&pgm->privy.metrics.lat[stage], us);
+  hist_record(&tm_metrics.lat[stage], us);
+}
+
+void metrics_proc_enter(t_pgm *pgm, t_process *proc) {
+  t_pgm_metrics *m = &pgm->privy.metrics;
+
+  proc->since = metrics_now_ms();
+  m->st_cnt[proc->state]++;
+  m->st_since[proc->state] += proc->since;
+}
+
+void metrics_proc_leave(t_pgm *pgm, const t_process *proc) {
+  t_pgm_metrics *m = &pgm->privy.metrics;
+
+  m->st_cnt[proc->state]--;
+  m->st_since[proc->state] -= proc->since;
+  m->st_ms[proc->state] += metrics_now_ms() - proc->since;
+}
+
+void metrics_proc_exit(t_pgm *pgm, int32_t w_status) {
+  t_pgm_metrics *m = &pgm->privy.metrics;
+  t_metrics_exit key, *exits;
+
+  if (WIFEXITED(w_status))
+    key = (t_metrics_exit){.val = WEXITSTATUS(w_status)};
+  else if (WIFSIGNALED(w_status))
+    key = (t_metrics_exit){.signaled = true, .val = WTERMSIG(w_status)};
+  else
+    return;
+  for (uint16_t i = 0; i < m->exit_nb; i++) {
+    if (m->exits[i].signaled == key.signaled && m->exits[i].val == key.val) {
+      m->exits[i].cnt++;
+      return;
+    }
+  }
+  if (!(exits = realloc(m->exits, (m->exit_nb + 1) * sizeof(*exits)))) return;
+  key.cnt = 1;
+  exits[m->exit_nb++] = key;
+  m->exits = exits;
+}
+
+void metrics_timer_armed(time_t sec) {
+  tm_metrics.timer_due = sec < 0 ? 0 : metrics_now_us() + sec * 1000000L;
+}
+
+void metrics_timer_fired(void) {
+  int64_t lag;
+
+  if (!tm_metrics.timer_due) return;
+  lag = metrics_now_us() - tm_metrics.timer_due;
+  hist_record(&tm_metrics.lag, lag > 0 ? lag : 0);
+  tm_metrics.timer_due = 0;
+}
+
+void metrics_timer_drift(int64_t due) {
+  int64_t drift = metrics_now_us() - due;
+
+  if (drift >= 0)
+    hist_record(&tm_metrics.drift[DRIFT_LATE], drift);
+  else
+    hist_record(&tm_metrics.drift[DRIFT_EARLY], -drift);
+}
+
+void metrics_cost(t_cost_path path, const char *name, int64_t start) {
+  int64_t us = metrics_now_us() - start;
+  t_metrics_cost *cost;
+
+  if (path >= COST_MAX) return;
+  cost = &tm_metrics.cost[path];
+  cost->name = name;
+  cost->cnt++;
+  cost->us += us;
+  if (us > cost->max_us) cost->max_us = us;
+}
+
+/* ================================ printing ================================ */
+
+static void print_hist(FILE *stream, const t_hist *hist) {
+  fprintf(stream, " n=%" PRIu64, hist->cnt);
+  for (uint32_t i = 0; i < sizeof(quantiles) / sizeof(*quantiles); i++)
+    fprintf(stream, " p%g=%.3fms", quantiles[i] * 100,
+            hist_quantile(hist, quantiles[i]) / 1000.0);
+  fprintf(stream, " max=%.3fms\n", hist->max / 1000.0);
+}
+
+void metrics_print_debug(FILE *stream) {
+  const t_metrics_cost *cost;
+
+  fprintf(stream, "%-20s %10s %12s %10s %10s\n", "path", "calls", "total ms",
+          "avg us", "max us");
+  for (int32_t path = 0; path < COST_MAX; path++) {
+    cost = &tm_metrics.cost[path];
+    if (!cost->name) continue;
+    fprintf(stream, "%s%-*s %10" PRIu64 " %12.3f %10.1f %10" PRId64 "\n",
+            path >= COST_CMD ? "cmd " : "", path >= COST_CMD ? 16 : 20,
+            cost->name, cost->cnt, cost->us / 1000.0,
+            (double)cost->us / cost->cnt, cost->max_us);
+  }
+  fprintf(stream, "timer lag           ");
+  if (tm_metrics.lag)
+    print_hist(stream, tm_metrics.lag);
+  else
+    fprintf(stream, " no timer fired yet\n");
+  for (int32_t side = 0; side < DRIFT_NB; side++) {
+    if (!tm_metrics.drift[side]) continue;
+    fprintf(stream, "timer %-14s", drift_names[side]);
+    print_hist(stream, tm_metrics.drift[side]);
+  }
+}
+
+void metrics_print_lat(FILE *stream, const t_pgm *pgm) {
+  const t_hist *hist;
+  bool any = false;
+
+  fprintf(stream, "- %s\n", pgm->usr.name);
+  for (int32_t stage = 0; stage < LAT_NB; stage++) {
+    if (!(hist = pgm->privy.metrics.lat[stage])) continue;
+    any = true;
+    fprintf(stream, "  %-10s", lat_names[stage]);
+    print_hist(stream, hist);
+  }
+  if (!any) fprintf(stream, "  no latency measured yet\n");
+}
+
+/* ================================ rendering =============================== */
+
+static void family(t_strbuf *buf, const char *name, const char *type,
+                   const char *help) {
+  strbuf_printf(buf, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* name{program="<pgm name>" followed by the label value escapes */
+static void sample(t_strbuf *buf, const char *name, const t_pgm *pgm) {
+  strbuf_printf(buf, "%s{program=\"", name);
+  for (const char *c = pgm->usr.name; *c; c++) {
+    if (*c == '\\' || *c == '"')
+      strbuf_printf(buf, "\\%c", *c);
+    else if (*c == '\n')
+      strbuf_printf(buf, "\\n");
+    else
+      strbuf_printf(buf, "%c", *c);
+  }
+  strbuf_printf(buf, "\"");
+}
+
+/* a program being replaced is reported by its replacement only */
+#define FOREACH_PGM(pgm, node)                                 \
+  for (const t_pgm *pgm = (node)->head; pgm; pgm = pgm->privy.next) \
+    if (pgm->privy.ev != PGM_EV_DEL)
+
+static void render_pgm(t_strbuf *buf, const t_tm_node *node) {
+  int64_t now = metrics_now_ms(), ms;
+  const t_pgm_metrics *m;
+
+  family(buf, "taskmaster_program_processes_desired", "gauge",
+         "Processes a program is configured to run (numprocs).");
+  FOREACH_PGM(pgm, node) {
+    sample(buf, "taskmaster_program_processes_desired", pgm);
+    strbuf_printf(buf, "} %u\n", pgm->usr.numprocs);
+  }
+  family(buf, "taskmaster_program_processes", "gauge",
+         "Processes of a program by state.");
+  FOREACH_PGM(pgm, node) {
+    for (int32_t st = 0; st < PROC_ST_MAX; st++) {
+      sample(buf, "taskmaster_program_processes", pgm);
+      strbuf_printf(buf, ",state=\"%s\"} %u\n", st_names[st],
+                    pgm->privy.metrics.st_cnt[st]);
+    }
+  }
+  family(buf, "taskmaster_program_state_seconds_total", "counter",
+         "Time spent by the processes of a program in each state.");
+  FOREACH_PGM(pgm, node) {
+    m = &pgm->privy.metrics;
+    for (int32_t st = 0; st < PROC_ST_MAX; st++) {
+      ms = m->st_ms[st] + m->st_cnt[st] * now - m->st_since[st];
+      sample(buf, "taskmaster_program_state_seconds_total", pgm);
+      strbuf_printf(buf, ",state=\"%s\"} %.3f\n", st_names[st], ms / 1000.0);
+    }
+  }
+  family(buf, "taskmaster_program_spawns_total", "counter",
+         "Processes forked for a program, restarts included.");
+  FOREACH_PGM(pgm, node) {
+    sample(buf, "taskmaster_program_spawns_total", pgm);
+    strbuf_printf(buf, "} %" PRIu64 "\n", pgm->privy.metrics.spawns);
+  }
+  family(buf, "taskmaster_program_restarts_total", "counter",
+         "Processes of a program restarted after they exited.");
+  FOREACH_PGM(pgm, node) {
+    sample(buf, "taskmaster_program_restarts_total", pgm);
+    strbuf_printf(buf, "} %" PRIu64 "\n", pgm->privy.metrics.restarts);
+  }
+  family(buf, "taskmaster_program_start_failures_total", "counter",
+         "Starts of a program short of numprocs once starttime elapsed.");
+  FOREACH_PGM(pgm, node) {
+    sample(buf, "taskmaster_program_start_failures_total", pgm);
+    strbuf_printf(buf, "} %" PRIu64 "\n", pgm->privy.metrics.start_failures);
+  }
+  family(buf, "taskmaster_program_exits_total", "counter",
+         "Processes of a program which exited, by exit code.");
+  FOREACH_PGM(pgm, node) {
+    m = &pgm->privy.metrics;
+    for (uint16_t i = 0; i < m->exit_nb; i++) {
+      if (m->exits[i].signaled) continue;
+      sample(buf, "taskmaster_program_exits_total", pgm);
+      strbuf_printf(buf, ",code=\"%u\"} %" PRIu64 "\n", m->exits[i].val,
+                    m->exits[i].cnt);
+    }
+  }
+  family(buf, "taskmaster_program_signaled_total", "counter",
+         "Processes of a program killed by a signal, by signal number.");
+  FOREACH_PGM(pgm, node) {
+    m = &pgm->privy.metrics;
+    for (uint16_t i = 0; i < m->exit_nb; i++) {
+      if (!m->exits[i].signaled) continue;
+      sample(buf, "taskmaster_program_signaled_total", pgm);
+      strbuf_printf(buf, ",signal=\"%u\"} %" PRIu64 "\n", m->exits[i].val,
+                    m->exits[i].cnt);
+    }
+  }
+}
+
+static void render_lat(t_strbuf *buf, const t_tm_node *node) {
+  const t_hist *hist;
+
+  family(buf, "taskmaster_program_latency_seconds", "summary",
+         "Latencies of a program by stage: fork_exec, ready (spawn to "
+         "starttime passed), stop (stop signal to exit), respawn (exit to "
+         "restart).");
+  FOREACH_PGM(pgm, node) {
+    for (int32_t stage = 0; stage < LAT_NB; stage++) {
+      if (!(hist = pgm->privy.metrics.lat[stage])) continue;
+      for (uint32_t i = 0;
+           i < sizeof(quantiles) / sizeof(*quantiles); i++) {
+        sample(buf, "taskmaster_program_latency_seconds", pgm);
+        strbuf_printf(buf, ",stage=\"%s\",quantile=\"%g\"} %.6f\n",
+                      lat_names[stage], quantiles[i],
+                      hist_quantile(hist, quantiles[i]) / 1e6);
+      }
+      sample(buf, "taskmaster_program_latency_seconds_sum", pgm);
+      strbuf_printf(buf, ",stage=\"%s\"} %.6f\n", lat_names[stage],
+                    hist->sum / 1e6);
+      sample(buf, "taskmaster_program_latency_seconds_count", pgm);
+      strbuf_printf(buf, ",stage=\"%s\"} %" PRIu64 "\n", lat_names[stage],
+                    hist->cnt);
+    }
+  }
+  family(buf, "taskmaster_latency_seconds", "summary",
+         "Latencies of all the programs by stage.");
+  for (int32_t stage = 0; stage < LAT_NB; stage++) {
+    if (!(hist = tm_metrics.lat[stage])) continue;
+    for (uint32_t i = 0; i < sizeof(quantiles) / sizeof(*quantiles); i++)
+      strbuf_printf(buf,
+                    "taskmaster_latency_seconds{stage=\"%s\",quantile=\"%g\"} "
+                    "%.6f\n",
+                    lat_names[stage], quantiles[i],
+                    hist_quantile(hist, quantiles[i]) / 1e6);
+    strbuf_printf(buf, "taskmaster_latency_seconds_sum{stage=\"%s\"} %.6f\n",
+                  lat_names[stage], hist->sum / 1e6);
+    strbuf_printf(buf,
+                  "taskmaster_latency_seconds_count{stage=\"%s\"} %" PRIu64
+                  "\n",
+                  lat_names[stage], hist->cnt);
+  }
+}
+
+/* paths timed at least once */
+#define FOREACH_COST(cost, path)                                \
+  for (int32_t path = 0; path < COST_MAX; path++)               \
+    for (const t_metrics_cost *cost = &tm_metrics.cost[path]; \
+         cost && cost->name; cost = NULL)
+
+static void render_drift(t_strbuf *buf) {
+  const t_hist *hist;
+
+  family(buf, "taskmaster_timer_drift_seconds", "summary",
+         "How late or early timers fired, from the instant they are due.");
+  for (int32_t side = 0; side < DRIFT_NB; side++) {
+    if (!(hist = tm_metrics.drift[side])) continue;
+    for (uint32_t i = 0; i < sizeof(quantiles) / sizeof(*quantiles); i++)
+      strbuf_printf(buf,
+                    "taskmaster_timer_drift_seconds{side=\"%s\",quantile="
+                    "\"%g\"} %.6f\n",
+                    drift_names[side], quantiles[i],
+                    hist_quantile(hist, quantiles[i]) / 1e6);
+    /* the worst drift is what delays a kill or a start confirmation */
+    strbuf_printf(buf,
+                  "taskmaster_timer_drift_seconds{side=\"%s\",quantile=\"1\"} "
+                  "%.6f\n",
+                  drift_names[side], hist->max / 1e6);
+    strbuf_printf(buf, "taskmaster_timer_drift_seconds_sum{side=\"%s\"} %.6f\n",
+                  drift_names[side], hist->sum / 1e6);
+    strbuf_printf(buf,
+                  "taskmaster_timer_drift_seconds_count{side=\"%s\"} %" PRIu64
+                  "\n",
+                  drift_names[side], hist->cnt);
+  }
+}
+
+static void render_supervisor(t_strbuf *buf, const t_tm_node *node) {
+  const t_hist *lag = tm_metrics.lag;
+
+  family(buf, "taskmaster_programs", "gauge", "Programs loaded.");
+  strbuf_printf(buf, "taskmaster_programs %u\n", node->pgm_nb);
+  family(buf, "taskmaster_timers_pending", "gauge", "Timers waiting to fire.");
+  strbuf_printf(buf, "taskmaster_timers_pending %u\n", tm_metrics.timers);
+  family(buf, "taskmaster_event_loop_lag_seconds", "summary",
+         "Delay between the instant a timer is due and its handler.");
+  for (uint32_t i = 0; lag && i < sizeof(quantiles) / sizeof(*quantiles); i++)
+    strbuf_printf(buf,
+                  "taskmaster_event_loop_lag_seconds{quantile=\"%g\"} %.6f\n",
+                  quantiles[i], hist_quantile(lag, quantiles[i]) / 1e6);
+  strbuf_printf(buf,
+                "taskmaster_event_loop_lag_seconds_sum %.6f\n"
+                "taskmaster_event_loop_lag_seconds_count %" PRIu64 "\n",
+                lag ? lag->sum / 1e6 : 0, lag ? lag->cnt : 0);
+  render_drift(buf);
+  family(buf, "taskmaster_handler_calls_total", "counter",
+         "Calls of the supervisor handlers & commands.");
+  FOREACH_COST(cost, path) {
+    strbuf_printf(buf,
+                  "taskmaster_handler_calls_total{path=\"%s%s\"} %" PRIu64 "\n",
+                  path >= COST_CMD ? "cmd_" : "", cost->name, cost->cnt);
+  }
+  family(buf, "taskmaster_handler_seconds_total", "counter",
+         "Time spent in the supervisor handlers & commands.");
+  FOREACH_COST(cost, path) {
+    strbuf_printf(buf,
+                  "taskmaster_handler_seconds_total{path=\"%s%s\"} %.6f\n",
+                  path >= COST_CMD ? "cmd_" : "", cost->name, cost->us / 1e6);
+  }
+  family(buf, "taskmaster_handler_max_seconds", "gauge",
+         "Longest call of the supervisor handlers & commands.");
+  FOREACH_COST(cost, path) {
+    strbuf_printf(buf, "taskmaster_handler_max_seconds{path=\"%s%s\"} %.6f\n",
+                  path >= COST_CMD ? "cmd_" : "", cost->name,
+                  cost->max_us / 1e6);
+  }
+  family(buf, "taskmaster_log_bytes_total", "counter",
+         "Bytes written to the taskmaster log or sent to its sink.");
+  strbuf_printf(buf, "taskmaster_log_bytes_total %llu\n", ft_log_bytes());
+}
+
+void metrics_serve(const t_tm_node *node) {
+  t_strbuf buf = {0};
+  bool want;
+
+  pthread_mutex_lock(&srv.lock);
+  want = srv.want;
+  pthread_mutex_unlock(&srv.lock);
+  if (!want) return;
+  render_pgm(&buf, node);
+  render_lat(&buf, node);
+  render_supervisor(&buf, node);
+  if (buf.err) DESTROY_PTR(buf.data);
+  pthread_mutex_lock(&srv.lock);
+  free(srv.body);
+  srv.body = buf.data, srv.len = buf.data ? buf.len : 0;
+  srv.want = false;
+  pthread_cond_signal(&srv.cond);
+  pthread_mutex_unlock(&srv.lock);
+}
+
+/* ================================= server ================================= */
+
+/* ask the main thread for a rendering & wait for it */
+static char *request_body(size_t *len) {
+  char *body;
+
+  pthread_mutex_lock(&srv.lock);
+  srv.want = true;
+  pthread_kill(srv.main, METRICS_SIGNAL);
+  while (srv.want && !srv.stop) pthread_cond_wait(&srv.cond, &srv.lock);
+  body = srv.want ? NULL : srv.body;
+  *len = srv.len;
+  srv.body = NULL, srv.want = false;
+  pthread_mutex_unlock(&srv.lock);
+  return body;
+}
+
+static void send_all(int32_t fd, const char *data, size_t len) {
+  ssize_t ret;
+
+  while (len && (ret = send(fd, data, len, MSG_NOSIGNAL)) > 0)
+    data += ret, len -= ret;
+}
+
+/* read the request up to its blank line, if the client sends one */
+static void serve_client(int32_t fd) {
+  struct timeval tv = {.tv_sec = METRICS_REQ_TIMEOUT_MS / 1000,
+                       .tv_usec = (METRICS_REQ_TIMEOUT_MS % 1000) * 1000};
+  char req[1024], hdr[128];
+  size_t len = 0, body_len;
+  ssize_t ret;
+  char *body;
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  req[0] = 0;
+  while (len < sizeof(req) - 1 &&
+         (ret = read(fd, req + len, sizeof(req) - 1 - len)) > 0) {
+    req[len += ret] = 0;
+    if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+  }
+  if (!(body = request_body(&body_len))) return;
+  if (!strncmp(req, "GET ", 4)) {
+    snprintf(hdr, sizeof(hdr),
+             "HTTP/1.0 200 OK\r\n"
+             "Content-Type: text/plain; version=0.0.4\r\n"
+             "Content-Length: %zu\r\n\r\n",
+             body_len);
+    send_all(fd, hdr, strlen(hdr));
+  }
+  send_all(fd, body, body_len);
+  free(body);
+}
+
+static void *metrics_routine(void *arg) {
+  UNUSED_PARAM(arg);
+  int32_t fd;
+
+  while (!srv.stop) {
+    if ((fd = accept4(srv.fd, NULL, NULL, SOCK_CLOEXEC)) == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break; /* socket shut down */
+    }
+    serve_client(fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+/* atexit() callback. Signals are blocked while the lock is held: the handler
+ * takes it too */
+static void metrics_stop(void) {
+  sigset_t all, old;
+
+  if (!srv.running) return;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  pthread_mutex_lock(&srv.lock);
+  srv.stop = true;
+  pthread_cond_signal(&srv.cond);
+  pthread_mutex_unlock(&srv.lock);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  shutdown(srv.fd, SHUT_RDWR);
+  pthread_join(srv.thread, NULL);
+  close(srv.fd);
+  unlink(srv.path);
+  DESTROY_PTR(srv.path);
+  DESTROY_PTR(srv.body);
+  srv.running = false;
+}
+
+/* the thread inherits a full signal mask so that signals are always handled
+ * by the main thread */
+int32_t metrics_start(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  sigset_t all, old;
+  int32_t err;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return EXIT_FAILURE;
+  }
+  strcpy(addr.sun_path, path);
+  if ((srv.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+    return EXIT_FAILURE;
+  unlink(path); /* left by a former run */
+  if (bind(srv.fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(srv.fd, METRICS_BACKLOG) == -1 || !(srv.path = strdup(path)))
+    goto error;
+  srv.main = pthread_self();
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  err = pthread_create(&srv.thread, NULL, metrics_routine, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (err) {
+    errno = err;
+    goto error;
+  }
+  srv.running = true;
+  atexit(metrics_stop);
+  return EXIT_SUCCESS;
+error:
+  err = errno;
+  close(srv.fd);
+  srv.fd = -1;
+  DESTROY_PTR(srv.path);
+  errno = err;
+  return EXIT_FAILURE;
+}
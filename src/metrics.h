@@ -0,0 +1,106 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <signal.h>
+#include <time.h>
+
+#include "taskmaster.h"
+
+/*
+ * Prometheus metrics.
+ * Counters are kept up to date by the paths which already handle the events:
+ * forks, reaps, proc state changes & timers. The time spent in a state is
+ * added up when a proc leaves it, and each program keeps the sum of the
+ * instants its procs entered their current state: a scrape reads a few
+ * counters per program & never walks the processes. Latencies go to
+ * log-bucketed histograms (hist.h), reported as summaries.
+ * With -m, a thread listens on a UNIX socket and answers every connection with
+ * the metrics in the text exposition format, wrapped in an HTTP/1.0 response
+ * if the client sent a GET request. The thread asks the main thread for them
+ * with METRICS_SIGNAL, the program list being only read from its handler.
+ */
+
+#define METRICS_SIGNAL SIGUSR2
+#define METRICS_REQ_TIMEOUT_MS (1000) /* wait for the request of a client */
+#define METRICS_BACKLOG (16)
+#define METRICS_CMD_MAX (16) /* commands timed */
+
+/* supervisor code paths timed, for `debug stats` */
+typedef enum e_cost_path {
+  COST_NOTIFICATION, /* pgm_notification() */
+  COST_REAP,         /* update_pgm_status() */
+  COST_SIGALRM,      /* sigalrm_handler() */
+  COST_RELOAD,       /* commit of a reloaded configuration */
+  COST_CMD,          /* command handlers, by command index from here */
+  COST_MAX = COST_CMD + METRICS_CMD_MAX,
+} t_cost_path;
+
+typedef struct s_metrics_cost {
+  const char *name; /* NULL until the path is timed once */
+  uint64_t cnt;
+  int64_t us;
+  int64_t max_us;
+} t_metrics_cost;
+
+/* timers fired after & before the instant they are due */
+typedef enum e_drift_side {
+  DRIFT_LATE,
+  DRIFT_EARLY,
+  DRIFT_NB,
+} t_drift_side;
+
+/* supervisor metrics */
+typedef struct s_tm_metrics {
+  uint32_t timers;    /* timers pending */
+  int64_t timer_due;  /* us the armed timer is due, 0 if none is armed */
+  struct s_hist *lag; /* delays timers were fired with by SIGALRM */
+  struct s_hist *drift[DRIFT_NB]; /* fire time minus due time of timers */
+  struct s_hist *lat[LAT_NB]; /* latencies of all the programs */
+  t_metrics_cost cost[COST_MAX];
+} t_tm_metrics;
+
+extern t_tm_metrics tm_metrics;
+
+/* monotonic clock in ms & us */
+int64_t metrics_now_ms(void);
+int64_t metrics_now_us(void);
+
+/* add a latency in us to the histogram of stage of pgm */
+void metrics_lat(t_pgm *pgm, t_lat_stage stage, int64_t us);
+
+/* print the latency percentiles of pgm, for the stats command */
+void metrics_print_lat(FILE *stream, const t_pgm *pgm);
+
+/* proc entered proc->state */
+void metrics_proc_enter(t_pgm *pgm, t_process *proc);
+
+/* proc leaves proc->state, for another one or for good */
+void metrics_proc_leave(t_pgm *pgm, const t_process *proc);
+
+/* count the exit code or the signal of a waitpid() status */
+void metrics_proc_exit(t_pgm *pgm, int32_t w_status);
+
+/* the first timer is armed to fire in sec seconds, or disarmed if sec < 0 */
+void metrics_timer_armed(time_t sec);
+
+/* SIGALRM fired the armed timer */
+void metrics_timer_fired(void);
+
+/* a timer due at due (monotonic us) fires now. Timers are armed to the
+ * second, so the ones sharing the alarm of another can fire early */
+void metrics_timer_drift(int64_t due);
+
+/* add a call of path, named name, which started start us ago */
+void metrics_cost(t_cost_path path, const char *name, int64_t start);
+
+/* print the costs of the timed paths, the timer lag & drift, for `debug
+ * stats` */
+void metrics_print_debug(FILE *stream);
+
+/* serve metrics on the UNIX socket path. Returns EXIT_FAILURE with errno set */
+int32_t metrics_start(const char *path);
+
+/* METRICS_SIGNAL handler: render the metrics of node for the thread */
+void metrics_serve(const t_tm_node *node);
+
+#endif
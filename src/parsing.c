@@ -5,6 +5,11 @@
 #include <signal.h>
 #include <sys/stat.h>
 
+#include "conf_include.h"
+#include "ft_log.h"
+#include "san_pool.h"
+#include "shared.h"
+#include "snapshot.h"
 #include "taskmaster.h"
 #include "yaml.h"
 
@@ -23,6 +28,8 @@ static const char keys[KEY_NB_MAX][KEY_BUF_LEN] = {
     "stderr\0",     "workingdir\0",  "exitcodes\0",    "numprocs\0",
     "umask\0",      "autorestart\0", "startretries\0", "autostart\0",
     "stopsignal\0", "starttime\0",   "stoptime\0",
+    "stdout_maxbytes\0", "stdout_backups\0", "stderr_maxbytes\0",
+    "stderr_backups\0", "logcompress\0", "max_unavailable\0", "max_surge\0",
 };
 
 static t_config_error print_san_err(const char *name, t_keys key,
@@ -33,6 +40,7 @@ static t_config_error print_san_err(const char *name, t_keys key,
            name, keys[key], key ? " key: " : "", err_type[err],
            err_msg ? err_msg : "");
   write(STDERR_FILENO, err_msg_buf, strlen(err_msg_buf));
+  ft_log(FT_LOG_ERR, "%.*s", (int)strlen(err_msg_buf) - 1, err_msg_buf);
   return err;
 }
 
@@ -45,6 +53,9 @@ static void handle_config_error(yaml_event_t *event, t_config_error err,
            key ? " key: " : "", err_type[err], event->start_mark.line + 1,
            event->start_mark.column + 1);
   write(STDERR_FILENO, err_msg_buf, strlen(err_msg_buf));
+  ft_log(FT_LOG_ERR, "Parse error: %s%s%s (line %lu column %lu)", keys[key],
+         key ? " key: " : "", err_type[err], event->start_mark.line + 1,
+         event->start_mark.column + 1);
 }
 
 /* =============================== utils ==================================== */
@@ -140,6 +151,39 @@ static char **ft_split(const char *str, char c) {
   return array;
 }
 
+/* parse a number of bytes with an optional K, M or G suffix (ex: 50MB) */
+static uint8_t parse_bytes(const char *data, uint64_t *bytes) {
+  char *endptr;
+
+  *bytes = (uint64_t)strtoumax(data, &endptr, 10);
+  if (endptr == data) return VALUE_ERROR;
+  switch (*endptr) {
+    case 'G':
+      *bytes <<= 10; /* fall through */
+    case 'M':
+      *bytes <<= 10; /* fall through */
+    case 'K':
+      *bytes <<= 10;
+      endptr++;
+      if (*endptr == 'B') endptr++;
+      break;
+    case 'B':
+      endptr++;
+      break;
+  }
+  return (*endptr ? VALUE_ERROR : EXIT_SUCCESS);
+}
+
+static uint8_t parse_backups(const char *data, uint8_t *backups) {
+  char *endptr;
+  uintmax_t val;
+
+  val = strtoumax(data, &endptr, 10);
+  if (endptr == data || *endptr || val > SAN_BACKUPS_MAX) return VALUE_ERROR;
+  *backups = (uint8_t)val;
+  return EXIT_SUCCESS;
+}
+
 /* =========================== data_load handlers =========================== */
 
 DECL_DATA_LOAD_HANDLER(nokey_data_load) {
@@ -149,95 +193,61 @@ DECL_DATA_LOAD_HANDLER(nokey_data_load) {
 }
 
 DECL_DATA_LOAD_HANDLER(cmd_data_load) {
-  char *cmd;
+  char **cmd;
+  uint32_t cnt = 0;
 
   if (!*data) return MISSING_ERROR;
-  cmd = strdup(data);
-  if (!cmd) handle_error("strdup");
-  pgm->cmd = ft_split(cmd, ' ');
-  free(cmd);
-  if (!pgm->cmd) handle_error("ft_split");
+  if (!(cmd = ft_split(data, ' '))) handle_error("ft_split");
+  while (cmd[cnt]) cnt++;
+  shr_unref(pgm->cmd);
+  pgm->cmd = shr_strv(cmd, cnt);
+  destroy_str_array(cmd, cnt);
+  if (!pgm->cmd) handle_error("shr_strv");
   return EXIT_SUCCESS;
 }
 
+/* env is a mapping, loaded by load_vec_env() */
 DECL_DATA_LOAD_HANDLER(env_data_load) {
-  static uint8_t data_type = KEY_TYPE;
-  size_t data_len = strlen(data), old_len;
-  char *str = NULL, *old_str;
-
-  if (!*data) return MISSING_ERROR;
-
-  if (data_type == KEY_TYPE) {
-    /* create a new char pointer for a new key=value pair*/
-    pgm->env.array_size++;
-    pgm->env.array_val =
-        realloc(pgm->env.array_val,
-                (pgm->env.array_size + 1) * sizeof(*(pgm->env.array_val)));
-    if (!pgm->env.array_val) handle_error("realloc");
-    pgm->env.array_val[pgm->env.array_size] = NULL;
-
-    /* create a new formated 'key' string and hold the address in the array */
-    str = malloc((data_len + 2) * sizeof(*str));
-    if (!str) handle_error("malloc");
-    strncpy(str, data, data_len);
-    strncpy(str + data_len, "=\0", 2);
-    pgm->env.array_val[pgm->env.array_size - 1] = str;
-  } else if (data_type == VALUE_TYPE) {
-    /* just concatenate the value to the key string */
-    old_str = pgm->env.array_val[pgm->env.array_size - 1];
-    old_len = strlen(old_str);
-    str = realloc(old_str, old_len + data_len + 1);
-    if (!str) handle_error("realloc");
-    strncpy(str + old_len, data, data_len);
-    str[old_len + data_len] = 0;
-    pgm->env.array_val[pgm->env.array_size - 1] = str;
-  } else
-    return EXIT_FAILURE;
-
-  TOGGLE_TYPE(data_type);
-  return EXIT_SUCCESS;
+  UNUSED_PARAM(pgm);
+  UNUSED_PARAM(data);
+  return VALUE_ERROR;
 }
 
 DECL_DATA_LOAD_HANDLER(stdout_data_load) {
   if (!*data) return MISSING_ERROR;
-  pgm->std_out = strdup(data);
-  if (!pgm->std_out) handle_error("strdup");
+  shr_unref(pgm->std_out);
+  pgm->std_out = shr_str(data);
+  if (!pgm->std_out) handle_error("shr_str");
   return EXIT_SUCCESS;
 }
 
 DECL_DATA_LOAD_HANDLER(stderr_data_load) {
   if (!*data) return MISSING_ERROR;
-  pgm->std_err = strdup(data);
-  if (!pgm->std_err) handle_error("strdup");
+  shr_unref(pgm->std_err);
+  pgm->std_err = shr_str(data);
+  if (!pgm->std_err) handle_error("shr_str");
   return EXIT_SUCCESS;
 }
 
 DECL_DATA_LOAD_HANDLER(workingdir_data_load) {
   if (!*data) return MISSING_ERROR;
-  pgm->workingdir = strdup(data);
-  if (!pgm->workingdir) handle_error("strdup");
+  shr_unref(pgm->workingdir);
+  pgm->workingdir = shr_str(data);
+  if (!pgm->workingdir) handle_error("shr_str");
   return EXIT_SUCCESS;
 }
 
+/* a single exit code, a sequence of them is loaded by load_vec_code() */
 DECL_DATA_LOAD_HANDLER(exitcodes_data_load) {
   char *endptr;
+  int16_t code;
 
   if (!*data) return MISSING_ERROR;
-  if (!pgm->exitcodes.array_val) {
-    pgm->exitcodes.array_size++;
-    pgm->exitcodes.array_val =
-        calloc(pgm->exitcodes.array_size, sizeof(*(pgm->exitcodes.array_val)));
-    if (!pgm->exitcodes.array_val) handle_error("calloc");
-    pgm->exitcodes.array_val[0] = (uint8_t)strtoimax(data, &endptr, 10);
-  } else {
-    pgm->exitcodes.array_size++;
-    pgm->exitcodes.array_val =
-        reallocarray(pgm->exitcodes.array_val, pgm->exitcodes.array_size,
-                     sizeof(*(pgm->exitcodes.array_val)));
-    if (!pgm->exitcodes.array_val) handle_error("reallocarray");
-    pgm->exitcodes.array_val[pgm->exitcodes.array_size - 1] =
-        (uint8_t)strtoimax(data, &endptr, 10);
-  }
+  code = (uint8_t)strtoimax(data, &endptr, 10);
+  shr_unref(pgm->exitcodes.array_val);
+  pgm->exitcodes.array_val = shr_i16(&code, 1);
+  if (!pgm->exitcodes.array_val) handle_error("shr_i16");
+  pgm->exitcodes.array_size = 1;
   return EXIT_SUCCESS;
 }
 
@@ -334,6 +344,57 @@ DECL_DATA_LOAD_HANDLER(stoptime_data_load) {
   return EXIT_SUCCESS;
 }
 
+DECL_DATA_LOAD_HANDLER(stdout_maxbytes_data_load) {
+  if (!*data) return MISSING_ERROR;
+  return parse_bytes(data, &pgm->out_rotate.maxbytes);
+}
+
+DECL_DATA_LOAD_HANDLER(stdout_backups_data_load) {
+  if (!*data) return MISSING_ERROR;
+  return parse_backups(data, &pgm->out_rotate.backups);
+}
+
+DECL_DATA_LOAD_HANDLER(stderr_maxbytes_data_load) {
+  if (!*data) return MISSING_ERROR;
+  return parse_bytes(data, &pgm->err_rotate.maxbytes);
+}
+
+DECL_DATA_LOAD_HANDLER(stderr_backups_data_load) {
+  if (!*data) return MISSING_ERROR;
+  return parse_backups(data, &pgm->err_rotate.backups);
+}
+
+DECL_DATA_LOAD_HANDLER(logcompress_data_load) {
+  if (!*data) return MISSING_ERROR;
+  if (!strcmp("true\0", data))
+    pgm->out_rotate.compress = pgm->err_rotate.compress = true;
+  else if (!strcmp("false\0", data))
+    pgm->out_rotate.compress = pgm->err_rotate.compress = false;
+  else
+    return VALUE_ERROR;
+  return EXIT_SUCCESS;
+}
+
+DECL_DATA_LOAD_HANDLER(max_unavailable_data_load) {
+  char *endptr;
+
+  if (!*data) return MISSING_ERROR;
+  pgm->max_unavailable = (uint16_t)strtoumax(data, &endptr, 10);
+  if (endptr == data || *endptr || pgm->max_unavailable > SAN_NUM_PROC_MAX)
+    return VALUE_ERROR;
+  return EXIT_SUCCESS;
+}
+
+DECL_DATA_LOAD_HANDLER(max_surge_data_load) {
+  char *endptr;
+
+  if (!*data) return MISSING_ERROR;
+  pgm->max_surge = (uint16_t)strtoumax(data, &endptr, 10);
+  if (endptr == data || *endptr || pgm->max_surge > SAN_NUM_PROC_MAX)
+    return VALUE_ERROR;
+  return EXIT_SUCCESS;
+}
+
 /* array of functions of type DATA_LOAD_HANDLER */
 static uint8_t (*handle_data_loading[KEY_NB_MAX])(t_pgm_usr *, const char *) = {
     nokey_data_load,       cmd_data_load,          env_data_load,
@@ -341,8 +402,245 @@ static uint8_t (*handle_data_loading[KEY_NB_MAX])(t_pgm_usr *, const char *) = {
     exitcodes_data_load,   numprocs_data_load,     umask_data_load,
     autorestart_data_load, startretries_data_load, autostart_data_load,
     stopsignal_data_load,  starttime_data_load,    stoptime_data_load,
+    stdout_maxbytes_data_load, stdout_backups_data_load,
+    stderr_maxbytes_data_load, stderr_backups_data_load,
+    logcompress_data_load, max_unavailable_data_load, max_surge_data_load,
 };
 
+/* ======================== merge keys & templates ========================== */
+
+/* free the value of key in pgm, so that it can be loaded again */
+static void reset_key(t_pgm_usr *pgm, t_keys key) {
+  switch (key) {
+    case KEY_CMD:
+      shr_unref(pgm->cmd);
+      pgm->cmd = NULL;
+      break;
+    case KEY_ENV:
+      shr_unref(pgm->env.array_val);
+      pgm->env.array_val = NULL, pgm->env.array_size = 0;
+      break;
+    case KEY_STDOUT:
+      shr_unref(pgm->std_out);
+      pgm->std_out = NULL;
+      break;
+    case KEY_STDERR:
+      shr_unref(pgm->std_err);
+      pgm->std_err = NULL;
+      break;
+    case KEY_WORKINGDIR:
+      shr_unref(pgm->workingdir);
+      pgm->workingdir = NULL;
+      break;
+    case KEY_EXITCODES:
+      shr_unref(pgm->exitcodes.array_val);
+      pgm->exitcodes.array_val = NULL, pgm->exitcodes.array_size = 0;
+      break;
+    default:
+      break;
+  }
+}
+
+static void reset_all_keys(t_pgm_usr *pgm) {
+  for (t_keys key = 1; key < KEY_NB_MAX; key++) reset_key(pgm, key);
+  shr_unref(pgm->name);
+  pgm->name = NULL;
+}
+
+/* copy the value of key from src to dst. Shared values are referenced */
+static void copy_key(t_pgm_usr *dst, const t_pgm_usr *src, t_keys key) {
+  switch (key) {
+    case KEY_CMD:
+      dst->cmd = shr_ref(src->cmd);
+      break;
+    case KEY_ENV:
+      dst->env.array_val = shr_ref(src->env.array_val);
+      dst->env.array_size = src->env.array_size;
+      break;
+    case KEY_STDOUT:
+      dst->std_out = shr_ref(src->std_out);
+      break;
+    case KEY_STDERR:
+      dst->std_err = shr_ref(src->std_err);
+      break;
+    case KEY_WORKINGDIR:
+      dst->workingdir = shr_ref(src->workingdir);
+      break;
+    case KEY_EXITCODES:
+      dst->exitcodes.array_val = shr_ref(src->exitcodes.array_val);
+      dst->exitcodes.array_size = src->exitcodes.array_size;
+      break;
+    case KEY_NUMPROCS:
+      dst->numprocs = src->numprocs;
+      break;
+    case KEY_UMASK:
+      dst->umask = src->umask;
+      break;
+    case KEY_AUTORESTART:
+      dst->autorestart = src->autorestart;
+      break;
+    case KEY_STARTRETRIES:
+      dst->startretries = src->startretries;
+      break;
+    case KEY_AUTOSTART:
+      dst->autostart = src->autostart;
+      break;
+    case KEY_STOPSIGNAL:
+      dst->stopsignal = src->stopsignal;
+      break;
+    case KEY_STARTTIME:
+      dst->starttime = src->starttime;
+      break;
+    case KEY_STOPTIME:
+      dst->stoptime = src->stoptime;
+      break;
+    case KEY_STDOUT_MAXBYTES:
+      dst->out_rotate.maxbytes = src->out_rotate.maxbytes;
+      break;
+    case KEY_STDOUT_BACKUPS:
+      dst->out_rotate.backups = src->out_rotate.backups;
+      break;
+    case KEY_STDERR_MAXBYTES:
+      dst->err_rotate.maxbytes = src->err_rotate.maxbytes;
+      break;
+    case KEY_STDERR_BACKUPS:
+      dst->err_rotate.backups = src->err_rotate.backups;
+      break;
+    case KEY_LOGCOMPRESS:
+      dst->out_rotate.compress = src->out_rotate.compress;
+      dst->err_rotate.compress = src->err_rotate.compress;
+      break;
+    case KEY_MAX_UNAVAILABLE:
+      dst->max_unavailable = src->max_unavailable;
+      break;
+    case KEY_MAX_SURGE:
+      dst->max_surge = src->max_surge;
+      break;
+    default:
+      break;
+  }
+}
+
+/* Claim key for a value found at level in the block of parsing->usr. The
+ * least merged value wins, whatever its position: a value of the block itself
+ * overrides merged ones, and the first of several merges at the same level
+ * wins. Returns false if the value is overridden. */
+static bool claim_key(t_config_parsing *parsing, t_keys key, uint8_t level) {
+  uint8_t *key_level = &parsing->key_level[key];
+
+  if (*key_level < level || (*key_level == level && level)) return false;
+  if (*key_level != KEY_UNSET) reset_key(parsing->usr, key);
+  *key_level = level;
+  if (parsing->tpl) parsing->tpl->keys |= (1U << key);
+  return true;
+}
+
+/* returns where the value of key is to be loaded */
+static t_pgm_usr *key_target(t_config_parsing *parsing, t_keys key) {
+  if (claim_key(parsing, key, parsing->merge_level)) return parsing->usr;
+  reset_key(&parsing->scratch, key);
+  return &parsing->scratch;
+}
+
+/* merge the keys of template name into parsing->usr, one level below the
+ * current one */
+static uint8_t apply_template(t_config_parsing *parsing, const char *name) {
+  const t_pgm_tpl *tpl = parsing->templates;
+
+  while (tpl && strcmp(tpl->usr.name, name)) tpl = tpl->next;
+  if (!tpl || tpl == parsing->tpl) return VALUE_ERROR;
+  for (t_keys key = 1; key < KEY_NB_MAX; key++)
+    if ((tpl->keys & (1U << key)) &&
+        claim_key(parsing, key, parsing->merge_level + 1))
+      copy_key(parsing->usr, &tpl->usr, key);
+  return EXIT_SUCCESS;
+}
+
+/* ============================ env & exitcodes ============================= */
+
+/* room for one more value in vec, which starts gathering key of target */
+static void load_vec_grow(t_config_parsing *parsing, t_keys key) {
+  t_load_vec *vec = &parsing->vec;
+
+  if (!vec->nb) vec->target = parsing->target, vec->key = key;
+  if (vec->nb < vec->cap) return;
+  vec->cap = vec->cap ? vec->cap * 2 : 16;
+  vec->off = reallocarray(vec->off, vec->cap, sizeof(*vec->off));
+  vec->strv = reallocarray(vec->strv, vec->cap + 1, sizeof(*vec->strv));
+  vec->codes = reallocarray(vec->codes, vec->cap, sizeof(*vec->codes));
+  if (!vec->off || !vec->strv || !vec->codes) handle_error("reallocarray");
+}
+
+/* append str, with its NUL if nul, to the env strings */
+static void load_vec_append(t_load_vec *vec, const char *str, bool nul) {
+  size_t len = strlen(str) + nul;
+
+  if (vec->len + len + 1 > vec->size) {
+    while (vec->len + len + 1 > vec->size)
+      vec->size = vec->size ? vec->size * 2 : 1024;
+    if (!(vec->buf = realloc(vec->buf, vec->size))) handle_error("realloc");
+  }
+  memcpy(vec->buf + vec->len, str, len);
+  vec->len += len;
+}
+
+/* a scalar of the env mapping: a name, then its value */
+static uint8_t load_vec_env(t_config_parsing *parsing, const char *data) {
+  t_load_vec *vec = &parsing->vec;
+
+  if (!vec->value) {
+    if (!*data) return MISSING_ERROR;
+    load_vec_grow(parsing, KEY_ENV);
+    vec->off[vec->nb++] = vec->len;
+    load_vec_append(vec, data, false);
+    load_vec_append(vec, "=", false);
+  } else {
+    load_vec_append(vec, data, true);
+  }
+  vec->value = !vec->value;
+  return EXIT_SUCCESS;
+}
+
+/* a code of the exitcodes sequence */
+static uint8_t load_vec_code(t_config_parsing *parsing, const char *data) {
+  char *endptr;
+
+  if (!*data) return MISSING_ERROR;
+  load_vec_grow(parsing, KEY_EXITCODES);
+  parsing->vec.codes[parsing->vec.nb++] = (uint8_t)strtoimax(data, &endptr, 10);
+  return EXIT_SUCCESS;
+}
+
+/* intern the values gathered, the env or exitcodes node being over */
+static void load_vec_seal(t_config_parsing *parsing) {
+  t_load_vec *vec = &parsing->vec;
+  t_pgm_usr *usr = vec->target;
+
+  if (!vec->nb) return;
+  if (vec->key == KEY_ENV) {
+    for (uint32_t i = 0; i < vec->nb; i++)
+      vec->strv[i] = vec->buf + vec->off[i];
+    shr_unref(usr->env.array_val);
+    usr->env.array_val = shr_strv(vec->strv, vec->nb);
+    if (!usr->env.array_val) handle_error("shr_strv");
+    usr->env.array_size = vec->nb;
+  } else {
+    shr_unref(usr->exitcodes.array_val);
+    usr->exitcodes.array_val = shr_i16(vec->codes, vec->nb);
+    if (!usr->exitcodes.array_val) handle_error("shr_i16");
+    usr->exitcodes.array_size = vec->nb;
+  }
+  vec->nb = 0, vec->len = 0, vec->value = false;
+}
+
+static void load_vec_destroy(t_load_vec *vec) {
+  free(vec->off);
+  free(vec->strv);
+  free(vec->codes);
+  free(vec->buf);
+  *vec = (t_load_vec){0};
+}
+
 /* ============================= yaml handlers ============================== */
 
 DECL_YAML_HANDLER(yaml_nothing) {
@@ -380,13 +678,6 @@ DECL_YAML_HANDLER(yaml_doc_e) {
   return EXIT_SUCCESS;
 }
 
-DECL_YAML_HANDLER(yaml_alias) {
-  UNUSED_PARAM(node);
-  UNUSED_PARAM(parsing);
-  UNUSED_PARAM(event);
-  return EXIT_SUCCESS;
-}
-
 DECL_YAML_HANDLER(yaml_scalar_0) {
   UNUSED_PARAM(node);
   UNUSED_PARAM(parsing);
@@ -394,33 +685,55 @@ DECL_YAML_HANDLER(yaml_scalar_0) {
   return EXIT_FAILURE;
 }
 
-/* this depth of scalar event should happen only once and declare the begining
- * of programs declaration */
+/* this depth of scalar event declares either the begining of programs or
+ * templates declaration, which should happen only once, or files to
+ * include */
 DECL_YAML_HANDLER(yaml_scalar_1) {
-  UNUSED_PARAM(node);
-  if (parsing->info != PARSING_READY) {
-    if (!strcmp("programs\0", (char *)event->data.scalar.value)) {
-      parsing->info |= MASK_PGM;
-    } else {
-      return EXIT_FAILURE; /* wrong key */
-    }
+  const char *value = (char *)event->data.scalar.value;
+
+  if (parsing->include) {
+    if (!parsing->seq_depth) parsing->include = false;
+    return conf_include_load(node, value);
+  }
+  if (!strcmp("include\0", value) && !parsing->nested) {
+    parsing->include = true;
+  } else if (!strcmp("programs\0", value) &&
+             (parsing->info & PARSING_READY) != PARSING_READY) {
+    parsing->info |= MASK_PGM;
+    parsing->section = SECTION_PGM;
+  } else if (!strcmp("templates\0", value) && !(parsing->info & MASK_TPL)) {
+    parsing->info |= MASK_TPL;
+    parsing->section = SECTION_TPL;
   } else {
-    return EXIT_FAILURE; /* We should enter only once in 'programs' field */
+    return EXIT_FAILURE; /* wrong key, or a field entered twice */
   }
   return EXIT_SUCCESS;
 }
 
-/* this depth of scalar event is a declaration of a new program, the key being
- * the program name */
+/* this depth of scalar event is a declaration of a new program, or template,
+ * the key being its name */
 DECL_YAML_HANDLER(yaml_scalar_2) {
-  UNUSED_PARAM(parsing);
-  t_pgm *new = calloc(1, sizeof(*new));
+  const char *name = (char *)event->data.scalar.value;
+  t_pgm_tpl *tpl;
+  t_pgm *new;
+
+  memset(parsing->key_level, KEY_UNSET, sizeof(parsing->key_level));
+  if (parsing->section == SECTION_TPL) {
+    if (!(tpl = calloc(1, sizeof(*tpl)))) handle_error("calloc");
+    tpl->next = parsing->templates;
+    parsing->templates = tpl;
+    if (!(tpl->usr.name = shr_str(name))) handle_error("shr_str");
+    parsing->usr = &tpl->usr, parsing->tpl = tpl;
+    return EXIT_SUCCESS;
+  }
+  new = calloc(1, sizeof(*new));
   if (!new) handle_error("calloc");
   if (node->head) new->privy.next = node->head;
   node->head = new;
-  new->usr.name = strdup((char *)event->data.scalar.value);
-  if (!new->usr.name) handle_error("strdup");
+  new->usr.name = shr_str(name);
+  if (!new->usr.name) handle_error("shr_str");
   node->pgm_nb++;
+  parsing->usr = &new->usr, parsing->tpl = NULL;
   return EXIT_SUCCESS;
 }
 
@@ -430,16 +743,34 @@ static t_keys findkey(const char *key) {
   return (0);
 }
 
-/* this depth of scalar event concerns all variables of a t_pgm */
+/* this depth of scalar event concerns all variables of a t_pgm, a merge key
+ * or a template */
 DECL_YAML_HANDLER(yaml_scalar_3) {
+  UNUSED_PARAM(node);
+  const char *value = (char *)event->data.scalar.value;
   uint8_t ret = EXIT_SUCCESS;
+
   if (parsing->scalar_type == KEY_TYPE) {
-    parsing->key = findkey((char *)event->data.scalar.value);
-    ret = (ret * (parsing->key > 0)) + (WRONG_KEY * (parsing->key == 0));
+    parsing->key = NO_KEY;
+    if (!strcmp(MERGE_KEY, value))
+      parsing->merge_pending = true;
+    else if (!strcmp("template\0", value))
+      parsing->use_tpl = true;
+    else if ((parsing->key = findkey(value)))
+      parsing->target = key_target(parsing, parsing->key);
+    else
+      ret = WRONG_KEY;
   } else if (parsing->scalar_type == VALUE_TYPE) {
-    if (!parsing->key || parsing->key >= KEY_NB_MAX) return EXIT_FAILURE;
-    ret = handle_data_loading[parsing->key](&node->head->usr,
-                                            (char *)event->data.scalar.value);
+    if (parsing->use_tpl) {
+      parsing->use_tpl = false;
+      ret = apply_template(parsing, value);
+    } else if (parsing->merge_pending || !parsing->key ||
+               parsing->key >= KEY_NB_MAX)
+      return EXIT_FAILURE; /* merge keys take mappings */
+    else if (parsing->key == KEY_EXITCODES && parsing->seq_depth)
+      ret = load_vec_code(parsing, value);
+    else
+      ret = handle_data_loading[parsing->key](parsing->target, value);
   } else
     return EXIT_FAILURE;
   if (!parsing->seq_depth)
@@ -451,10 +782,9 @@ DECL_YAML_HANDLER(yaml_scalar_3) {
 DECL_YAML_HANDLER(yaml_scalar_4) {
   uint8_t ret = EXIT_SUCCESS;
 
-  if (parsing->key != KEY_ENV || !parsing->key || parsing->key >= KEY_NB_MAX)
-    return EXIT_FAILURE;
-  ret = handle_data_loading[parsing->key](&node->head->usr,
-                                          (char *)event->data.scalar.value);
+  UNUSED_PARAM(node);
+  if (parsing->key != KEY_ENV) return EXIT_FAILURE;
+  ret = load_vec_env(parsing, (char *)event->data.scalar.value);
   return ret;
 }
 
@@ -472,8 +802,13 @@ DECL_YAML_HANDLER(yaml_scalar) {
 DECL_YAML_HANDLER(yaml_seq_st) {
   UNUSED_PARAM(node);
   UNUSED_PARAM(event);
-  if (parsing->map_depth < 3)
-    return EXIT_FAILURE; /* no sequence before pgm definition */
+  if (parsing->map_depth < 3 && !parsing->include)
+    return EXIT_FAILURE; /* no sequence before pgm definition but includes */
+  if (parsing->merge_pending &&
+      !(parsing->merge_seqs & (1 << parsing->merge_level))) {
+    parsing->merge_seqs |= (1 << parsing->merge_level); /* '<<: [*a, *b]' */
+    return EXIT_SUCCESS;
+  }
   parsing->seq_depth++;
   return EXIT_SUCCESS;
 }
@@ -482,13 +817,29 @@ DECL_YAML_HANDLER(yaml_seq_e) {
   UNUSED_PARAM(node);
   UNUSED_PARAM(event);
   parsing->scalar_type = KEY_TYPE; /* we fall back on a key after this event */
+  if (parsing->merge_pending) { /* end of a sequence of merged mappings */
+    parsing->merge_seqs &= ~(1 << parsing->merge_level);
+    parsing->merge_pending = false;
+    return EXIT_SUCCESS;
+  }
   parsing->seq_depth--;
+  parsing->include = false;
+  if (!parsing->seq_depth && parsing->key == KEY_EXITCODES)
+    load_vec_seal(parsing);
   return EXIT_SUCCESS;
 }
 
 DECL_YAML_HANDLER(yaml_map_st) {
   UNUSED_PARAM(node);
   UNUSED_PARAM(event);
+  if (parsing->include) return VALUE_ERROR; /* include patterns are scalars */
+  if (parsing->merge_pending) { /* merged mapping, flattened in the pgm */
+    if (parsing->merge_level == MERGE_DEPTH_MAX) return VALUE_ERROR;
+    parsing->merge_level++;
+    parsing->merge_pending = false;
+    parsing->scalar_type = KEY_TYPE;
+    return EXIT_SUCCESS;
+  }
   parsing->map_depth++;
   return EXIT_SUCCESS;
 }
@@ -496,131 +847,401 @@ DECL_YAML_HANDLER(yaml_map_st) {
 DECL_YAML_HANDLER(yaml_map_e) {
   UNUSED_PARAM(node);
   UNUSED_PARAM(event);
+  if (parsing->merge_level && parsing->map_depth == 3) {
+    parsing->merge_level--; /* end of a merged mapping */
+    parsing->merge_pending =
+        (parsing->merge_seqs & (1 << parsing->merge_level)) != 0;
+    parsing->scalar_type = KEY_TYPE;
+    parsing->key = 0;
+    return EXIT_SUCCESS;
+  }
   parsing->map_depth--;
   parsing->scalar_type = KEY_TYPE; /* we fall back on a key after this event */
+  if (parsing->map_depth == 3 && parsing->key == KEY_ENV)
+    load_vec_seal(parsing);
   if (parsing->map_depth < 3) parsing->key = 0; /* reset key */
   return EXIT_SUCCESS;
 }
 
+/* array of functions of type YAML_HANDLER. Aliases are replayed by
+ * handle_event() */
+static uint8_t (*handle_yaml_event[YAML_MAX_EVENT])(t_tm_node *,
+                                                    t_config_parsing *,
+                                                    yaml_event_t *) = {
+    yaml_nothing, yaml_stream_st, yaml_stream_e, yaml_doc_st,
+    yaml_doc_e,   yaml_nothing,   yaml_scalar,   yaml_seq_st,
+    yaml_seq_e,   yaml_map_st,    yaml_map_e};
+
+/* ================================ anchors ================================= */
+
+/* copy the data handlers use of event into dst, without anchor */
+static int32_t copy_event(yaml_event_t *dst, const yaml_event_t *src) {
+  int32_t ok = 0;
+
+  switch (src->type) {
+    case YAML_SCALAR_EVENT:
+      ok = yaml_scalar_event_initialize(
+          dst, NULL, NULL, src->data.scalar.value, src->data.scalar.length, 1,
+          1, YAML_ANY_SCALAR_STYLE);
+      break;
+    case YAML_SEQUENCE_START_EVENT:
+      ok = yaml_sequence_start_event_initialize(dst, NULL, NULL, 1,
+                                                YAML_ANY_SEQUENCE_STYLE);
+      break;
+    case YAML_SEQUENCE_END_EVENT:
+      ok = yaml_sequence_end_event_initialize(dst);
+      break;
+    case YAML_MAPPING_START_EVENT:
+      ok = yaml_mapping_start_event_initialize(dst, NULL, NULL, 1,
+                                               YAML_ANY_MAPPING_STYLE);
+      break;
+    case YAML_MAPPING_END_EVENT:
+      ok = yaml_mapping_end_event_initialize(dst);
+      break;
+    default:
+      break;
+  }
+  dst->start_mark = src->start_mark, dst->end_mark = src->end_mark;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static const yaml_char_t *event_anchor(const yaml_event_t *event) {
+  if (event->type == YAML_SCALAR_EVENT) return event->data.scalar.anchor;
+  if (event->type == YAML_SEQUENCE_START_EVENT)
+    return event->data.sequence_start.anchor;
+  if (event->type == YAML_MAPPING_START_EVENT)
+    return event->data.mapping_start.anchor;
+  return NULL;
+}
+
+static int32_t start_anchor(t_config_parsing *parsing, const char *name) {
+  t_yaml_anchor *anchors;
+
+  anchors = reallocarray(parsing->anchors, parsing->anchor_nb + 1,
+                         sizeof(*anchors));
+  if (!anchors) return EXIT_FAILURE;
+  parsing->anchors = anchors;
+  anchors[parsing->anchor_nb] = (t_yaml_anchor){.recording = true};
+  if (!(anchors[parsing->anchor_nb].name = strdup(name))) return EXIT_FAILURE;
+  parsing->anchor_nb++;
+  return EXIT_SUCCESS;
+}
+
+/* append event to every anchored node it belongs to */
+static int32_t record_event(t_config_parsing *parsing,
+                            const yaml_event_t *event) {
+  t_yaml_anchor *anchor;
+  yaml_event_t *events;
+
+  for (uint32_t i = 0; i < parsing->anchor_nb; i++) {
+    anchor = &parsing->anchors[i];
+    if (!anchor->recording) continue;
+    if (anchor->nb == anchor->cap) {
+      anchor->cap = anchor->cap ? anchor->cap * 2 : 16;
+      events = reallocarray(anchor->events, anchor->cap, sizeof(*events));
+      if (!events) return EXIT_FAILURE;
+      anchor->events = events;
+    }
+    if (copy_event(&anchor->events[anchor->nb], event)) return EXIT_FAILURE;
+    anchor->nb++;
+    if (event->type == YAML_SEQUENCE_START_EVENT ||
+        event->type == YAML_MAPPING_START_EVENT)
+      anchor->depth++;
+    else if (event->type == YAML_SEQUENCE_END_EVENT ||
+             event->type == YAML_MAPPING_END_EVENT)
+      anchor->depth--;
+    if (!anchor->depth) anchor->recording = false;
+  }
+  return EXIT_SUCCESS;
+}
+
+static uint8_t handle_event(t_tm_node *node, t_config_parsing *parsing,
+                            yaml_event_t *event);
+
+/* replay the events of the last node anchored as name */
+static uint8_t replay_anchor(t_tm_node *node, t_config_parsing *parsing,
+                             const char *name) {
+  uint32_t i = parsing->anchor_nb, nb;
+  uint8_t ret = EXIT_SUCCESS;
+
+  while (i && strcmp(parsing->anchors[i - 1].name, name)) i--;
+  if (!i || parsing->anchors[i - 1].recording)
+    return VALUE_ERROR; /* unknown, or recursive alias */
+  nb = parsing->anchors[i - 1].nb;
+  for (uint32_t j = 0; !ret && j < nb; j++)
+    ret = handle_event(node, parsing, &parsing->anchors[i - 1].events[j]);
+  return ret;
+}
+
+/* dispatch event to its handler. Anchored nodes are recorded on the way,
+ * aliases are replaced by the events of their node */
+static uint8_t handle_event(t_tm_node *node, t_config_parsing *parsing,
+                            yaml_event_t *event) {
+  const yaml_char_t *anchor = event_anchor(event);
+
+  if (event->type == YAML_ALIAS_EVENT)
+    return replay_anchor(node, parsing, (char *)event->data.alias.anchor);
+  if (anchor && start_anchor(parsing, (const char *)anchor))
+    return UNDEFINED_ERROR;
+  if (record_event(parsing, event)) return UNDEFINED_ERROR;
+  return handle_yaml_event[event->type](node, parsing, event);
+}
+
+/* free anchors, templates & values merged away */
+static void destroy_parsing(t_config_parsing *parsing) {
+  t_pgm_tpl *next;
+
+  for (uint32_t i = 0; i < parsing->anchor_nb; i++) {
+    for (uint32_t j = 0; j < parsing->anchors[i].nb; j++)
+      yaml_event_delete(&parsing->anchors[i].events[j]);
+    free(parsing->anchors[i].events);
+    free(parsing->anchors[i].name);
+  }
+  DESTROY_PTR(parsing->anchors);
+  parsing->anchor_nb = 0;
+  for (t_pgm_tpl *tpl = parsing->templates; tpl; tpl = next) {
+    next = tpl->next;
+    reset_all_keys(&tpl->usr);
+    free(tpl);
+  }
+  parsing->templates = NULL;
+  reset_all_keys(&parsing->scratch);
+  load_vec_destroy(&parsing->vec);
+}
+
 /* ========================= main parsing functions ========================= */
 
-/* Parse yaml configuration file and load data into t_pgm linked list.
+/* Run parser and load data into t_pgm linked list of node.
  * Do some basic sanitation */
-uint8_t load_config_file(t_tm_node *node) {
-  yaml_parser_t parser;
+static uint8_t parse_config(t_tm_node *node, yaml_parser_t *parser,
+                            t_config_parsing *parsing) {
   yaml_event_t event;
-  t_config_parsing parsing = {0};
   uint8_t done = 0, ret;
-  uint8_t (*handle_yaml_event[YAML_MAX_EVENT])(t_tm_node *, t_config_parsing *,
-                                               yaml_event_t *) = {
-      yaml_nothing, yaml_stream_st, yaml_stream_e, yaml_doc_st,
-      yaml_doc_e,   yaml_alias,     yaml_scalar,   yaml_seq_st,
-      yaml_seq_e,   yaml_map_st,    yaml_map_e}; /* array of functions of type
-                                                    YAML_HANDLER */
-
-  yaml_parser_initialize(&parser);
-  yaml_parser_set_input_file(&parser, node->config_file_stream);
 
   /* Read the event sequence. */
   while (!done) {
     /* Get the next event. */
-    if (!yaml_parser_parse(&parser, &event)) {
-      if (parser.problem_mark.line || parser.problem_mark.column) {
+    if (!yaml_parser_parse(parser, &event)) {
+      if (parser->problem_mark.line || parser->problem_mark.column) {
         fprintf(stderr, "Parse error: %s\nLine: %lu Column: %lu\n",
-                parser.problem, (unsigned long)parser.problem_mark.line + 1,
-                (unsigned long)parser.problem_mark.column + 1);
+                parser->problem, (unsigned long)parser->problem_mark.line + 1,
+                (unsigned long)parser->problem_mark.column + 1);
+        ft_log(FT_LOG_ERR, "Parse error: %s (line %lu column %lu)",
+               parser->problem, (unsigned long)parser->problem_mark.line + 1,
+               (unsigned long)parser->problem_mark.column + 1);
       } else {
-        fprintf(stderr, "Parse error: %s\n", parser.problem);
+        fprintf(stderr, "Parse error: %s\n", parser->problem);
+        ft_log(FT_LOG_ERR, "Parse error: %s", parser->problem);
       }
-      goto error;
+      destroy_parsing(parsing);
+      return EXIT_FAILURE;
     }
 
-    ret = handle_yaml_event[event.type](node, &parsing, &event);
+    ret = handle_event(node, parsing, &event);
     if (ret) {
-      handle_config_error(&event, ret, parsing.key);
+      handle_config_error(&event, ret, parsing->key);
       yaml_event_delete(&event);
-      goto error;
+      destroy_parsing(parsing);
+      return EXIT_FAILURE;
     }
     done = (event.type == YAML_STREAM_END_EVENT);
     yaml_event_delete(&event);
   }
+  destroy_parsing(parsing);
+  return EXIT_SUCCESS;
+}
 
+/* Parse yaml configuration file of node, files it includes are loaded along */
+uint8_t load_config_file(t_tm_node *node) {
+  yaml_parser_t parser;
+  t_config_parsing parsing = {0};
+
+  yaml_parser_initialize(&parser);
+  yaml_parser_set_input_file(&parser, node->config_file_stream);
+  if (parse_config(node, &parser, &parsing)) {
+    yaml_parser_delete(&parser);
+    destroy_taskmaster(node);
+    return EXIT_FAILURE;
+  }
   fclose(node->config_file_stream);
   node->config_file_stream = NULL;
   yaml_parser_delete(&parser);
   return EXIT_SUCCESS;
+}
 
-error:
+/* Parse the yaml content of an included file, which can't include others */
+uint8_t load_config_buffer(t_tm_node *node, const char *buf, size_t len) {
+  yaml_parser_t parser;
+  t_config_parsing parsing = {.nested = true};
+  uint8_t ret;
+
+  yaml_parser_initialize(&parser);
+  yaml_parser_set_input_string(&parser, (const unsigned char *)buf, len);
+  ret = parse_config(node, &parser, &parsing);
   yaml_parser_delete(&parser);
-  destroy_taskmaster(node);
-  return EXIT_FAILURE;
+  if (ret) destroy_taskmaster(node);
+  return ret;
+}
+
+/* index of the filesystem checks of a pgm in the pool */
+typedef enum e_san_fs {
+  SAN_FS_CMD,
+  SAN_FS_WORKINGDIR,
+  SAN_FS_STDOUT,
+  SAN_FS_STDERR,
+  SAN_FS_NB,
+} t_san_fs;
+
+/* register the filesystem checks of every pgm into pool. Checks which don't
+ * apply are set to -1 */
+static uint8_t register_fs_checks(t_tm_node *node, t_san_pool *pool,
+                                  int32_t (*ids)[SAN_FS_NB]) {
+  uint32_t i = 0;
+  t_pgm_usr *pgm;
+
+  for (t_pgm *head = node->head; head; head = head->privy.next, i++) {
+    pgm = &head->usr;
+    ids[i][SAN_FS_CMD] = (pgm->cmd && pgm->cmd[0])
+                             ? san_pool_add(pool, pgm->cmd[0], SAN_CHECK_STAT)
+                             : -1;
+    ids[i][SAN_FS_WORKINGDIR] =
+        pgm->workingdir ? san_pool_add(pool, pgm->workingdir, SAN_CHECK_STAT)
+                        : -1;
+    ids[i][SAN_FS_STDOUT] =
+        pgm->std_out ? san_pool_add(pool, pgm->std_out, SAN_CHECK_APPEND) : -1;
+    ids[i][SAN_FS_STDERR] =
+        pgm->std_err ? san_pool_add(pool, pgm->std_err, SAN_CHECK_APPEND) : -1;
+    if ((pgm->cmd && pgm->cmd[0] && ids[i][SAN_FS_CMD] == -1) ||
+        (pgm->workingdir && ids[i][SAN_FS_WORKINGDIR] == -1) ||
+        (pgm->std_out && ids[i][SAN_FS_STDOUT] == -1) ||
+        (pgm->std_err && ids[i][SAN_FS_STDERR] == -1))
+      return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/* length of the name of the first variable of env set twice, 0 if none. The
+ * child would only get the first value, reordering env would change it while
+ * env is hashed as a set by the reload. Elements are 'name=value' strings */
+static size_t env_dup_name(const t_pgm_usr *pgm, uint32_t *idx) {
+  char *const *env = pgm->env.array_val;
+  size_t len;
+
+  for (*idx = 0; *idx < pgm->env.array_size; (*idx)++) {
+    len = strchr(env[*idx], '=') - env[*idx];
+    for (uint32_t j = *idx + 1; j < pgm->env.array_size; j++)
+      if (!strncmp(env[*idx], env[j], len + 1)) return len;
+  }
+  return 0;
+}
+
+/* Sanitize configuration. Verify files and directory access, open logging fd.
+ * Filesystem accesses are done beforehand on a thread pool, once per path,
+ * then errors are reported in the pgm list order. */
+/* occurrences of the name of pgm in the programs of node if pgm is the second
+ * one, 0 otherwise: a name defined several times is reported once */
+static uint32_t pgm_dup_name(const t_tm_node *node, const t_pgm_map *map,
+                             const t_pgm *pgm) {
+  uint32_t cnt = 0;
+  bool second = false;
+
+  if (pgm_map_get(map, pgm->usr.name) == pgm) return 0;
+  for (const t_pgm *cur = node->head; cur; cur = cur->privy.next)
+    if (cur->usr.name == pgm->usr.name && ++cnt == 2) second = cur == pgm;
+  return second ? cnt : 0;
 }
 
-/* Sanitize configuration. Verify files and directory access, open logging fd */
 uint8_t sanitize_config(t_tm_node *node) {
+  t_san_pool pool = {0};
+  t_pgm_map map = {0};
+  int32_t(*ids)[SAN_FS_NB] = NULL;
+  const t_san_check *check;
   t_pgm_usr *pgm;
-  struct stat statbuf;
   t_keys key;
+  uint32_t i = 0, pgm_nb = 0, var, cnt;
   uint8_t err, tot_err = 0;
-  int8_t ret;
+  char msg[ERR_MSG_BUF_SIZE];
+  size_t len;
 
-  for (t_pgm *head = node->head; head; head = head->privy.next) {
+  for (t_pgm *head = node->head; head; head = head->privy.next) pgm_nb++;
+  if (pgm_nb && !(ids = calloc(pgm_nb, sizeof(*ids)))) goto_error("calloc");
+  if (pgm_map_init(&map, node->head)) goto_error("pgm_map_init");
+  if (register_fs_checks(node, &pool, ids)) goto_error("san_pool_add");
+  san_pool_run(&pool);
+
+  for (t_pgm *head = node->head; head; head = head->privy.next, i++) {
     pgm = &head->usr;
     err = 0;
 
+    if ((cnt = pgm_dup_name(node, &map, head))) {
+      conf_include_origin(node->config_file_name, pgm->name, cnt, msg,
+                          sizeof(msg));
+      tot_err++, err = print_san_err(pgm->name, NO_KEY, 0, msg);
+    }
     if (!pgm->cmd || !*(pgm->cmd))
       tot_err++, key = KEY_CMD,
                  err = print_san_err(pgm->name, key, MISSING_ERROR, NULL);
-    if (pgm->cmd) {
-      ret = stat(pgm->cmd[0], &statbuf);
-      if (ret == -1) {
+    if (ids[i][SAN_FS_CMD] != -1) {
+      check = san_pool_get(&pool, ids[i][SAN_FS_CMD]);
+      if (check->err) {
         tot_err++, key = KEY_CMD,
-                   err = print_san_err(pgm->name, key, 0, strerror(errno));
-      } else if (!ret) {
-        if (!S_ISREG(statbuf.st_mode))
-          tot_err++,
-              key = KEY_CMD,
-              err = print_san_err(pgm->name, key, 0, "Not a regular file");
-      }
+                   err = print_san_err(pgm->name, key, 0, strerror(check->err));
+      } else if (!S_ISREG(check->mode))
+        tot_err++, key = KEY_CMD,
+                   err = print_san_err(pgm->name, key, 0, "Not a regular file");
     }
-    if (pgm->workingdir) {
-      ret = stat(pgm->workingdir, &statbuf);
-      if (ret == -1) {
+    if (ids[i][SAN_FS_WORKINGDIR] != -1) {
+      check = san_pool_get(&pool, ids[i][SAN_FS_WORKINGDIR]);
+      if (check->err) {
         tot_err++, key = KEY_WORKINGDIR,
-                   err = print_san_err(pgm->name, key, 0, strerror(errno));
-      } else if (!ret) {
-        if (!S_ISDIR(statbuf.st_mode))
-          tot_err++, key = KEY_WORKINGDIR,
-                     err = print_san_err(pgm->name, key, 0, "Not a directory");
-      }
+                   err = print_san_err(pgm->name, key, 0, strerror(check->err));
+      } else if (!S_ISDIR(check->mode))
+        tot_err++, key = KEY_WORKINGDIR,
+                   err = print_san_err(pgm->name, key, 0, "Not a directory");
     }
     if (!pgm->numprocs)
       tot_err++, key = KEY_NUMPROCS,
                  err = print_san_err(pgm->name, key, MISSING_ERROR, NULL);
-    if (pgm->std_out) {
-      head->privy.log.out =
-          open(pgm->std_out, O_WRONLY | O_CREAT | O_APPEND, LOGFILE_PERM);
-      if (head->privy.log.out == -1) {
+    if ((len = env_dup_name(pgm, &var))) {
+      snprintf(msg, sizeof(msg), "%.*s set twice", (int)len,
+               pgm->env.array_val[var]);
+      tot_err++, key = KEY_ENV, err = print_san_err(pgm->name, key, 0, msg);
+    }
+    if (ids[i][SAN_FS_STDOUT] != -1) {
+      check = san_pool_get(&pool, ids[i][SAN_FS_STDOUT]);
+      head->privy.log.out = san_pool_fd(&pool, ids[i][SAN_FS_STDOUT]);
+      if (head->privy.log.out == -1)
         tot_err++, key = KEY_STDOUT,
-                   err = print_san_err(pgm->name, key, 0, strerror(errno));
-      }
+                   err = print_san_err(pgm->name, key, 0,
+                                       strerror(check->err ? check->err : errno));
     }
-    if (pgm->std_err) {
-      head->privy.log.err =
-          open(pgm->std_err, O_WRONLY | O_CREAT | O_APPEND, LOGFILE_PERM);
-      if (head->privy.log.err == -1) {
+    if (ids[i][SAN_FS_STDERR] != -1) {
+      check = san_pool_get(&pool, ids[i][SAN_FS_STDERR]);
+      head->privy.log.err = san_pool_fd(&pool, ids[i][SAN_FS_STDERR]);
+      if (head->privy.log.err == -1)
         tot_err++, key = KEY_STDERR,
-                   err = print_san_err(pgm->name, key, 0, strerror(errno));
-      }
+                   err = print_san_err(pgm->name, key, 0,
+                                       strerror(check->err ? check->err : errno));
     }
   }
+  san_pool_destroy(&pool);
+  pgm_map_destroy(&map);
+  free(ids);
 
   if (tot_err) {
     fprintf(stderr, "%d error%c detected\n", tot_err, tot_err > 1 ? 's' : '\0');
+    ft_log(FT_LOG_ERR, "%d error%s detected", tot_err, tot_err > 1 ? "s" : "");
     destroy_taskmaster(node);
     return EXIT_FAILURE;
   }
   return EXIT_SUCCESS;
+
+error:
+  san_pool_destroy(&pool);
+  pgm_map_destroy(&map);
+  free(ids);
+  destroy_taskmaster(node);
+  return EXIT_FAILURE;
 }
 
 /* Set default values in blank variables of t_pgm */
@@ -630,25 +1251,25 @@ uint8_t fulfill_config(t_tm_node *node) {
   for (t_pgm *head = node->head; head; head = head->privy.next) {
     pgm = &head->usr;
     if (!pgm->env.array_val) {
-      pgm->env.array_val = calloc(1, sizeof(*pgm->env.array_val));
-      if (!pgm->env.array_val) goto_error("calloc");
-      pgm->env.array_size++;
+      pgm->env.array_val = shr_strv(NULL, 0);
+      if (!pgm->env.array_val) goto_error("shr_strv");
     }
     if (!pgm->std_out) {
-      pgm->std_out = strdup("/dev/null");
-      if (!pgm->std_out) goto_error("strdup");
+      pgm->std_out = shr_str("/dev/null");
+      if (!pgm->std_out) goto_error("shr_str");
       head->privy.log.out =
           open(pgm->std_out, O_WRONLY | O_CREAT | O_APPEND, LOGFILE_PERM);
       if ((head->privy.log.out) == -1) goto_error("open");
     }
     if (!pgm->std_err) {
-      pgm->std_err = strdup("/dev/null");
-      if (!pgm->std_err) goto_error("strdup");
+      pgm->std_err = shr_str("/dev/null");
+      if (!pgm->std_err) goto_error("shr_str");
       head->privy.log.err =
           open(pgm->std_err, O_WRONLY | O_CREAT | O_APPEND, LOGFILE_PERM);
       if ((head->privy.log.out) == -1) goto_error("open");
     }
     if (!pgm->stopsignal.nb) pgm->stopsignal = siglist[SIGTERM];
+    pgm_fingerprint(head);
   }
   return EXIT_SUCCESS;
 
@@ -656,3 +1277,25 @@ error:
   destroy_taskmaster(node);
   return EXIT_FAILURE;
 }
+
+/* Load, sanitize & fulfill the configuration of node. The program table comes
+ * from the compiled snapshot when it is up to date with the configuration
+ * file, otherwise from the yaml parser & a new snapshot is written. A
+ * configuration including other files isn't snapshotted as the key only covers
+ * the configuration file: included files have their own cache. */
+uint8_t load_config(t_tm_node *node) {
+  t_snapshot_key key;
+  bool has_key = !snapshot_key(node, &key), cached = false;
+  uint8_t ret;
+
+  conf_include_begin(node->config_file_name);
+  if (has_key) cached = !snapshot_load(node, TM_SNAPSHOTFILE, &key);
+  ret = !cached && load_config_file(node);
+  conf_include_end(!ret);
+  if (ret) return EXIT_FAILURE;
+  if (sanitize_config(node)) return EXIT_FAILURE;
+  if (fulfill_config(node)) return EXIT_FAILURE;
+  if (has_key && !cached && !conf_include_used())
+    snapshot_save(node, TM_SNAPSHOTFILE, &key);
+  return EXIT_SUCCESS;
+}
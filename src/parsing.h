@@ -2,6 +2,10 @@
 #define PARSING_H
 
 #include <inttypes.h>
+#include <stdbool.h>
+
+#include "taskmaster.h"
+#include "yaml.h"
 
 #define SIGNAL_NB (32)   /* number of posix signal */
 #define KEY_BUF_LEN (32) /* buffer size to store a key name */
@@ -23,6 +27,13 @@ typedef enum e_keys {
   KEY_STOPSIGNAL,
   KEY_STARTTIME,
   KEY_STOPTIME,
+  KEY_STDOUT_MAXBYTES,
+  KEY_STDOUT_BACKUPS,
+  KEY_STDERR_MAXBYTES,
+  KEY_STDERR_BACKUPS,
+  KEY_LOGCOMPRESS,
+  KEY_MAX_UNAVAILABLE,
+  KEY_MAX_SURGE,
   KEY_NB_MAX, /* number of keys in a config file */
 } t_keys;
 
@@ -30,12 +41,69 @@ typedef enum e_keys {
 
 #define SEC_TO_MS (1000)
 
+#define MERGE_KEY "<<"     /* yaml merge key, flattens mappings into a pgm */
+#define MERGE_DEPTH_MAX (8) /* nested merge keys */
+#define KEY_UNSET (0xff)    /* t_config_parsing::key_level of a key not set */
+
+/* set of fields programs refer to with the 'template' key */
+typedef struct s_pgm_tpl {
+  t_pgm_usr usr;
+  uint32_t keys; /* bit (1 << key) set for each key the template defines */
+  struct s_pgm_tpl *next;
+} t_pgm_tpl;
+
+/* events of an anchored node, replayed in place of its aliases */
+typedef struct s_yaml_anchor {
+  char *name;
+  yaml_event_t *events;
+  uint32_t nb;
+  uint32_t cap;
+  uint32_t depth; /* collections of the node still open */
+  bool recording; /* the node isn't complete yet */
+} t_yaml_anchor;
+
+/* env or exitcodes being loaded: their values are gathered here & interned
+ * at once when their node ends, instead of an array per value */
+typedef struct s_load_vec {
+  t_pgm_usr *target; /* fields the values are loaded into */
+  t_keys key;        /* KEY_ENV or KEY_EXITCODES */
+  uint32_t nb, cap;  /* values, room for */
+  uint32_t *off;     /* env: offset of each 'name=value' string in buf */
+  char **strv;       /* env: the strings, once sealed */
+  int16_t *codes;    /* exitcodes */
+  char *buf;         /* env: the strings one after the other */
+  size_t len, size;  /* of buf */
+  bool value;        /* env: the next scalar is the value of the last name */
+} t_load_vec;
+
+typedef enum e_parsing_section {
+  SECTION_NONE,
+  SECTION_PGM, /* 'programs' map */
+  SECTION_TPL, /* 'templates' map */
+} t_parsing_section;
+
 typedef struct s_config_parsing {
   uint8_t info; /* bit interrupt to detect '+STR - +DOC - +MAP' start sequence*/
   uint8_t scalar_type; /* is it a key or a value */
   t_keys key;          /* key number */
   uint8_t map_depth;   /* increments when a new field appears at a new level */
   uint8_t seq_depth;
+  bool include; /* scalars are include patterns */
+  bool nested;  /* parsing an included file, which can't include */
+  t_parsing_section section;
+  t_pgm_usr *usr;      /* fields of the pgm or template being loaded */
+  t_pgm_tpl *tpl;      /* template being loaded, NULL for a pgm */
+  t_pgm_usr *target;   /* fields the value of key is loaded into */
+  t_pgm_usr scratch;   /* target of merged values which are overridden */
+  uint8_t key_level[KEY_NB_MAX]; /* merge level each key of usr comes from */
+  uint8_t merge_level; /* merged mappings open, 0 in the block of usr */
+  uint8_t merge_seqs;  /* bit (1 << level) set if its merge is a sequence */
+  bool merge_pending;  /* a merge key waits for its mappings */
+  bool use_tpl;        /* the value is a template name */
+  t_load_vec vec;      /* env or exitcodes being loaded */
+  t_pgm_tpl *templates;
+  t_yaml_anchor *anchors;
+  uint32_t anchor_nb;
 } t_config_parsing;
 
 #define KEY_TYPE (0)
@@ -49,10 +117,11 @@ typedef enum e_parsing_info_mask {
   MASK_STREAM = (1 << 0),
   MASK_DOC = (1 << 1),
   MASK_PGM = (1 << 2),
+  MASK_TPL = (1 << 3),
 } t_parsing_info_mask;
 
 #define PARSING_READY \
-  (0x7) /* value of t_config_parsing::info when all bits are set (0000 0111)*/
+  (0x7) /* value of t_config_parsing::info once 'programs' is entered */
 
 #define YAML_MAX_EVENT (YAML_MAPPING_END_EVENT + 1)
 #define YAML_MAX_SCALAR_EVENT (5)
@@ -66,6 +135,7 @@ typedef enum e_parsing_info_mask {
 #define SAN_RETRIES_MAX (128)
 #define SAN_STARTTIME_MAX (120) /* in seconds */
 #define SAN_STOPTIME_MAX (60)   /* in seconds */
+#define SAN_BACKUPS_MAX (32)
 
 #define LOGFILE_PERM (0644)
 
@@ -0,0 +1,193 @@
+#include "shared.h"
+#include "taskmaster.h"
+
+/*
+ * Hashing of programs.
+ * Each program gets two fingerprints of its canonicalized configuration: one
+ * over the fields a soft reload can apply on the fly, one over the fields
+ * which need a restart. numprocs is in neither: reload compares it on its own
+ * & scales running programs by the difference. Fields are hashed with a tag &
+ * their length so that shifting a value from a field to its neighbour changes
+ * the fingerprint.
+ * env & exitcodes are sets: their elements are hashed independently then
+ * summed, so that their order in the config file doesn't matter. env names are
+ * unique (sanitize_config()), so the set is the environment the child gets.
+ * Strings & string arrays are shared blocks: the hash of their content is
+ * computed once when they are interned and reused here.
+ * Reload joins the old & new program lists on names with t_pgm_map, then only
+ * compares fingerprints: pgm_join() decides, its callback acts.
+ */
+
+#define FNV_OFFSET (14695981039346656037ULL)
+#define FNV_PRIME (1099511628211ULL)
+
+enum e_fp_tag {
+  FP_CMD = 1,
+  FP_STDOUT,
+  FP_STDERR,
+  FP_ENV,
+  FP_WORKINGDIR,
+  FP_UMASK,
+  FP_AUTOSTART,
+  FP_AUTORESTART,
+  FP_STARTTIME,
+  FP_STARTRETRIES,
+  FP_STOPSIGNAL,
+  FP_STOPTIME,
+  FP_OUT_ROTATE,
+  FP_ERR_ROTATE,
+  FP_EXITCODES,
+  FP_MAX_UNAVAILABLE,
+  FP_MAX_SURGE,
+};
+
+static uint64_t fnv_bytes(uint64_t h, const void *data, size_t len) {
+  const uint8_t *p = data;
+
+  for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * FNV_PRIME;
+  return h;
+}
+
+/* splitmix64 finalizer, spreads the bits of set elements before summing */
+static uint64_t mix(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+static uint64_t fp_field(uint64_t h, uint8_t tag, const void *data,
+                         size_t len) {
+  uint32_t len32 = len;
+
+  h = fnv_bytes(h, &tag, sizeof(tag));
+  h = fnv_bytes(h, &len32, sizeof(len32));
+  return fnv_bytes(h, data, len);
+}
+
+static uint64_t fp_num(uint64_t h, uint8_t tag, uint64_t val) {
+  return fp_field(h, tag, &val, sizeof(val));
+}
+
+/* a shared block by the hash of its content. A NULL block is hashed
+ * differently from an empty one */
+static uint64_t fp_shr(uint64_t h, uint8_t tag, const void *shr) {
+  if (!shr) return fp_field(h, tag, NULL, 0);
+  return fp_num(h, tag, shr_hash(shr));
+}
+
+static uint64_t fp_rotate(uint64_t h, uint8_t tag, const t_log_rotate *rot) {
+  h = fp_num(h, tag, rot->maxbytes);
+  h = fp_num(h, tag, rot->backups);
+  return fp_num(h, tag, rot->compress);
+}
+
+uint64_t tm_hash_bytes(const void *data, size_t len) {
+  return fnv_bytes(FNV_OFFSET, data, len);
+}
+
+uint64_t tm_hash_str(const char *str) {
+  return fnv_bytes(FNV_OFFSET, str, strlen(str));
+}
+
+/* compute soft & hard fingerprints of pgm from its sanitized configuration */
+void pgm_fingerprint(t_pgm *pgm) {
+  const t_pgm_usr *usr = &pgm->usr;
+  uint64_t hard = FNV_OFFSET, soft = FNV_OFFSET, set = 0;
+
+  hard = fp_shr(hard, FP_CMD, usr->cmd);
+  hard = fp_shr(hard, FP_STDOUT, usr->std_out);
+  hard = fp_shr(hard, FP_STDERR, usr->std_err);
+  for (uint32_t i = 0; i < usr->env.array_size; i++)
+    if (usr->env.array_val[i])
+      set += mix(shr_hash(usr->env.array_val[i]));
+  hard = fp_num(hard, FP_ENV, set);
+  hard = fp_shr(hard, FP_WORKINGDIR, usr->workingdir);
+  hard = fp_num(hard, FP_UMASK, usr->umask);
+
+  soft = fp_num(soft, FP_AUTOSTART, usr->autostart);
+  soft = fp_num(soft, FP_AUTORESTART, usr->autorestart);
+  soft = fp_num(soft, FP_STARTTIME, usr->starttime);
+  soft = fp_num(soft, FP_STARTRETRIES, usr->startretries);
+  soft = fp_num(soft, FP_STOPSIGNAL, usr->stopsignal.nb);
+  soft = fp_num(soft, FP_STOPTIME, usr->stoptime);
+  soft = fp_rotate(soft, FP_OUT_ROTATE, &usr->out_rotate);
+  soft = fp_rotate(soft, FP_ERR_ROTATE, &usr->err_rotate);
+  set = 0;
+  for (uint32_t i = 0; i < usr->exitcodes.array_size; i++)
+    set += mix((uint16_t)usr->exitcodes.array_val[i] + 1);
+  soft = fp_num(soft, FP_EXITCODES, set);
+  soft = fp_num(soft, FP_MAX_UNAVAILABLE, usr->max_unavailable);
+  soft = fp_num(soft, FP_MAX_SURGE, usr->max_surge);
+
+  pgm->privy.hard_fp = hard;
+  pgm->privy.soft_fp = soft;
+}
+
+/* =============================== name map ================================= */
+
+/* open addressing table of at least twice the number of programs. Programs
+ * being deleted are left out. When names are duplicated, the first program of
+ * the list wins. Names are interned: they are compared by address */
+int32_t pgm_map_init(t_pgm_map *map, t_pgm *head) {
+  uint32_t size = 16, slot, pgm_nb = 0;
+
+  for (t_pgm *pgm = head; pgm; pgm = pgm->privy.next) pgm_nb++;
+  while (size < pgm_nb * 2) size <<= 1;
+  map->mask = size - 1;
+  if (!(map->slots = calloc(size, sizeof(*map->slots)))) return EXIT_FAILURE;
+  for (; head; head = head->privy.next) {
+    if (head->privy.ev == PGM_EV_DEL) continue;
+    slot = shr_hash(head->usr.name) & map->mask;
+    while (map->slots[slot] && map->slots[slot]->usr.name != head->usr.name)
+      slot = (slot + 1) & map->mask;
+    if (!map->slots[slot]) map->slots[slot] = head;
+  }
+  return EXIT_SUCCESS;
+}
+
+t_pgm *pgm_map_get(const t_pgm_map *map, const char *name) {
+  uint32_t slot = shr_hash(name) & map->mask;
+
+  while (map->slots[slot]) {
+    if (map->slots[slot]->usr.name == name) return map->slots[slot];
+    slot = (slot + 1) & map->mask;
+  }
+  return NULL;
+}
+
+void pgm_map_destroy(t_pgm_map *map) { DESTROY_PTR(map->slots); }
+
+/* how pgm_new differs from the running pgm of the same name, PGM_DIFF_ADD if
+ * there is none. A numprocs change alone is applied on the fly by scaling */
+static t_pgm_diff pgm_diff(const t_pgm *pgm, const t_pgm *pgm_new) {
+  if (!pgm) return PGM_DIFF_ADD;
+  if (pgm->privy.hard_fp != pgm_new->privy.hard_fp) return PGM_DIFF_HARD;
+  if (pgm->privy.soft_fp != pgm_new->privy.soft_fp ||
+      pgm->usr.numprocs != pgm_new->usr.numprocs)
+    return PGM_DIFF_SOFT;
+  return PGM_DIFF_NONE;
+}
+
+/* the join of a reload: old_map indexes the running list & new_map the new
+ * one, head. cb gets each running pgm not in head, deleted ones aside, then
+ * each pgm of head with the running one of the same name, or NULL. The pgm
+ * cb moves are unlinked from head */
+void pgm_join(t_pgm *running, const t_pgm_map *old_map, t_pgm **head,
+              const t_pgm_map *new_map, t_pgm_join_cb cb, void *arg) {
+  t_pgm *pgm_new = *head, *prev = NULL, *next, *pgm;
+
+  for (; running; running = running->privy.next)
+    if (running->privy.ev != PGM_EV_DEL &&
+        !pgm_map_get(new_map, running->usr.name))
+      cb(running, NULL, PGM_DIFF_DEL, arg);
+  for (; pgm_new; pgm_new = next) {
+    next = pgm_new->privy.next;
+    pgm = pgm_map_get(old_map, pgm_new->usr.name);
+    if (!cb(pgm, pgm_new, pgm_diff(pgm, pgm_new), arg))
+      prev = pgm_new;
+    else if (prev)
+      prev->privy.next = next;
+    else
+      *head = next;
+  }
+}
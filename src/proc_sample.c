@@ -0,0 +1,165 @@
+#include "proc_sample.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+
+#include "metrics.h"
+
+#define PROC_SAMPLE_BUF_SZ (4096) /* /proc/<pid>/status is ~1.5 kB */
+
+static struct {
+  time_t interval; /* 0: sampling disabled */
+  uint32_t budget;
+  time_t tick; /* second the budget left is for */
+  uint32_t left;
+} ps = {.interval = PROC_SAMPLE_INTERVAL, .budget = PROC_SAMPLE_BUDGET};
+
+int32_t proc_sample_config(const char *arg) {
+  char *end;
+  long interval, budget = PROC_SAMPLE_BUDGET;
+
+  interval = strtol(arg, &end, 10);
+  if (end == arg || interval < 0) return EXIT_FAILURE;
+  if (*end == ',') {
+    arg = end + 1;
+    budget = strtol(arg, &end, 10);
+    if (end == arg || budget <= 0 || budget > UINT32_MAX) return EXIT_FAILURE;
+  }
+  if (*end) return EXIT_FAILURE;
+  ps.interval = interval, ps.budget = budget;
+  return EXIT_SUCCESS;
+}
+
+bool proc_sample_enabled(void) { return ps.interval > 0; }
+
+void proc_sample_open(t_process *proc) {
+  proc->res = (t_proc_res){.sampled = ps.interval > 0};
+}
+
+void proc_sample_close(t_process *proc) { proc->res.sampled = false; }
+
+/* read the file name of the /proc/<pid> directory dirfd, NUL terminated */
+static ssize_t read_at(int32_t dirfd, const char *name, char *buf) {
+  int32_t fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+  ssize_t len;
+
+  if (fd == -1) return -1;
+  len = read(fd, buf, PROC_SAMPLE_BUF_SZ - 1);
+  close(fd);
+  if (len >= 0) buf[len] = 0;
+  return len;
+}
+
+/* value of the "key:\t<value>" line of /proc/<pid>/status, 0 if missing */
+static uint64_t status_field(const char *status, const char *key) {
+  const char *line = strstr(status, key);
+
+  return line ? strtoull(line + strlen(key), NULL, 10) : 0;
+}
+
+static uint32_t count_fds(int32_t dirfd) {
+  int32_t fd = openat(dirfd, "fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  struct dirent *ent;
+  uint32_t cnt = 0;
+  DIR *dir;
+
+  if (fd == -1) return 0;
+  if (!(dir = fdopendir(fd))) {
+    close(fd);
+    return 0;
+  }
+  while ((ent = readdir(dir))) cnt += ent->d_name[0] != '.';
+  closedir(dir);
+  return cnt;
+}
+
+/* fields 14 & 15 of /proc/<pid>/stat, after the command name which may hold
+ * spaces & parentheses */
+static int32_t sample_at(t_proc_res *res, int32_t dirfd, int64_t now) {
+  static long clk_tck;
+  char buf[PROC_SAMPLE_BUF_SZ], *fields;
+  uint64_t utime, stime, ticks;
+
+  if (!clk_tck) clk_tck = sysconf(_SC_CLK_TCK);
+  if (read_at(dirfd, "stat", buf) <= 0 || !(fields = strrchr(buf, ')')))
+    return EXIT_FAILURE;
+  if (sscanf(fields + 2,
+             "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %" SCNu64
+             " %" SCNu64,
+             &utime, &stime) != 2)
+    return EXIT_FAILURE;
+  ticks = utime + stime;
+  res->cpu = res->n && now > res->at
+                 ? (ticks - res->cpu_ticks) * 100000.0f / clk_tck /
+                       (now - res->at)
+                 : 0;
+  res->cpu_ticks = ticks;
+  if (read_at(dirfd, "status", buf) <= 0) return EXIT_FAILURE;
+  res->rss_kb = status_field(buf, "VmRSS:");
+  res->threads = status_field(buf, "Threads:");
+  res->vcsw = status_field(buf, "\nvoluntary_ctxt_switches:");
+  res->ivcsw = status_field(buf, "nonvoluntary_ctxt_switches:");
+  res->fds = count_fds(dirfd);
+  if (res->n++) {
+    res->cpu_avg += PROC_SAMPLE_ALPHA * (res->cpu - res->cpu_avg);
+    res->rss_avg += PROC_SAMPLE_ALPHA * (res->rss_kb - res->rss_avg);
+  } else {
+    res->cpu_avg = res->cpu, res->rss_avg = res->rss_kb;
+  }
+  res->at = now;
+  return EXIT_SUCCESS;
+}
+
+/* /proc/<proc->pid> is only open for the sample */
+static int32_t sample(t_process *proc, int64_t now) {
+  char path[32];
+  int32_t dirfd, ret;
+
+  snprintf(path, sizeof(path), "/proc/%d", proc->pid);
+  if ((dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    return EXIT_FAILURE;
+  ret = sample_at(&proc->res, dirfd, now);
+  close(dirfd);
+  return ret;
+}
+
+/* half a second of slack, timers firing on whole seconds */
+static bool is_due(const t_proc_res *res, int64_t now) {
+  return res->sampled && now + 500 >= res->due;
+}
+
+void proc_sample_pgm(t_pgm *pgm) {
+  int64_t now = metrics_now_ms();
+  time_t tick = time(NULL);
+
+  if (tick != ps.tick) ps.tick = tick, ps.left = ps.budget;
+  for (t_process *proc = pgm->privy.proc_head; proc && ps.left;
+       proc = proc->next) {
+    if (!is_due(&proc->res, now)) continue;
+    ps.left--;
+    /* a proc which exited & isn't reaped yet isn't sampled, it's tried again
+     * next interval all the same */
+    sample(proc, now);
+    proc->res.due = now + ps.interval * 1000L;
+  }
+}
+
+time_t proc_sample_delay(const t_pgm *pgm) {
+  int64_t now = metrics_now_ms();
+
+  for (t_process *proc = pgm->privy.proc_head; proc; proc = proc->next)
+    if (is_due(&proc->res, now)) return 1;
+  return ps.interval;
+}
+
+void proc_sample_print(t_strbuf *buf, const t_process *proc) {
+  const t_proc_res *res = &proc->res;
+
+  if (!res->n) return;
+  strbuf_printf(buf,
+                " - cpu %.1f%% (avg %.1f%%) rss %.1fM (avg %.1fM) threads %u "
+                "fds %u ctxsw %" PRIu64 "/%" PRIu64,
+                res->cpu, res->cpu_avg, res->rss_kb / 1024.0,
+                res->rss_avg / 1024.0, res->threads, res->fds, res->vcsw,
+                res->ivcsw);
+}
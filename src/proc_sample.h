@@ -0,0 +1,46 @@
+#ifndef PROC_SAMPLE_H
+#define PROC_SAMPLE_H
+
+#include <time.h>
+
+#include "strbuf.h"
+#include "taskmaster.h"
+
+/*
+ * Resources of the supervised processes, sampled from /proc.
+ * Each sample opens /proc/<pid>, reads its stat & status & counts its fd
+ * entries relative to it, then closes it: no fd is held between samples. The
+ * pid can't be reused meanwhile, a proc being removed from its program in the
+ * SIGCHLD handler which reaps it. Sampling is driven by a timer per program,
+ * every interval seconds: the timers firing within the same second share a
+ * budget of processes, those left over are sampled on the next seconds. CPU
+ * usage & RSS are smoothed by an exponential moving average over about the
+ * last 1 / PROC_SAMPLE_ALPHA samples.
+ */
+
+#define PROC_SAMPLE_INTERVAL (5) /* default seconds between two samples */
+#define PROC_SAMPLE_BUDGET (32)  /* default procs sampled per second */
+#define PROC_SAMPLE_ALPHA (0.3f) /* weight of a new sample in the averages */
+
+/* set the sampling from "interval[,budget]", interval 0 disables it. Returns
+ * EXIT_FAILURE if arg isn't valid */
+int32_t proc_sample_config(const char *arg);
+
+/* sampling is enabled */
+bool proc_sample_enabled(void);
+
+/* start sampling proc once forked, or stop when it exited */
+void proc_sample_open(t_process *proc);
+void proc_sample_close(t_process *proc);
+
+/* sample the procs of pgm due for it, within the budget of the current
+ * second */
+void proc_sample_pgm(t_pgm *pgm);
+
+/* seconds before the procs of pgm have to be sampled again */
+time_t proc_sample_delay(const t_pgm *pgm);
+
+/* append the last sample of proc to a status line */
+void proc_sample_print(t_strbuf *buf, const t_process *proc);
+
+#endif
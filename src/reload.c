@@ -0,0 +1,142 @@
+#include "reload.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include "ft_log.h"
+#include "trace.h"
+
+/* a record logged by the reload thread, replayed by the main thread */
+typedef struct s_reload_rec {
+  struct s_reload_rec *next;
+  int32_t level;
+  size_t len;
+  char msg[];
+} t_reload_rec;
+
+static struct {
+  const t_tm_node *node; /* running configuration, for the reloads asked */
+  pthread_t main;        /* thread the generation is sent to */
+  pthread_t thread;
+  t_reload_gen *gen;     /* generation being built or committed */
+  t_reload_rec *recs, **recs_tail;
+  bool running;          /* thread isn't joined yet */
+  bool done;             /* gen is built, set by the thread */
+  bool pending;          /* a reload was asked while gen was being built */
+  bool registered;       /* reload_exit() is registered */
+} rl = {.recs_tail = &rl.recs};
+
+/* ft_log() capture of the reload thread, records are queued in order */
+static void capture_rec(int level, const char *msg, size_t len, void *arg) {
+  UNUSED_PARAM(arg);
+  t_reload_rec *rec = malloc(sizeof(*rec) + len);
+
+  if (!rec) return;
+  *rec = (t_reload_rec){.level = level, .len = len};
+  memcpy(rec->msg, msg, len);
+  *rl.recs_tail = rec;
+  rl.recs_tail = &rec->next;
+}
+
+static void flush_recs(bool replay) {
+  t_reload_rec *next;
+
+  for (t_reload_rec *rec = rl.recs; rec; rec = next) {
+    next = rec->next;
+    if (replay) ft_log(rec->level, "%.*s", (int)rec->len, rec->msg);
+    free(rec);
+  }
+  rl.recs = NULL, rl.recs_tail = &rl.recs;
+}
+
+static void destroy_gen(t_reload_gen *gen) {
+  pgm_map_destroy(&gen->map);
+  destroy_taskmaster(&gen->node);
+  free(gen);
+}
+
+static void *reload_routine(void *arg) {
+  t_reload_gen *gen = arg;
+  t_tm_node *node = &gen->node;
+  struct timespec start, end;
+
+  ft_log_capture(capture_rec, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (!(node->config_file_stream = fopen(node->config_file_name, "r"))) {
+    fprintf(stderr, "%s: %s: %s\n", node->tm_name, node->config_file_name,
+            strerror(errno));
+    gen->ret = EXIT_FAILURE;
+  } else if (load_config(node) || pgm_map_init(&gen->map, node->head))
+    gen->ret = EXIT_FAILURE;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  TM_TRACE(TRACE_RELOAD, "generation %s in %ld us",
+           gen->ret ? "rejected" : "built",
+           (end.tv_sec - start.tv_sec) * 1000000L +
+               (end.tv_nsec - start.tv_nsec) / 1000);
+  ft_log_capture(NULL, NULL);
+  __atomic_store_n(&rl.done, true, __ATOMIC_RELEASE);
+  pthread_kill(rl.main, RELOAD_SIGNAL);
+  return NULL;
+}
+
+/* atexit() callback: wait for a load in progress, its generation is dropped */
+static void reload_exit(void) {
+  if (rl.running) pthread_join(rl.thread, NULL);
+  rl.running = false;
+  flush_recs(false);
+  if (rl.gen) destroy_gen(rl.gen);
+  rl.gen = NULL;
+}
+
+/* the thread inherits a full signal mask so that signals are always handled
+ * by the main thread */
+int32_t reload_start(const t_tm_node *node) {
+  t_reload_gen *gen;
+  sigset_t all, old;
+
+  rl.node = node;
+  if (rl.gen) {
+    TM_TRACE(TRACE_RELOAD, "reload running, another one queued");
+    rl.pending = true;
+    return EXIT_SUCCESS;
+  }
+  if (!(gen = calloc(1, sizeof(*gen)))) return EXIT_FAILURE;
+  gen->node.tm_name = node->tm_name;
+  if (!(gen->node.config_file_name = strdup(node->config_file_name))) {
+    free(gen);
+    return EXIT_FAILURE;
+  }
+  if (!rl.registered) rl.registered = !atexit(reload_exit);
+  rl.main = pthread_self();
+  rl.done = false;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  rl.running = !pthread_create(&rl.thread, NULL, reload_routine, gen);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (!rl.running) {
+    destroy_gen(gen);
+    return EXIT_FAILURE;
+  }
+  rl.gen = gen;
+  return EXIT_SUCCESS;
+}
+
+t_reload_gen *reload_collect(void) {
+  if (!rl.running || !__atomic_load_n(&rl.done, __ATOMIC_ACQUIRE)) return NULL;
+  pthread_join(rl.thread, NULL);
+  rl.running = false;
+  flush_recs(true);
+  return rl.gen;
+}
+
+void reload_done(t_reload_gen *gen) {
+  destroy_gen(gen);
+  rl.gen = NULL;
+  if (!rl.pending) return;
+  rl.pending = false;
+  if (reload_start(rl.node))
+    ft_log(FT_LOG_ERR, "failed to reload %s: %s", rl.node->config_file_name,
+           strerror(errno));
+}
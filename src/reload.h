@@ -0,0 +1,40 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include <signal.h>
+
+#include "taskmaster.h"
+
+/*
+ * Background reloads.
+ * Parsing, sanitizing & fingerprinting a configuration runs on a reload
+ * thread, which builds the new generation of programs while the main thread
+ * keeps reaping children & firing timers. Once it's done the thread sends
+ * RELOAD_SIGNAL to the main thread, whose handler collects the generation &
+ * commits it: only the join with the running programs is left to it. A reload
+ * asked while one is running is run again once it's committed, so that the
+ * last change of the configuration is always loaded. Records the thread logs
+ * are replayed by the main thread when collecting.
+ */
+
+#define RELOAD_SIGNAL SIGUSR1
+
+typedef struct s_reload_gen {
+  t_tm_node node; /* new programs, sanitized & fingerprinted */
+  t_pgm_map map;  /* node programs by name */
+  uint8_t ret;    /* EXIT_FAILURE if the configuration was rejected */
+} t_reload_gen;
+
+/* start loading the configuration file of node on the reload thread, or ask
+ * for another load if one is running. Returns EXIT_FAILURE if the thread
+ * can't be created */
+int32_t reload_start(const t_tm_node *node);
+
+/* the generation built by the reload thread, NULL if it's still running. The
+ * caller commits it then gives it back to reload_done() */
+t_reload_gen *reload_collect(void);
+
+/* free gen & start the reload asked in the meantime, if any */
+void reload_done(t_reload_gen *gen);
+
+#endif
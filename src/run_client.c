@@ -1,33 +1,24 @@
 #include "run_client.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <time.h>
 
+#include "conf_include.h"
 #include "ft_log.h"
 #include "ft_readline.h"
-
-/* Debugging macro. */
-#if 1
-FILE *rl_debug_fp = NULL;
-void close_debugfile(void) {
-    if (rl_debug_fp) fclose(rl_debug_fp);
-}
-#define client_debug(...)                                       \
-    do {                                                        \
-        if (rl_debug_fp == NULL) {                              \
-            rl_debug_fp = fopen("/tmp/client_debug.txt", "a");  \
-            atexit(close_debugfile); /* avoid valgrind errors*/ \
-        }                                                       \
-        fprintf(rl_debug_fp, ", " __VA_ARGS__);                 \
-        fflush(rl_debug_fp);                                    \
-    } while (0)
-#else
-#define client_debug(...)
-#endif
+#include "journal.h"
+#include "metrics.h"
+#include "parsing.h"
+#include "proc_sample.h"
+#include "reload.h"
+#include "shared.h"
+#include "status.h"
+#include "trace.h"
 
 /* ================================= getters ================================ */
 
@@ -44,29 +35,34 @@ static t_tm_node *get_node(t_tm_node *node) {
     return my_node;
 }
 
-static t_tm_node *get_newnode(t_tm_node *newnode, bool init) {
-    static t_tm_node *my_newnode = NULL;
-
-    if (init) my_newnode = newnode;
-    return my_newnode;
-}
-
 DECL_CMD_HANDLER(cmd_status);
 DECL_CMD_HANDLER(cmd_start);
 DECL_CMD_HANDLER(cmd_stop);
 DECL_CMD_HANDLER(cmd_restart);
+DECL_CMD_HANDLER(cmd_scale);
 DECL_CMD_HANDLER(cmd_reload);
+DECL_CMD_HANDLER(cmd_reopen);
+DECL_CMD_HANDLER(cmd_trace);
+DECL_CMD_HANDLER(cmd_events);
+DECL_CMD_HANDLER(cmd_stats);
+DECL_CMD_HANDLER(cmd_debug);
 DECL_CMD_HANDLER(cmd_exit);
 DECL_CMD_HANDLER(cmd_help);
 
 /* returns address of taskmaster commands */
 static t_tm_cmd *get_commands() {
     static t_tm_cmd command[TM_CMD_NB] = {
-        {cmd_status, "status", FREE_NB_ARGS, 0},
+        {cmd_status, "status", RAW_ARGS, 0},
         {cmd_start, "start", MANY_ARGS, 0},
         {cmd_stop, "stop", MANY_ARGS, 0},
         {cmd_restart, "restart", MANY_ARGS, 0},
+        {cmd_scale, "scale", RAW_ARGS, 0},
         {cmd_reload, "reload", NO_ARGS, 0},
+        {cmd_reopen, "reopen", FREE_NB_ARGS, 0},
+        {cmd_trace, "trace", RAW_ARGS, 0},
+        {cmd_events, "events", RAW_ARGS, 0},
+        {cmd_stats, "stats", FREE_NB_ARGS, 0},
+        {cmd_debug, "debug", RAW_ARGS, 0},
         {cmd_exit, "exit", NO_ARGS, 0},
         {cmd_help, "help", NO_ARGS, 0}};
     return command;
@@ -76,38 +72,36 @@ static t_tm_cmd *get_commands() {
 
 static void log_exit() { ft_log(FT_LOG_INFO, "exited"); }
 
-static void *destroy_str_array(char **array, uint32_t sz) {
-    while (--sz >= 0) {
-        free(array[sz]);
-        array[sz] = NULL;
-    }
-    return NULL;
+static void destroy_completion(char **completions, uint32_t nb) {
+    while (nb) shr_unref(completions[--nb]);
+    free(completions);
 }
 
-/* Add taskmaster commands and program names to completion */
+/* Add taskmaster commands and program names to completion. Strings are
+ * shared: program names are referenced rather than copied. *compl_nb is the
+ * room of the list & gets its length */
 static char **get_completion(const t_tm_node *node, const t_tm_cmd *commands,
-                             uint32_t compl_nb) {
+                             uint32_t *compl_nb) {
     uint32_t i = 0;
     t_pgm *pgm = node->head;
-    char **completions = malloc(compl_nb * sizeof(*completions));
+    char **completions = malloc(*compl_nb * sizeof(*completions));
 
     if (!completions) return NULL;
 
     while (i < TM_CMD_NB) {
-        completions[i] = strdup(commands[i].name);
-        if (!completions[i]) return destroy_str_array(completions, i);
+        completions[i] = shr_str(commands[i].name);
+        if (!completions[i]) {
+            destroy_completion(completions, i);
+            return NULL;
+        }
         i++;
     }
-    while (i < compl_nb && pgm) {
-        if (pgm->privy.ev == PGM_EV_DEL) {
-            pgm = pgm->privy.next;
-            continue;
-        }
-        completions[i] = strdup(pgm->usr.name);
-        if (!completions[i]) return destroy_str_array(completions, i);
+    while (i < *compl_nb && pgm) {
+        if (pgm->privy.ev != PGM_EV_DEL)
+            completions[i++] = shr_ref(pgm->usr.name);
         pgm = pgm->privy.next;
-        i++;
     }
+    *compl_nb = i;
     return completions;
 }
 
@@ -116,11 +110,14 @@ static void add_cli_completion() {
     char **completion = NULL;
     t_tm_node *node = get_node(NULL);
     t_tm_cmd *command = get_commands();
-    int32_t compl_nb = TM_CMD_NB + node->pgm_nb;
+    uint32_t compl_nb = TM_CMD_NB + node->pgm_nb;
 
-    completion = get_completion(node, command, compl_nb);
+    completion = get_completion(node, command, &compl_nb);
     if (!completion) goto error;
-    if (ft_readline_add_completion(completion, compl_nb)) goto error;
+    if (ft_readline_add_completion(completion, compl_nb, shr_unref)) {
+        destroy_completion(completion, compl_nb);
+        goto error;
+    }
     return;
 error:
     ft_log(FT_LOG_ERR, "failed to add completion");
@@ -150,6 +147,10 @@ static int32_t sanitize_arg(const t_tm_node *node, t_tm_cmd *command,
     bool found;
 
     while (args[i] == ' ') i++;
+    if (command->flag == RAW_ARGS) { /* the handler parses args itself */
+        if (args[i]) command->args = (char *)(args + i);
+        return EXIT_SUCCESS;
+    }
     while (args[i]) {
         found = false;
         if (command->flag == NO_ARGS) return CMD_TOO_MANY_ARGS;
@@ -298,11 +299,14 @@ static int32_t process_proc(t_pgm *pgm, t_proc_handle handle, const void *arg) {
 
 /* ============================= timer primitives =========================== */
 
+/* SIGHUP is blocked too: its handler unblocks SIGALRM to reload, so it must
+ * not interrupt a timer operation */
 static void block_sigalrm(sigset_t *old_sigset) {
     sigset_t block_alarm;
 
     sigemptyset(&block_alarm);
     sigaddset(&block_alarm, SIGALRM);
+    sigaddset(&block_alarm, SIGHUP);
     sigprocmask(SIG_BLOCK, &block_alarm, old_sigset);
 }
 
@@ -311,6 +315,7 @@ static void unblock_sigalrm(sigset_t *old_sigset) {
 
     sigemptyset(&block_alarm);
     sigaddset(&block_alarm, SIGALRM);
+    sigaddset(&block_alarm, SIGHUP);
     sigprocmask(SIG_UNBLOCK, &block_alarm, NULL);
     sigprocmask(SIG_BLOCK, old_sigset, NULL);
 }
@@ -325,6 +330,8 @@ static void safe_timer_fn_call(t_pgm *pgm, int32_t type,
 }
 
 static void set_timer(t_timer *timer);
+static void add_timer(t_pgm *pgm, int32_t type);
+static void roll_step(t_pgm *pgm);
 
 static void delete_timer(t_timer *timer) {
     t_tm_node *node = get_node(NULL);
@@ -336,6 +343,9 @@ static void delete_timer(t_timer *timer) {
     }
 
     if (!tmr) return;
+    TM_TRACE(TRACE_TIMER, "delete timer type %d of %s", timer->type,
+             timer->pgm->usr.name);
+    tm_metrics.timers--;
     if (last)
         last->next = tmr->next;
     else {
@@ -345,14 +355,33 @@ static void delete_timer(t_timer *timer) {
     free(timer);
 }
 
+/* every state change of a proc goes through here, for its metrics */
+static void move_proc(t_pgm *pgm, t_process *proc, t_proc_state state) {
+    metrics_proc_leave(pgm, proc);
+    proc->state = state;
+    metrics_proc_enter(pgm, proc);
+}
+
 /* take arg as t_proc_state type and apply it to *current->state */
 static int set_proc_state(t_pgm *pgm, const void *arg, t_process *last,
                           t_process **current) {
-    UNUSED_PARAM(pgm);
     UNUSED_PARAM(last);
     t_process *proc = *current;
     t_proc_state *state = (t_proc_state *)arg;
-    proc->state = *state;
+    move_proc(pgm, proc, *state);
+    return 0;
+}
+
+/* starting procs passed starttime, those being stopped meanwhile stay so */
+static int set_proc_started(t_pgm *pgm, const void *arg, t_process *last,
+                            t_process **current) {
+    UNUSED_PARAM(arg);
+    UNUSED_PARAM(last);
+    if ((*current)->state == PROC_ST_STARTING) {
+        metrics_lat(pgm, LAT_READY,
+                    (metrics_now_ms() - (*current)->since) * 1000);
+        move_proc(pgm, *current, PROC_ST_RUNNING);
+    }
     return 0;
 }
 
@@ -360,11 +389,17 @@ static int set_proc_state(t_pgm *pgm, const void *arg, t_process *last,
  * logs. */
 static void handle_timer_start(t_timer *timer) {
     t_pgm *pgm = timer->pgm;
-    t_proc_state state = PROC_ST_RUNNING;
     time_t elapsed = (pgm->usr.starttime / 1000) - (timer->time - time(NULL));
 
+    if (pgm->privy.ev == PGM_EV_ROLL) { /* a batch of a rolling reload */
+        process_proc(pgm, set_proc_started, NULL);
+        roll_step(pgm);
+        return;
+    }
     if (pgm->usr.numprocs == pgm->privy.proc_cnt &&
-        (elapsed >= (pgm->usr.starttime / 1000)))
+        (elapsed >= (pgm->usr.starttime / 1000))) {
+        journal_record(JRNL_RUNNING, pgm->usr.name, pgm->privy.pgid,
+                       pgm->privy.proc_cnt);
         ft_log(FT_LOG_INFO,
                "(%d) %s successfully started. <%d/%d> seconds elapsed. "
                "<%d/%d> "
@@ -372,7 +407,10 @@ static void handle_timer_start(t_timer *timer) {
                pgm->privy.pgid, pgm->usr.name, elapsed,
                (pgm->usr.starttime / 1000), pgm->privy.proc_cnt,
                pgm->usr.numprocs);
-    else
+    } else {
+        pgm->privy.metrics.start_failures++;
+        journal_record(JRNL_START_FAIL, pgm->usr.name, pgm->privy.pgid,
+                       pgm->privy.proc_cnt);
         ft_log(FT_LOG_INFO,
                "(%d) %s failed to start successfully. <%d/%d> seconds "
                "elapsed. <%d/%d> "
@@ -380,7 +418,8 @@ static void handle_timer_start(t_timer *timer) {
                pgm->privy.pgid, pgm->usr.name, elapsed,
                (pgm->usr.starttime / 1000), pgm->privy.proc_cnt,
                pgm->usr.numprocs);
-    process_proc(timer->pgm, set_proc_state, &state);
+    }
+    process_proc(timer->pgm, set_proc_started, NULL);
 }
 
 /* function triggered by the SIGALRM handler when timer is TIMER_EV_STOP.
@@ -403,18 +442,68 @@ static void handle_timer_stop(t_timer *timer) {
                pgm->privy.pgid, pgm->usr.name, elapsed,
                (pgm->usr.stoptime / 1000), pgm->privy.proc_cnt,
                pgm->usr.numprocs);
+        journal_record(JRNL_SIGNAL, pgm->usr.name, pgm->privy.pgid, SIGKILL);
         kill(-(pgm->privy.pgid), SIGKILL);
     }
 }
 
+/* function triggered by the SIGALRM handler when timer is TIMER_EV_LOGROTATE.
+ * rotates pgm logs which grew above their limit & rearm while pgm runs */
+static void handle_timer_logrotate(t_timer *timer) {
+    t_pgm *pgm = timer->pgm;
+
+    log_rotate_check(pgm->privy.log.out, pgm->usr.std_out,
+                     &pgm->usr.out_rotate);
+    log_rotate_check(pgm->privy.log.err, pgm->usr.std_err,
+                     &pgm->usr.err_rotate);
+    if (pgm->privy.proc_cnt) add_timer(pgm, TIMER_EV_LOGROTATE);
+}
+
+/* function triggered by the SIGALRM handler when timer is TIMER_EV_KILL.
+ * kills the procs stopped one by one which outlived stoptime */
+static void handle_timer_kill(t_timer *timer) {
+    t_pgm *pgm = timer->pgm;
+
+    for (t_process *proc = pgm->privy.proc_head; proc; proc = proc->next) {
+        if (proc->state != PROC_ST_TERMINATING) continue;
+        ft_log(FT_LOG_INFO,
+               "(%d) %s <%d> didn't terminated correctly after <%d> seconds",
+               pgm->privy.pgid, pgm->usr.name, proc->pid,
+               pgm->usr.stoptime / 1000);
+        journal_record(JRNL_SIGNAL, pgm->usr.name, proc->pid, SIGKILL);
+        kill(proc->pid, SIGKILL);
+    }
+}
+
+/* function triggered by the SIGALRM handler when timer is TIMER_EV_SAMPLE.
+ * samples the resources of the procs due for it & rearm while pgm runs */
+static void handle_timer_sample(t_timer *timer) {
+    t_pgm *pgm = timer->pgm;
+
+    proc_sample_pgm(pgm);
+    if (pgm->privy.proc_cnt) add_timer(pgm, TIMER_EV_SAMPLE);
+}
+
+/* timer callbacks, indexed by timer type - 1 */
+static void (*const timer_cb[MAX_TIMER_EV_NB - 1])(t_timer *) = {
+    handle_timer_start, handle_timer_stop, handle_timer_logrotate,
+    handle_timer_kill, handle_timer_sample};
+
+/* journal the timer & execute its callback */
+static void fire_timer(t_timer *timer) {
+    journal_record(JRNL_TIMER, timer->pgm->usr.name, timer->pgm->privy.pgid,
+                   timer->type);
+    timer_cb[timer->type - 1](timer);
+}
+
 static void set_timer(t_timer *timer) {
     struct itimerval new = {0};
-    void (*cb[2])(t_timer *) = {handle_timer_start, handle_timer_stop};
 
     if (!timer) {
         /* if timer is NULL, disarm it */
         if (setitimer(ITIMER_REAL, &new, NULL) == -1)
             ft_log(FT_LOG_ERR, "setitimer() failed: %s", strerror(errno));
+        metrics_timer_armed(-1);
         return;
     }
 
@@ -422,12 +511,14 @@ static void set_timer(t_timer *timer) {
     if (new.it_value.tv_sec <= 0) {
         /* if we already reached or exceeded the time, no need to set a timer
          * and rather trigger immediately the needed function */
-        cb[timer->type - 1](timer);
+        metrics_timer_drift(timer->due);
+        fire_timer(timer);
         delete_timer(timer);
         return;
     }
     if (setitimer(ITIMER_REAL, &new, NULL) == -1)
         ft_log(FT_LOG_ERR, "setitimer() failed: %s", strerror(errno));
+    metrics_timer_armed(new.it_value.tv_sec);
 }
 
 /* return the first timer related to pgm encountered, or NULL */
@@ -439,40 +530,103 @@ static t_timer *get_pgm_timer(t_pgm *pgm) {
     return timer;
 }
 
+/* return the timer of type related to pgm, or NULL */
+static t_timer *get_pgm_timer_type(t_pgm *pgm, int32_t type) {
+    t_tm_node *node = get_node(NULL);
+    t_timer *timer = node->timer_hd;
+
+    while (timer && (timer->pgm != pgm || timer->type != type))
+        timer = timer->next;
+    return timer;
+}
+
 /* trigger every timers related to pgm. unused is to have a prototype compatible
  * with safe_timer_fn_call() callback parameter. */
 static void trigger_pgm_timer(t_pgm *pgm, int32_t unused) {
     UNUSED_PARAM(unused);
-    t_tm_node *node = get_node(NULL);
-    t_timer *timer = node->timer_hd;
-    void (*cb[2])(t_timer *) = {handle_timer_start, handle_timer_stop};
+    t_timer *timer;
 
     while ((timer = get_pgm_timer(pgm))) {
-        cb[timer->type - 1](timer); /* execute timer cb before deletion */
+        fire_timer(timer); /* execute timer cb before deletion */
         delete_timer(timer);
     }
 }
 
+/* delete every timers related to pgm without triggering them. unused is to
+ * have a prototype compatible with safe_timer_fn_call() callback parameter. */
+static void delete_pgm_timer(t_pgm *pgm, int32_t unused) {
+    UNUSED_PARAM(unused);
+    t_timer *timer;
+
+    while ((timer = get_pgm_timer(pgm))) delete_timer(timer);
+}
+
+/* add the log rotation timer of pgm if it has a size limit and isn't already
+ * watched. unused is to have a prototype compatible with safe_timer_fn_call()
+ * callback parameter. */
+static void add_logrotate_timer(t_pgm *pgm, int32_t unused) {
+    UNUSED_PARAM(unused);
+    if (!pgm->usr.out_rotate.maxbytes && !pgm->usr.err_rotate.maxbytes) return;
+    if (get_pgm_timer_type(pgm, TIMER_EV_LOGROTATE)) return;
+    add_timer(pgm, TIMER_EV_LOGROTATE);
+}
+
+/* add the resource sampling timer of pgm if sampling is enabled & pgm isn't
+ * already sampled. unused is to have a prototype compatible with
+ * safe_timer_fn_call() callback parameter. */
+static void add_sample_timer(t_pgm *pgm, int32_t unused) {
+    UNUSED_PARAM(unused);
+    if (!proc_sample_enabled()) return;
+    if (get_pgm_timer_type(pgm, TIMER_EV_SAMPLE)) return;
+    add_timer(pgm, TIMER_EV_SAMPLE);
+}
+
+/* (re)arm the timer killing the procs of pgm stopped one by one. unused is to
+ * have a prototype compatible with safe_timer_fn_call() callback parameter. */
+static void add_kill_timer(t_pgm *pgm, int32_t unused) {
+    UNUSED_PARAM(unused);
+    t_timer *timer = get_pgm_timer_type(pgm, TIMER_EV_KILL);
+
+    if (timer) delete_timer(timer);
+    add_timer(pgm, TIMER_EV_KILL);
+}
+
 /* trigger the right function according to the type of the 1st timer in
  * the list */
 static void sigalrm_handler(int signb) {
     UNUSED_PARAM(signb);
     t_tm_node *node = get_node(NULL);
     t_timer *tmr = node->timer_hd;
-    void (*cb[2])(t_timer *) = {handle_timer_start, handle_timer_stop};
 
     if (!tmr) {
         ft_log(FT_LOG_WARNING, "SIGALRM triggered but no timer left");
         return;
     }
-    cb[tmr->type - 1](tmr);
+    int64_t start = metrics_now_us();
+    TM_TRACE(TRACE_TIMER, "fire timer type %d of %s, %ld s late", tmr->type,
+             tmr->pgm->usr.name, (long)(time(NULL) - tmr->time));
+    metrics_timer_fired();
+    metrics_timer_drift(tmr->due);
+    fire_timer(tmr);
     delete_timer(tmr);
+    ft_log_flush();
+    metrics_cost(COST_SIGALRM, "sigalrm_handler", start);
+}
+
+/* returns in seconds how long a timer of this type lasts for pgm */
+static time_t timer_delay(const t_pgm *pgm, int32_t type) {
+    if (type == TIMER_EV_START) return pgm->usr.starttime / 1000;
+    if (type == TIMER_EV_STOP || type == TIMER_EV_KILL)
+        return pgm->usr.stoptime / 1000;
+    if (type == TIMER_EV_SAMPLE) return proc_sample_delay(pgm);
+    return LOGROTATE_INTERVAL;
 }
 
 /* add a timer link to the list and set the timer if it is in 1st position */
 static void add_timer(t_pgm *pgm, int32_t type) {
     t_tm_node *node = get_node(NULL);
     t_timer *tmr = node->timer_hd, *last = NULL, *timer;
+    time_t delay = timer_delay(pgm, type);
 
     timer = malloc(1 * sizeof(*timer));
     if (!timer) {
@@ -480,9 +634,11 @@ static void add_timer(t_pgm *pgm, int32_t type) {
         return;
     }
     timer->pgm = pgm, timer->type = type, timer->next = NULL;
-    timer->time = time(NULL) + ((type == TIMER_EV_START ? pgm->usr.starttime
-                                                        : pgm->usr.stoptime) /
-                                1000);
+    tm_metrics.timers++;
+    timer->time = time(NULL) + delay;
+    timer->due = metrics_now_us() + delay * 1000000L;
+    TM_TRACE(TRACE_TIMER, "add timer type %d of %s in %ld s", type,
+             pgm->usr.name, (long)delay);
 
     /* find where to insert the new timer in the list */
     while (tmr) {
@@ -504,9 +660,11 @@ static void add_timer(t_pgm *pgm, int32_t type) {
 
 /* -------------------------- processus launching --------------------------- */
 
-/* Reset to default interactive and job-control signals. */
+/* Reset to default interactive and job-control signals. The mask of the
+ * handler or command which launched the proc is cleared too */
 static void reset_dfl_interactive_sig() {
     struct sigaction act;
+    sigset_t none;
 
     act.sa_handler = SIG_DFL;
     sigemptyset(&act.sa_mask);
@@ -517,14 +675,33 @@ static void reset_dfl_interactive_sig() {
     sigaction(SIGTTIN, &act, NULL);
     sigaction(SIGTTOU, &act, NULL);
     sigaction(SIGCHLD, &act, NULL);
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
 }
 
-static pid_t launch_proc(const t_pgm *pgm, pid_t pgid) {
+/* the read end of the exec pipe raises EXEC_SIGNAL once the child execs or
+ * fails to, it isn't waited for: a child stuck before its exec mustn't stall
+ * the handler which launched it. A child whose execve fails writes a byte */
+static pid_t launch_proc(t_pgm *pgm, pid_t pgid, t_proc_exec *exec) {
+    int32_t exec_pipe[2] = {-1, -1};
+    int32_t err;
     pid_t pid;
 
+    exec->fd = -1;
+    exec->forked = metrics_now_us();
+    if (pipe2(exec_pipe, O_CLOEXEC) == -1) {
+        perror("pipe2");
+    } else if (fcntl(exec_pipe[0], F_SETOWN, getpid()) == -1 ||
+               fcntl(exec_pipe[0], F_SETSIG, EXEC_SIGNAL) == -1 ||
+               fcntl(exec_pipe[0], F_SETFL, O_ASYNC | O_NONBLOCK) == -1) {
+        perror("fcntl");
+        close(exec_pipe[0]), close(exec_pipe[1]);
+        exec_pipe[0] = -1;
+    }
     pid = fork();
     if (pid == -1) handle_error("fork()");
     if (pid == 0) {
+        if (exec_pipe[0] != -1) close(exec_pipe[0]);
         pid = getpid();
         if (!pgid) pgid = pid;
         setpgid(pid, pgid);
@@ -542,34 +719,100 @@ static pid_t launch_proc(const t_pgm *pgm, pid_t pgid) {
         dup2(pgm->privy.log.err, STDERR_FILENO);
         close(pgm->privy.log.err);
 
-        if (execve(pgm->usr.cmd[0], pgm->usr.cmd, pgm->usr.env.array_val) == -1)
-            handle_error("execve");
+        if (execve(pgm->usr.cmd[0], pgm->usr.cmd, pgm->usr.env.array_val) ==
+            -1) {
+            err = errno;
+            if (exec_pipe[0] != -1) write(exec_pipe[1], "", 1);
+            errno = err;
+            perror("execve");
+            _exit(EXIT_FAILURE); /* the supervisor's atexit() aren't its own */
+        }
     }
+    if (exec_pipe[0] == -1) return pid;
+    close(exec_pipe[1]);
+    exec->fd = exec_pipe[0];
+    pgm->privy.exec_cnt++;
     return pid;
 }
 
+static void exec_close(t_pgm *pgm, t_process *proc) {
+    if (proc->exec.fd == -1) return;
+    close(proc->exec.fd);
+    proc->exec.fd = -1;
+    pgm->privy.exec_cnt--;
+}
+
+/* EOF on the exec pipe times the exec of the proc, & its restart if it was
+ * reaped before. A byte means its execve failed: there's nothing to time */
+static int32_t exec_poll(t_pgm *pgm, const void *arg, t_process *last,
+                         t_process **current_proc) {
+    UNUSED_PARAM(arg);
+    UNUSED_PARAM(last);
+    t_process *proc = *current_proc;
+    int64_t now;
+    ssize_t rd;
+    char c;
+
+    if (proc->exec.fd == -1) return 0;
+    while ((rd = read(proc->exec.fd, &c, 1)) == -1 && errno == EINTR)
+        ;
+    if (rd == -1 && errno == EAGAIN) return 0;
+    if (!rd) {
+        now = metrics_now_us();
+        metrics_lat(pgm, LAT_FORK_EXEC, now - proc->exec.forked);
+        if (proc->reaped) metrics_lat(pgm, LAT_RESPAWN, now - proc->reaped);
+    }
+    exec_close(pgm, proc);
+    return 0;
+}
+
+/* wrapper to call process_proc() on the pgms with an exec not seen yet */
+static int32_t exec_poll_pgm(t_pgm *pgm, void *arg) {
+    if (pgm->privy.exec_cnt) process_proc(pgm, exec_poll, arg);
+    return 0;
+}
+
 /* create a new proc, init it and add it into the linked list */
-static void add_new_proc(t_pgm *pgm, pid_t cpid) {
+static void add_new_proc(t_pgm *pgm, pid_t cpid, const t_proc_exec *exec) {
     t_process *new = calloc(1, sizeof(*new));
 
     if (!new) handle_error("calloc");
     new->next = pgm->privy.proc_head;
     pgm->privy.proc_head = new;
     new->pid = cpid;
+    new->exec = *exec;
     new->state = PROC_ST_STARTING;
     new->restart_cnt++;
+    proc_sample_open(new);
+    metrics_proc_enter(pgm, new);
+}
+
+static int32_t count_proc(const t_pgm *pgm, t_proc_state state) {
+    int32_t cnt = 0;
+
+    for (t_process *proc = pgm->privy.proc_head; proc; proc = proc->next)
+        cnt += (proc->state == state);
+    return cnt;
 }
 
-/* if there is room for a new proc: fork, execve, and add new proc to the list*/
+/* if there is room for a new proc: fork, execve, and add new proc to the list.
+ * procs being stopped leave their room */
 static void launch_new_proc(t_pgm *pgm) {
+    t_proc_exec exec;
     pid_t cpid;
 
-    if (pgm->privy.proc_cnt == pgm->usr.numprocs) return; /* guard */
-    cpid = launch_proc(pgm, pgm->privy.pgid);
-    if (cpid) add_new_proc(pgm, cpid);
+    if (pgm->privy.proc_cnt - count_proc(pgm, PROC_ST_TERMINATING) >=
+        pgm->usr.numprocs)
+        return; /* guard */
+    cpid = launch_proc(pgm, pgm->privy.pgid, &exec);
+    if (cpid) add_new_proc(pgm, cpid, &exec);
     if (!pgm->privy.pgid) pgm->privy.pgid = cpid;
     setpgid(cpid, pgm->privy.pgid);
     pgm->privy.proc_cnt++;
+    pgm->privy.metrics.spawns++;
+    journal_record(JRNL_SPAWN, pgm->usr.name, pgm->privy.proc_head->pid,
+                   pgm->privy.proc_head->restart_cnt - 1);
+    safe_timer_fn_call(pgm, 0, add_sample_timer);
     ft_log(FT_LOG_INFO, "(%d) %s <%d> started", pgm->privy.pgid, pgm->usr.name,
            pgm->privy.proc_head->pid);
 }
@@ -587,6 +830,9 @@ static int32_t delete_proc(t_pgm *pgm, t_process *last,
         pgm->privy.proc_head = current->next;
         *current_proc = NULL;
     }
+    metrics_proc_leave(pgm, current);
+    proc_sample_close(current);
+    exec_close(pgm, current);
     free(current);
     pgm->privy.proc_cnt--;
     if (!pgm->privy.proc_cnt) pgm->privy.pgid = 0;
@@ -597,15 +843,24 @@ static int32_t delete_proc(t_pgm *pgm, t_process *last,
 
 /* ---------------------------- processus update ---------------------------- */
 
-static void update_proc_data(t_process *proc, pid_t pid) {
-    proc->pid = pid, proc->restart_cnt++, proc->state = PROC_ST_RUNNING;
+static void update_proc_data(t_pgm *pgm, t_process *proc, pid_t pid) {
+    proc->pid = pid, proc->restart_cnt++;
+    proc_sample_close(proc);
+    proc_sample_open(proc);
+    move_proc(pgm, proc, PROC_ST_RUNNING);
+    pgm->privy.metrics.spawns++, pgm->privy.metrics.restarts++;
 }
 
 static void restart_proc(t_pgm *pgm, t_process *proc) {
-    pid_t cpid = launch_proc(pgm, pgm->privy.pgid);
-    if (cpid) update_proc_data(proc, cpid);
+    pid_t cpid;
+
+    exec_close(pgm, proc);
+    cpid = launch_proc(pgm, pgm->privy.pgid, &proc->exec);
+    if (cpid) update_proc_data(pgm, proc, cpid);
     if (!pgm->privy.pgid) pgm->privy.pgid = cpid;
     setpgid(cpid, pgm->privy.pgid);
+    journal_record(JRNL_RESTART, pgm->usr.name, proc->pid,
+                   proc->restart_cnt - 1);
     ft_log(FT_LOG_INFO, "(%d) %s <%d> restarted", pgm->privy.pgid,
            pgm->usr.name, proc->pid);
 }
@@ -629,16 +884,28 @@ static int32_t update_process(t_pgm *pgm, const void *arg, t_process *last,
     UNUSED_PARAM(arg);
 
     if (!current->updated) return 0;
+    TM_TRACE(TRACE_REAPER, "update %s <%d> state %d, restarted %d times",
+             pgm->usr.name, current->pid, current->state,
+             current->restart_cnt - 1);
+    metrics_proc_exit(pgm, current->w_status);
+    if (current->state == PROC_ST_TERMINATING)
+        metrics_lat(pgm, LAT_STOP, current->reaped - current->since * 1000);
     if (WIFEXITED(current->w_status)) {
+        journal_record(JRNL_EXIT, pgm->usr.name, current->pid,
+                       WEXITSTATUS(current->w_status));
         ft_log(FT_LOG_INFO, "(%d) %s <%d> exited with status %d",
                pgm->privy.pgid, pgm->usr.name, current->pid,
                WEXITSTATUS(current->w_status));
-        if (proc_no_restart(pgm, current)) {
+        /* a proc being stopped isn't restarted */
+        if (current->state == PROC_ST_TERMINATING ||
+            proc_no_restart(pgm, current)) {
             return delete_proc(pgm, last, current_proc);
         } else {
             restart_proc(pgm, current);
         }
     } else if (WIFSIGNALED(current->w_status)) {
+        journal_record(JRNL_SIGNALED, pgm->usr.name, current->pid,
+                       WTERMSIG(current->w_status));
         ft_log(FT_LOG_INFO, "(%d) %s <%d> terminated with signal %d",
                pgm->privy.pgid, pgm->usr.name, current->pid,
                WTERMSIG(current->w_status));
@@ -646,6 +913,8 @@ static int32_t update_process(t_pgm *pgm, const void *arg, t_process *last,
         if (!pgm->privy.proc_cnt) safe_timer_fn_call(pgm, 0, trigger_pgm_timer);
         return EXIT_SUCCESS;
     } else if (WIFSTOPPED(current->w_status)) {
+        journal_record(JRNL_STOPPED, pgm->usr.name, current->pid,
+                       WSTOPSIG(current->w_status));
         ft_log(FT_LOG_INFO, "(%d) %s <%d> stopped with signal %d",
                pgm->privy.pgid, pgm->usr.name, current->pid,
                WSTOPSIG(current->w_status));
@@ -677,6 +946,7 @@ static int32_t notify_process(t_pgm *pgm, const void *arg, t_process *last,
     } *args = arg;
 
     if (current->pid == args->pid) {
+        current->reaped = metrics_now_us();
         current->w_status = args->status;
         current->updated = true;
         pgm->privy.updated = true;
@@ -698,6 +968,7 @@ static int32_t mark_process_status(t_tm_node *node, pid_t pid, int32_t status) {
     } arg = {pid, status};
 
     if (pid > 0) {
+        TM_TRACE(TRACE_REAPER, "reaped pid %d, status %#x", pid, status);
         if (process_pgm(node->head, wr_notify_process, &arg)) return 0;
         fprintf(stderr, "No child process %d.\n", pid);
         return -1;
@@ -711,12 +982,14 @@ static int32_t mark_process_status(t_tm_node *node, pid_t pid, int32_t status) {
 
 /* if any child has a new status, mark it */
 static void update_pgm_status(t_tm_node *node) {
+    int64_t start = metrics_now_us();
     int status;
     pid_t pid;
 
     do {
         pid = waitpid(WAIT_ANY, &status, WUNTRACED | WNOHANG);
     } while (!mark_process_status(node, pid, status));
+    metrics_cost(COST_REAP, "update_pgm_status", start);
 }
 
 /* ====================== command handlers primitives ======================= */
@@ -727,12 +1000,15 @@ static void launch_pgm(t_pgm *pgm) {
 
     for (int32_t i = 0; i < nb_new_proc; i++) launch_new_proc(pgm);
     safe_timer_fn_call(pgm, TIMER_EV_START, add_timer);
+    safe_timer_fn_call(pgm, 0, add_logrotate_timer);
 }
 
 static int32_t signal_stop_pgm(t_pgm *pgm) {
     t_proc_state state = PROC_ST_TERMINATING;
 
     if (!pgm->privy.proc_cnt) return 1;
+    journal_record(JRNL_SIGNAL, pgm->usr.name, pgm->privy.pgid,
+                   pgm->usr.stopsignal.nb);
     kill(-(pgm->privy.pgid), pgm->usr.stopsignal.nb);
     process_proc(pgm, set_proc_state, &state);
     safe_timer_fn_call(pgm, TIMER_EV_STOP, add_timer);
@@ -762,152 +1038,203 @@ static int32_t exit_pgm(t_pgm *pgm, void *arg) {
     return 0;
 }
 
-static int32_t status_pgm(t_pgm *pgm, void *arg) {
-    UNUSED_PARAM(arg);
-    printf("- [%d] %s: <%d/%d> started\n", pgm->privy.pgid, pgm->usr.name,
-           pgm->privy.proc_cnt, pgm->usr.numprocs);
-    return EXIT_SUCCESS;
-}
-
-static void status_proc(t_pgm *pgm) {
-    char proc_st[PROC_ST_MAX][16] = {"starting", "running", "terminating"};
-    status_pgm(pgm, NULL);
-    for (t_process *proc = pgm->privy.proc_head; proc; proc = proc->next)
-        printf("pid <%d> - %s - restarted <%d/%d> times\n", proc->pid,
-               proc_st[proc->state], proc->restart_cnt - 1,
-               pgm->usr.startretries);
-}
+/* ----------------------------- rolling reload ----------------------------- */
 
-/* --------------------------------- reload --------------------------------- */
-
-static int32_t tm_strcmp(const char *s1, const char *s2) {
-    const unsigned char *s1_cp = (const unsigned char *)s1;
-    const unsigned char *s2_cp = (const unsigned char *)s2;
-    uint8_t diff;
-
-    if (!s1_cp && !s2_cp) return EXIT_SUCCESS;
-    if (!s1_cp || !s2_cp) return EXIT_FAILURE;
-    diff = (*s1_cp != *s2_cp);
-    while (*s1_cp && *s2_cp && !diff) {
-        s1_cp++;
-        s2_cp++;
-        diff = (*s1_cp != *s2_cp);
+/* break the rolling reload links of pgm. unused is to have a prototype
+ * compatible with safe_timer_fn_call() callback parameter. */
+static void roll_unlink(t_pgm *pgm, int32_t unused) {
+    UNUSED_PARAM(unused);
+    if (pgm->privy.roll_from) pgm->privy.roll_from->privy.roll_to = NULL;
+    if (pgm->privy.roll_to) pgm->privy.roll_to->privy.roll_from = NULL;
+    pgm->privy.roll_from = pgm->privy.roll_to = NULL;
+}
+
+/* pgm_new replaces pgm, linked to the pgm whose procs it replaces if any.
+ * By a rolling reload if it has a max_unavailable or a max_surge: if pgm was
+ * itself rolling, pgm_new takes over the procs pgm was replacing, & pgm is
+ * stopped at once. Otherwise pgm_new starts once the procs are all stopped */
+static bool roll_start(t_pgm *pgm, t_pgm *pgm_new) {
+    bool rolling = pgm_new->usr.max_unavailable || pgm_new->usr.max_surge;
+    t_pgm *old = pgm->privy.roll_from;
+
+    if (!old || (!rolling && pgm->privy.proc_cnt)) old = pgm;
+    safe_timer_fn_call(pgm, 0, roll_unlink);
+    if (!old->privy.proc_cnt) return false;
+    old->privy.roll_to = pgm_new;
+    pgm_new->privy.roll_from = old;
+    return rolling;
+}
+
+/* end the rolling reload of pgm, or its wait for the pgm it replaces: the
+ * procs it was replacing are stopped at once */
+static void roll_abort(t_pgm *pgm) {
+    if (!pgm->privy.roll_from) return;
+    safe_timer_fn_call(pgm, 0, roll_unlink);
+    if (pgm->privy.ev == PGM_EV_ROLL || pgm->privy.ev == PGM_EV_ADD)
+        pgm->privy.ev = PGM_NO_EV;
+}
+
+/* stop nb procs of pgm one by one */
+static void stop_procs(t_pgm *pgm, int32_t nb) {
+    for (t_process *proc = pgm->privy.proc_head; nb && proc;
+         proc = proc->next) {
+        if (proc->state == PROC_ST_TERMINATING) continue;
+        journal_record(JRNL_SIGNAL, pgm->usr.name, proc->pid,
+                       pgm->usr.stopsignal.nb);
+        kill(proc->pid, pgm->usr.stopsignal.nb);
+        move_proc(pgm, proc, PROC_ST_TERMINATING);
+        nb--;
     }
-    return (*s1_cp - *s2_cp);
+    safe_timer_fn_call(pgm, 0, add_kill_timer);
 }
 
-/* just compare two programs names. Returns 1 if they have the same name */
-static int32_t find_same_pgm(t_pgm *pgm, void *arg) {
-    return (tm_strcmp(pgm->usr.name, ((t_pgm *)arg)->usr.name) == 0);
-}
+/* replace the procs of the pgm pgm rolls from by its own, a batch at a time.
+ * A batch begins once the former is over: no new proc is starting & no old
+ * one terminating. Available procs, the old ones not stopped & the new ones
+ * which passed starttime, don't drop below numprocs - max_unavailable, and
+ * procs not being stopped don't exceed numprocs + max_surge */
+static void roll_step(t_pgm *pgm) {
+    t_pgm *old = pgm->privy.roll_from;
+    int32_t numprocs = pgm->usr.numprocs, old_up, new_up, stop, start;
 
-/* looks for pgm into arg list, notify pgm to be deleted if not found */
-static int32_t notify_removable_pgm(t_pgm *pgm, void *arg) {
-    if (!process_pgm((t_pgm *)arg, find_same_pgm, pgm)) {
-        ft_log(FT_LOG_DEBUG, "pgm %s - del", pgm->usr.name);
-        pgm->privy.ev = PGM_EV_DEL;
+    if (count_proc(pgm, PROC_ST_STARTING) ||
+        (old && count_proc(old, PROC_ST_TERMINATING)))
+        return;
+    old_up = old ? old->privy.proc_cnt : 0;
+    new_up = pgm->privy.proc_cnt;
+    if (new_up < pgm->privy.roll_cnt) { /* the last batch didn't start */
+        journal_record(JRNL_START_FAIL, pgm->usr.name, pgm->privy.pgid, new_up);
+        ft_log(FT_LOG_ERR,
+               "(%d) %s rolling reload stalled: <%d/%d> procs started, <%d> "
+               "old procs kept",
+               pgm->privy.pgid, pgm->usr.name, new_up, pgm->privy.roll_cnt,
+               old_up);
+        pgm->privy.ev = PGM_NO_EV;
+        return;
     }
-    return 0;
+    if (!old_up && new_up >= numprocs) {
+        journal_record(JRNL_RUNNING, pgm->usr.name, pgm->privy.pgid, new_up);
+        ft_log(FT_LOG_INFO, "(%d) %s rolling reload done. <%d/%d> procs",
+               pgm->privy.pgid, pgm->usr.name, new_up, numprocs);
+        pgm->privy.ev = PGM_NO_EV;
+        return;
+    }
+    stop = old_up + new_up - (numprocs - pgm->usr.max_unavailable);
+    stop = stop < 0 ? 0 : (stop > old_up ? old_up : stop);
+    start = numprocs + pgm->usr.max_surge - (old_up - stop) - new_up;
+    if (start > numprocs - new_up) start = numprocs - new_up;
+    if (start < 0) start = 0;
+    pgm->privy.roll_cnt = new_up + start;
+    TM_TRACE(TRACE_RELOAD, "%s rolling batch: stop %d, start %d", pgm->usr.name,
+             stop, start);
+    ft_log(FT_LOG_INFO,
+           "(%d) %s rolling reload: stopping <%d>, starting <%d>. <%d/%d> "
+           "procs replaced",
+           pgm->privy.pgid, pgm->usr.name, stop, start, new_up, numprocs);
+    if (stop) stop_procs(old, stop);
+    if (!start) return;
+    for (int32_t i = 0; i < start; i++) launch_new_proc(pgm);
+    safe_timer_fn_call(pgm, 0, add_logrotate_timer);
+    /* last: with no starttime, the timer fires now & runs the next batch */
+    safe_timer_fn_call(pgm, TIMER_EV_START, add_timer);
 }
 
-/* looks for new_pgm into main list (arg), notify new_pgm to be added if
- * not found & switch it from lists */
-static int32_t notify_new_pgm(t_pgm *new_pgm, void *arg) {
-    t_tm_node *newnode = get_newnode(NULL, false), *node = get_node(NULL);
+/* --------------------------------- scaling -------------------------------- */
 
-    if (!process_pgm((t_pgm *)arg, find_same_pgm, new_pgm)) {
-        ft_log(FT_LOG_DEBUG, "pgm %s - add", new_pgm->usr.name);
-        new_pgm->privy.ev = PGM_EV_ADD;
-        pgm_list_remove(newnode, new_pgm);
-        pgm_list_add_front(node, new_pgm);
-    }
-    return 0;
-}
+/* set the numprocs of pgm. If it runs, only the difference is started, or
+ * stopped newest first. A rolling reload adapts its next batch */
+static void scale_pgm(t_pgm *pgm, uint16_t numprocs) {
+    int32_t up = pgm->privy.proc_cnt - count_proc(pgm, PROC_ST_TERMINATING);
 
-static int32_t str_array_cmp(char *const *arr1, char *const *arr2) {
-    int32_t i = 0;
+    TM_TRACE(TRACE_RELOAD, "%s scaled from %d to %d procs, %d up",
+             pgm->usr.name, pgm->usr.numprocs, numprocs, up);
+    journal_record(JRNL_SCALE, pgm->usr.name, pgm->privy.pgid, numprocs);
+    pgm->usr.numprocs = numprocs;
+    if (pgm->privy.ev == PGM_EV_ROLL || !up || up == numprocs) return;
+    ft_log(FT_LOG_INFO, "(%d) %s scaled: %s <%d> procs", pgm->privy.pgid,
+           pgm->usr.name, up > numprocs ? "stopping" : "starting",
+           abs(up - numprocs));
+    if (up > numprocs) return stop_procs(pgm, up - numprocs);
+    for (int32_t i = up; i < numprocs; i++) launch_new_proc(pgm);
+    safe_timer_fn_call(pgm, TIMER_EV_START, add_timer);
+}
 
-    while (arr1[i] && arr2[i] && !tm_strcmp(arr1[i], arr2[i])) i++;
-    return !(!arr1[i] && !arr2[i]);
-}
-
-#define CLIENT_SOFT_RELOAD 1
-#define CLIENT_HARD_RELOAD 2
-
-/* compares two pgm with the same name and returns a status code according to
- * the differences between them. */
-static uint8_t pgm_compare(t_pgm *p1, t_pgm *p2) {
-    if (tm_strcmp((char *)p1->usr.name, (char *)p2->usr.name)) return 0;
-    bool soft_reload = (p1->usr.autostart != p2->usr.autostart ||
-                        p1->usr.autorestart != p2->usr.autorestart ||
-                        p1->usr.starttime != p2->usr.starttime ||
-                        p1->usr.startretries != p2->usr.startretries ||
-                        p1->usr.stopsignal.nb != p2->usr.stopsignal.nb ||
-                        p1->usr.stoptime != p2->usr.stoptime);
-    bool hard_reload =
-        (str_array_cmp(p1->usr.cmd, p2->usr.cmd) ||
-         p1->usr.numprocs != p2->usr.numprocs ||
-         p1->usr.exitcodes.array_size != p2->usr.exitcodes.array_size ||
-         tm_strcmp((char *)p1->usr.std_out, (char *)p2->usr.std_out) ||
-         tm_strcmp((char *)p1->usr.std_err, (char *)p2->usr.std_err) ||
-         p1->usr.env.array_size != p2->usr.env.array_size ||
-         tm_strcmp((char *)p1->usr.workingdir, (char *)p2->usr.workingdir) ||
-         p1->usr.umask != p2->usr.umask);
-
-    for (uint32_t cnt = 0; cnt < p1->usr.env.array_size && !hard_reload; cnt++)
-        if (tm_strcmp((char *)p1->usr.env.array_val[cnt],
-                      (char *)p2->usr.env.array_val[cnt]) != 0)
-            hard_reload = true;
-
-    for (uint32_t cnt = 0; cnt < p1->usr.exitcodes.array_size && !hard_reload;
-         cnt++)
-        if (p1->usr.exitcodes.array_val[cnt] !=
-            p2->usr.exitcodes.array_val[cnt])
-            soft_reload = true;
-
-    return ((hard_reload * CLIENT_HARD_RELOAD) +
-            ((soft_reload && !hard_reload) * CLIENT_SOFT_RELOAD));
-}
-
-/* copies all values from pgm_new to pgm, which don't need a restart of pgm */
+/* copies all values from pgm_new to pgm, which don't need a restart of pgm.
+ * exitcodes are swapped so that the old ones are freed with pgm_new */
 static int32_t pgm_soft_cpy(t_pgm *pgm, t_pgm *pgm_new) {
+    struct s_exit_code exitcodes = pgm->usr.exitcodes;
+
     pgm->usr.autostart = pgm_new->usr.autostart;
     pgm->usr.autorestart = pgm_new->usr.autorestart;
     pgm->usr.starttime = pgm_new->usr.starttime;
     pgm->usr.startretries = pgm_new->usr.startretries;
     pgm->usr.stopsignal = pgm_new->usr.stopsignal;
     pgm->usr.stoptime = pgm_new->usr.stoptime;
-    for (uint32_t i = 0; i < pgm->usr.exitcodes.array_size; i++)
-        pgm->usr.exitcodes.array_val[i] = pgm_new->usr.exitcodes.array_val[i];
+    pgm->usr.out_rotate = pgm_new->usr.out_rotate;
+    pgm->usr.err_rotate = pgm_new->usr.err_rotate;
+    pgm->usr.max_unavailable = pgm_new->usr.max_unavailable;
+    pgm->usr.max_surge = pgm_new->usr.max_surge;
+    pgm->usr.exitcodes = pgm_new->usr.exitcodes;
+    pgm_new->usr.exitcodes = exitcodes;
+    pgm->privy.soft_fp = pgm_new->privy.soft_fp;
+    if (pgm->usr.numprocs != pgm_new->usr.numprocs)
+        scale_pgm(pgm, pgm_new->usr.numprocs);
+    if (pgm->privy.proc_cnt) safe_timer_fn_call(pgm, 0, add_logrotate_timer);
     return EXIT_SUCCESS;
 }
 
-/* finds if the two pgm beeing compared are the same (same name) but have few
- * changes in the configuration which justify either a soft or hard reload, and
- * notify &/| accordingly */
-static int32_t find_reloadable_pgm(t_pgm *pgm, void *arg) {
-    t_tm_node *newnode = get_newnode(NULL, false);
-    t_pgm *pgm_new = (t_pgm *)arg;
-    int32_t ret = 0;
+/* --------------------------------- reload --------------------------------- */
 
-    ret = pgm_compare(pgm, pgm_new);
-    if (ret == CLIENT_SOFT_RELOAD) {
-        ft_log(FT_LOG_DEBUG, "%s soft reload", pgm->usr.name);
-        pgm_soft_cpy(pgm, pgm_new);
-    } else if (ret == CLIENT_HARD_RELOAD) {
-        ft_log(FT_LOG_DEBUG, "%s hard reload", pgm->usr.name);
+/* notify pgm, pgm_new or both according to diff, a decision of the join of
+ * the running pgm & the new config (pgm_join()). Returns true if pgm_new has
+ * been moved to the main list (arg). */
+static bool notify_reloadable_pgm(t_pgm *pgm, t_pgm *pgm_new, t_pgm_diff diff,
+                                  void *arg) {
+    t_tm_node *node = arg;
+
+    if (diff == PGM_DIFF_DEL) {
+        TM_TRACE(TRACE_RELOAD, "pgm %s - del", pgm->usr.name);
+        journal_record(JRNL_RELOAD, pgm->usr.name, pgm->privy.pgid,
+                       JRNL_RELOAD_DEL);
         pgm->privy.ev = PGM_EV_DEL;
+    } else if (diff == PGM_DIFF_ADD) {
+        TM_TRACE(TRACE_RELOAD, "pgm %s - add", pgm_new->usr.name);
+        journal_record(JRNL_RELOAD, pgm_new->usr.name, 0, JRNL_RELOAD_ADD);
         pgm_new->privy.ev = PGM_EV_ADD;
-        pgm_list_remove(newnode, pgm_new);
+        pgm_list_add_front(node, pgm_new);
+        return true;
+    } else if (diff == PGM_DIFF_SOFT) {
+        TM_TRACE(TRACE_RELOAD, "%s soft reload", pgm->usr.name);
+        journal_record(JRNL_RELOAD, pgm->usr.name, pgm->privy.pgid,
+                       JRNL_RELOAD_SOFT);
+        pgm_soft_cpy(pgm, pgm_new);
+    } else if (diff == PGM_DIFF_HARD) {
+        pgm->privy.ev = PGM_EV_DEL;
+        pgm_new->privy.ev =
+            roll_start(pgm, pgm_new) ? PGM_EV_ROLL : PGM_EV_ADD;
+        TM_TRACE(TRACE_RELOAD, "%s %s reload", pgm->usr.name,
+                 pgm_new->privy.ev == PGM_EV_ROLL ? "rolling" : "hard");
+        journal_record(JRNL_RELOAD, pgm->usr.name, pgm->privy.pgid,
+                       pgm_new->privy.ev == PGM_EV_ROLL ? JRNL_RELOAD_ROLL
+                                                        : JRNL_RELOAD_HARD);
         pgm_list_insert_after(pgm, pgm_new);
+        return true;
     }
-    return ret;
+    return false;
 }
 
-/* applies find_reloadable_pgm() to the main list (arg) against pgm_new */
-static int32_t notify_reloadable_pgm(t_pgm *pgm_new, void *arg) {
-    process_pgm((t_pgm *)arg, find_reloadable_pgm, pgm_new);
-    return 0;
+/* hash joins the main list & the new config on pgm names, new_map being
+ * built along the new config. Only pgm which are added, deleted or changed
+ * are touched. */
+static int32_t notify_reload(t_tm_node *node, t_tm_node *newnode,
+                             t_pgm_map *new_map) {
+    t_pgm_map old_map;
+
+    if (pgm_map_init(&old_map, node->head)) return EXIT_FAILURE;
+    pgm_join(node->head, &old_map, &newnode->head, new_map,
+             notify_reloadable_pgm, node);
+    pgm_map_destroy(&old_map);
+    return EXIT_SUCCESS;
 }
 
 /* ========================= command handlers utils ========================= */
@@ -923,11 +1250,50 @@ static char *get_next_word(const char *str) {
     return (char *)(str + i);
 }
 
+/* parse a time argument into microseconds since epoch. Accepts a duration
+ * ago (30s, 15m, 2h, 1d), a time of today (HH:MM[:SS]), a date
+ * (YYYY-MM-DDTHH:MM[:SS]) or seconds since epoch */
+static int32_t parse_time_arg(const char *arg, int64_t *us) {
+    struct tm tm = {0};
+    time_t now = time(NULL), t;
+    const char *end;
+    char *endptr;
+    int64_t val;
+
+    localtime_r(&now, &tm);
+    if ((end = strptime(arg, "%Y-%m-%dT%H:%M", &tm)) ||
+        (end = strptime(arg, "%H:%M", &tm))) {
+        tm.tm_sec = 0;
+        if (*end == ':') end = strptime(end, ":%S", &tm);
+        if (!end || *end) return EXIT_FAILURE;
+        tm.tm_isdst = -1;
+        t = mktime(&tm);
+    } else {
+        val = strtoll(arg, &endptr, 10);
+        if (endptr == arg || val < 0) return EXIT_FAILURE;
+        if (!*endptr)
+            t = val;
+        else if (!strcmp(endptr, "s"))
+            t = now - val;
+        else if (!strcmp(endptr, "m"))
+            t = now - val * 60;
+        else if (!strcmp(endptr, "h"))
+            t = now - val * 3600;
+        else if (!strcmp(endptr, "d"))
+            t = now - val * 86400;
+        else
+            return EXIT_FAILURE;
+    }
+    *us = (int64_t)t * 1000000;
+    return EXIT_SUCCESS;
+}
+
 /* compare pgm names with the current argument and returns the corresponding
  * pgm adress if it match */
 static t_pgm *get_pgm(const t_tm_node *node, char **args) {
     if (!*args) return NULL;
     for (t_pgm *pgm = node->head; pgm; pgm = pgm->privy.next) {
+        if (pgm->privy.ev == PGM_EV_DEL) continue; /* being replaced */
         if (!strncmp(pgm->usr.name, *args, strlen(pgm->usr.name))) {
             *args = get_next_word(*args);
             return pgm;
@@ -938,19 +1304,21 @@ static t_pgm *get_pgm(const t_tm_node *node, char **args) {
 
 /* ============================== command handlers ========================== */
 
-/* status can have 0 or 1 argument */
+/* status has optional arguments: [--json | --format=f] [--state=s] [pattern]
+ * ... The output is rendered then written at once */
 DECL_CMD_HANDLER(cmd_status) {
     t_tm_cmd *cmd = command;
-    char *args = cmd->args;
-    t_pgm *pgm;
+    t_status_query query;
+    int32_t ret;
 
-    if (cmd->args) {
-        while ((pgm = get_pgm(node, &args))) status_proc(pgm);
-    } else {
-        process_pgm(node->head, status_pgm, NULL);
+    if (status_parse(cmd->args, &query)) {
+        err_usr_input(node, CMD_BAD_ARG);
+        return EXIT_FAILURE;
     }
-
-    return EXIT_SUCCESS;
+    if ((ret = status_write(stdout, node, &query)))
+        err_usr_input(node, CMD_BAD_ARG);
+    status_query_destroy(&query);
+    return ret;
 }
 
 /* start has many arguments which must match with a pgm name */
@@ -969,7 +1337,10 @@ DECL_CMD_HANDLER(cmd_stop) {
     char *args = cmd->args;
     t_pgm *pgm;
 
-    while ((pgm = get_pgm(node, &args))) signal_stop_pgm(pgm);
+    while ((pgm = get_pgm(node, &args))) {
+        roll_abort(pgm);
+        signal_stop_pgm(pgm);
+    }
     return EXIT_SUCCESS;
 }
 
@@ -980,42 +1351,176 @@ DECL_CMD_HANDLER(cmd_restart) {
     t_pgm *pgm;
 
     while ((pgm = get_pgm(node, &args))) {
+        roll_abort(pgm);
         pgm->privy.ev = PGM_EV_RESTART;
         signal_stop_pgm(pgm);
     }
     return EXIT_SUCCESS;
 }
 
-/* reload config has 0 argument */
+/* scale has 2 arguments: a pgm name & its new numprocs */
+DECL_CMD_HANDLER(cmd_scale) {
+    t_tm_cmd *cmd = command;
+    char *name, *arg, *endptr, *save = NULL;
+    uintmax_t numprocs = 0;
+    t_pgm *pgm = node->head;
+
+    if (!cmd->args || !(name = strtok_r(cmd->args, " ", &save)) ||
+        !(arg = strtok_r(NULL, " ", &save))) {
+        err_usr_input(node, CMD_ARG_MISSING);
+        return EXIT_FAILURE;
+    }
+    if (strtok_r(NULL, " ", &save)) {
+        err_usr_input(node, CMD_TOO_MANY_ARGS);
+        return EXIT_FAILURE;
+    }
+    while (pgm && (pgm->privy.ev == PGM_EV_DEL || strcmp(pgm->usr.name, name)))
+        pgm = pgm->privy.next;
+    numprocs = strtoumax(arg, &endptr, 10);
+    if (!pgm || *endptr || endptr == arg || !numprocs ||
+        numprocs > SAN_NUM_PROC_MAX) {
+        err_usr_input(node, CMD_BAD_ARG);
+        return EXIT_FAILURE;
+    }
+    if (numprocs != pgm->usr.numprocs) scale_pgm(pgm, numprocs);
+    return EXIT_SUCCESS;
+}
+
+/* reload config has 0 argument. The configuration is loaded on the reload
+ * thread, then committed by sigreload_handler() */
 DECL_CMD_HANDLER(cmd_reload) {
     UNUSED_PARAM(command);
-    t_tm_node node_reload = {.tm_name = node->tm_name, 0};
 
-    if (!(node_reload.config_file_stream =
-              fopen(node->config_file_name, "r"))) {
-        fprintf(stderr, "%s: %s: %s\n", node_reload.tm_name,
-                node->config_file_name, strerror(errno));
-        goto error;
+    if (reload_start(node)) {
+        ft_log(FT_LOG_INFO, "failed to reload %s: %s", node->config_file_name,
+               strerror(errno));
+        return EXIT_FAILURE;
     }
-    if (load_config_file(&node_reload)) goto error;
-    if (sanitize_config(&node_reload)) goto error;
-    if (fulfill_config(&node_reload)) goto error;
+    return EXIT_SUCCESS;
+}
 
-    get_newnode(&node_reload, true); /* init newnode getter */
-    process_pgm(node->head, notify_removable_pgm, node_reload.head);
-    process_pgm(node_reload.head, notify_new_pgm, node->head);
-    process_pgm(node_reload.head, notify_reloadable_pgm, node->head);
-    node->pgm_nb = node_reload.pgm_nb;
-    get_newnode(NULL, true); /* reset newnode getter */
+/* commit the generation built by the reload thread: only the join with the
+ * running programs is done here, the new one being sanitized & fingerprinted
+ * already */
+static void reload_commit(t_tm_node *node) {
+    t_reload_gen *gen = reload_collect();
 
-    add_cli_completion();
-    destroy_taskmaster(&node_reload);
+    if (!gen) return;
+    if (gen->ret || notify_reload(node, &gen->node, &gen->map)) {
+        ft_log(FT_LOG_INFO, "failed to reload %s", node->config_file_name);
+    } else {
+        node->pgm_nb = gen->node.pgm_nb;
+        add_cli_completion();
+    }
+    conf_include_watch();
+    reload_done(gen);
+}
+
+static void reopen_pgm(t_pgm *pgm) {
+    log_reopen(&pgm->privy.log.out, pgm->usr.std_out, &pgm->usr.out_rotate);
+    if (pgm->usr.std_out != pgm->usr.std_err)
+        log_reopen(&pgm->privy.log.err, pgm->usr.std_err, &pgm->usr.err_rotate);
+}
+
+static int32_t wr_reopen_pgm(t_pgm *pgm, void *arg) {
+    UNUSED_PARAM(arg);
+    reopen_pgm(pgm);
+    return EXIT_SUCCESS;
+}
+
+/* reopen can have 0 or many arguments. Rotates logs right now, without
+ * restarting anything */
+DECL_CMD_HANDLER(cmd_reopen) {
+    t_tm_cmd *cmd = command;
+    char *args = cmd->args;
+    t_pgm *pgm;
+
+    if (cmd->args) {
+        while ((pgm = get_pgm(node, &args))) reopen_pgm(pgm);
+    } else {
+        process_pgm(node->head, wr_reopen_pgm, NULL);
+    }
+    return EXIT_SUCCESS;
+}
+
+/* trace has 0 argument to print subsystems state, or '<subsys,...> on|off' */
+DECL_CMD_HANDLER(cmd_trace) {
+    t_tm_cmd *cmd = command;
+    char buf[TRACE_NAME_BUF_SZ * TRACE_SUBSYS_NB * 2], *state;
+
+#ifdef PRODUCTION
+    fputs("tracepoints are compiled out of production builds\n", stdout);
+#endif
+    if (!cmd->args) {
+        tm_trace_status(buf, sizeof(buf));
+        fputs(buf, stdout);
+        fflush(stdout);
+        return EXIT_SUCCESS;
+    }
+    state = strrchr(cmd->args, ' ');
+    if (!state || (strcmp(state, " on") && strcmp(state, " off"))) goto error;
+    *state = 0; /* cut names from state */
+    if (tm_trace_set(cmd->args, !strcmp(state + 1, "on"))) goto error;
+    return EXIT_SUCCESS;
+error:
+    err_usr_input(node, CMD_BAD_ARG);
+    return EXIT_FAILURE;
+}
+
+/* events has optional arguments: [pgm] [--since t] [--until t] */
+DECL_CMD_HANDLER(cmd_events) {
+    t_tm_cmd *cmd = command;
+    char *pgm = NULL, *arg, *save = NULL;
+    int64_t since = 0, until = INT64_MAX;
+
+    arg = cmd->args ? strtok_r(cmd->args, " ", &save) : NULL;
+    for (; arg; arg = strtok_r(NULL, " ", &save)) {
+        if (!strcmp(arg, "--since") || !strcmp(arg, "--until")) {
+            bool is_since = !strcmp(arg, "--since");
+            if (!(arg = strtok_r(NULL, " ", &save))) goto error;
+            if (parse_time_arg(arg, is_since ? &since : &until)) goto error;
+        } else if (!pgm) {
+            pgm = arg;
+        } else
+            goto error;
+    }
+    journal_query(stdout, pgm, since, until);
+    fflush(stdout);
     return EXIT_SUCCESS;
 error:
-    ft_log(FT_LOG_INFO, "failed to reload %s", node->config_file_name);
+    err_usr_input(node, CMD_BAD_ARG);
     return EXIT_FAILURE;
 }
 
+/* stats can have 0 or many arguments */
+DECL_CMD_HANDLER(cmd_stats) {
+    t_tm_cmd *cmd = command;
+    char *args = cmd->args;
+    t_pgm *pgm;
+
+    if (cmd->args) {
+        while ((pgm = get_pgm(node, &args))) metrics_print_lat(stdout, pgm);
+    } else {
+        for (pgm = node->head; pgm; pgm = pgm->privy.next)
+            if (pgm->privy.ev != PGM_EV_DEL) metrics_print_lat(stdout, pgm);
+    }
+    fflush(stdout);
+    return EXIT_SUCCESS;
+}
+
+/* debug has 1 argument: stats, the cost of the supervisor handlers */
+DECL_CMD_HANDLER(cmd_debug) {
+    t_tm_cmd *cmd = command;
+
+    if (!cmd->args || strcmp(cmd->args, "stats")) {
+        err_usr_input(node, CMD_BAD_ARG);
+        return EXIT_FAILURE;
+    }
+    metrics_print_debug(stdout);
+    fflush(stdout);
+    return EXIT_SUCCESS;
+}
+
 /* exit has 0 argument */
 DECL_CMD_HANDLER(cmd_exit) {
     UNUSED_PARAM(command);
@@ -1032,9 +1537,16 @@ DECL_CMD_HANDLER(cmd_help) {
         "start <name>\t\tStart processes\n"
         "stop <name>\t\tStop processes\n"
         "restart <name>\t\tRestart all processes\n"
+        "scale <name> <n>\tStart or stop processes to run <n> of them\n"
         "reload\t\tReload the configuration file\n"
+        "reopen <name>\t\tRotate logs of <name> or of all programs\n"
+        "trace <subsys> on|off\tToggle timer,reaper,reload,cli tracepoints\n"
+        "events [name] [--since t] [--until t]\tQuery the lifecycle journal\n"
+        "stats [name]\t\tLatency percentiles of <name> or of all programs\n"
+        "debug stats\t\tCost of the supervisor handlers & timer lag\n"
         "status <name>\t\tGet status for <name> processes\n"
         "status\t\tGet status for all programs\n"
+        "status [--json|--format=tsv] [--state=s] [pattern]\tFor scripts\n"
         "exit\t\tExit the taskmaster shell and server.\n",
         stdout);
     fflush(stdout);
@@ -1055,15 +1567,29 @@ DECL_PGM_EV_HANDLER(restart_ev) {
     pgm->privy.ev = PGM_NO_EV;
 }
 
+/* a pgm replacing another by a hard reload waits for its procs to be down */
 DECL_PGM_EV_HANDLER(add_ev) {
-    if (pgm->privy.proc_cnt > 0 || !pgm->usr.autostart) return;
+    if (pgm->privy.roll_from || pgm->privy.proc_cnt > 0 || !pgm->usr.autostart)
+        return;
     launch_pgm(pgm);
     pgm->privy.ev = PGM_NO_EV;
 }
 
+/* a pgm replaced by a rolling reload is left to its replacement until its
+ * last proc is stopped. Otherwise it is stopped, & destroyed once its last
+ * proc is reaped: events are handled again after each SIGCHLD */
 DECL_PGM_EV_HANDLER(del_ev) {
     t_tm_node *node = get_node(NULL);
-    exit_pgm(pgm, NULL);
+    t_pgm *roll_to = pgm->privy.roll_to;
+
+    if (pgm->privy.proc_cnt) {
+        if (roll_to && roll_to->privy.ev != PGM_EV_ADD) return;
+        if (count_proc(pgm, PROC_ST_TERMINATING) < pgm->privy.proc_cnt)
+            signal_stop_pgm(pgm);
+        return;
+    }
+    safe_timer_fn_call(pgm, 0, roll_unlink);
+    safe_timer_fn_call(pgm, 0, delete_pgm_timer);
     pgm_list_remove(node, pgm);
     destroy_pgm(pgm);
 }
@@ -1072,7 +1598,7 @@ DECL_PGM_EV_HANDLER(del_ev) {
 static int32_t handle_event(t_pgm *pgm, void *arg) {
     UNUSED_PARAM(arg);
     void (*handler[PGM_MAX_EV])(t_pgm * pgm) = {no_ev, restart_ev, add_ev,
-                                                del_ev};
+                                                del_ev, roll_step};
 
     handler[pgm->privy.ev](pgm);
     return EXIT_SUCCESS;
@@ -1080,25 +1606,58 @@ static int32_t handle_event(t_pgm *pgm, void *arg) {
 
 /* ============================= client engine ============================== */
 
-/* notify any job activity then update pgm and finally handle events */
+/* notify any job activity then update pgm and finally handle events. Exec
+ * pipes are polled once the procs are reaped: a reaped proc's one is closed */
 static void pgm_notification(t_tm_node *node) {
+    int64_t start = metrics_now_us();
+
     update_pgm_status(node);
+    process_pgm(node->head, exec_poll_pgm, NULL);
     process_pgm(node->head, update_proc_ctrl, NULL);
     process_pgm(node->head, handle_event, NULL);
+    metrics_cost(COST_NOTIFICATION, "pgm_notification", start);
 }
 
 static void sighup_handler(int signb) {
+    UNUSED_PARAM(signb);
+    int64_t start = metrics_now_us();
+
+    TM_TRACE(TRACE_RELOAD, "SIGHUP received");
+    cmd_reload(get_node(NULL), NULL);
+    ft_log_flush();
+    metrics_cost(COST_CMD + CLIENT_EV_RELOAD,
+                 get_commands()[CLIENT_EV_RELOAD].name, start);
+}
+
+/* sent by the reload thread once the new generation is built */
+static void sigreload_handler(int signb) {
     UNUSED_PARAM(signb);
     t_tm_node *node = get_node(NULL);
+    int64_t start = metrics_now_us();
 
-    ft_log(FT_LOG_DEBUG, "SIGHUP received");
-    cmd_reload(node, NULL);
+    reload_commit(node);
     process_pgm(node->head, handle_event, NULL);
+    ft_log_flush();
+    metrics_cost(COST_RELOAD, "reload_commit", start);
+}
+
+static void sigmetrics_handler(int signb) {
+    UNUSED_PARAM(signb);
+    metrics_serve(get_node(NULL));
+}
+
+static void sigexec_handler(int signb) {
+    UNUSED_PARAM(signb);
+    int32_t saved_errno = errno;
+
+    process_pgm(get_node(NULL)->head, exec_poll_pgm, NULL);
+    errno = saved_errno;
 }
 
 static void sigchild_handler(int signb) {
     UNUSED_PARAM(signb);
     pgm_notification(get_node(NULL));
+    ft_log_flush();
 }
 
 /* Reset args of command */
@@ -1120,7 +1679,10 @@ static void auto_start(const t_tm_node *node) {
 static void init_sigaction(struct sigaction *sigchld_dfl_act,
                            struct sigaction *sigchld_handle_act,
                            struct sigaction *sigalrm_handle_act,
-                           struct sigaction *sighup_handle_act) {
+                           struct sigaction *sighup_handle_act,
+                           struct sigaction *sigreload_handle_act,
+                           struct sigaction *sigmetrics_handle_act,
+                           struct sigaction *sigexec_handle_act) {
     sigset_t block_mask;
 
     /* sigchld_dfl_act */
@@ -1137,6 +1699,9 @@ static void init_sigaction(struct sigaction *sigchld_dfl_act,
     sigaddset(&block_mask, SIGTTIN);
     sigaddset(&block_mask, SIGTTOU);
     sigaddset(&block_mask, SIGHUP);
+    sigaddset(&block_mask, RELOAD_SIGNAL);
+    sigaddset(&block_mask, METRICS_SIGNAL);
+    sigaddset(&block_mask, EXEC_SIGNAL);
     /* block timer-generated signal while sigchld handler runs*/
     sigaddset(&block_mask, SIGALRM);
     sigchld_handle_act->sa_mask = block_mask;
@@ -1157,46 +1722,96 @@ static void init_sigaction(struct sigaction *sigchld_dfl_act,
     sighup_handle_act->sa_mask = block_mask;
     sighup_handle_act->sa_handler = sighup_handler;
     sighup_handle_act->sa_flags = SA_RESTART;
+
+    /* sigreload_handle_act, the commit runs with every handler blocked */
+    sigreload_handle_act->sa_mask = block_mask;
+    sigreload_handle_act->sa_handler = sigreload_handler;
+    sigreload_handle_act->sa_flags = SA_RESTART;
+
+    /* sigmetrics_handle_act, the pgm list is read with every handler blocked */
+    sigmetrics_handle_act->sa_mask = block_mask;
+    sigmetrics_handle_act->sa_handler = sigmetrics_handler;
+    sigmetrics_handle_act->sa_flags = SA_RESTART;
+
+    /* sigexec_handle_act, the procs are polled with every handler blocked */
+    sigexec_handle_act->sa_mask = block_mask;
+    sigexec_handle_act->sa_handler = sigexec_handler;
+    sigexec_handle_act->sa_flags = SA_RESTART;
 }
 
 /* Main client function. Reads, sanitize & execute client input */
 uint8_t run_client(t_tm_node *node) {
     struct sigaction sigchld_dfl_act, sigchld_handle_act, sigalrm_handle_act,
-        sighup_handle_act;
+        sighup_handle_act, sigreload_handle_act, sigmetrics_handle_act,
+        sigexec_handle_act;
     t_tm_cmd *command = get_commands();
     char *line = NULL;
     int32_t hdlr_type;
+    sigset_t defer_set;
 
     get_node(node); /* init node getter */
+    if (getenv("TM_TRACE") && tm_trace_set(getenv("TM_TRACE"), true))
+        ft_log(FT_LOG_WARNING, "TM_TRACE: unknown subsystem");
     ft_log(FT_LOG_INFO, "started");
     atexit(log_exit);
 
     add_cli_completion();
 
     init_sigaction(&sigchld_dfl_act, &sigchld_handle_act, &sigalrm_handle_act,
-                   &sighup_handle_act);
+                   &sighup_handle_act, &sigreload_handle_act,
+                   &sigmetrics_handle_act, &sigexec_handle_act);
+    shr_mask_signals();
     sigaction(SIGCHLD, &sigchld_handle_act, NULL);
     sigaction(SIGALRM, &sigalrm_handle_act, NULL);
     sigaction(SIGHUP, &sighup_handle_act, NULL);
-
+    sigaction(RELOAD_SIGNAL, &sigreload_handle_act, NULL);
+    sigaction(METRICS_SIGNAL, &sigmetrics_handle_act, NULL);
+    sigaction(EXEC_SIGNAL, &sigexec_handle_act, NULL);
+    sigemptyset(&defer_set);
+    sigaddset(&defer_set, SIGHUP);
+    sigaddset(&defer_set, RELOAD_SIGNAL);
+    sigaddset(&defer_set, METRICS_SIGNAL);
+    sigaddset(&defer_set, EXEC_SIGNAL);
+    if (node->metrics_path && metrics_start(node->metrics_path))
+        ft_log(FT_LOG_WARNING, "%s: can't serve metrics: %s",
+               node->metrics_path, strerror(errno));
+    if (!node->no_watch &&
+        (conf_watch_start() || conf_include_watch()))
+        ft_log(FT_LOG_WARNING, "%s: can't watch for changes: %s",
+               node->config_file_name, strerror(errno));
+
+    /* launched as a command: the metrics handler mustn't interrupt it */
+    sigaction(SIGCHLD, &sigchld_dfl_act, NULL);
+    sigprocmask(SIG_BLOCK, &defer_set, NULL);
     auto_start(node);
+    pgm_notification(node);
+    ft_log_flush();
+    sigaction(SIGCHLD, &sigchld_handle_act, NULL);
+    sigprocmask(SIG_UNBLOCK, &defer_set, NULL);
     while (!node->exit && (line = ft_readline("taskmaster$ ")) != NULL) {
         /* avoid reentrancy problems */
         sigaction(SIGCHLD, &sigchld_dfl_act, NULL);
+        /* reload commits, metrics & exec polls wait for the command to be done */
+        sigprocmask(SIG_BLOCK, &defer_set, NULL);
         // TODO perhaps ign/dfl SIGALRM too an check timer queue at the end.
 
         ft_readline_add_history(line);
         format_user_input(line); /* maybe use this only to send to a client */
         hdlr_type = find_cmd(node, command, line);
 
+        TM_TRACE(TRACE_CLI, "'%s' -> %d", line, hdlr_type);
         if (hdlr_type >= 0) {
+            int64_t start = metrics_now_us();
             command[hdlr_type].handler(node, &command[hdlr_type]);
+            metrics_cost(COST_CMD + hdlr_type, command[hdlr_type].name, start);
         } else if (hdlr_type != CMD_EMPTY_LINE)
             err_usr_input(node, hdlr_type);
         clean_command(command);
         free(line);
         pgm_notification(node);
+        ft_log_flush();
         sigaction(SIGCHLD, &sigchld_handle_act, NULL);
+        sigprocmask(SIG_UNBLOCK, &defer_set, NULL);
     }
     return EXIT_SUCCESS;
 }
@@ -3,12 +3,13 @@
 
 #include "taskmaster.h"
 
-#define TM_CMD_NB (7)      /* number of commands of taskmaster */
+#define TM_CMD_NB (13)     /* number of commands of taskmaster */
 #define TM_CMD_BUF_SZ (32) /* buf size to store command names */
 
 typedef uint8_t (*cmd_handler)(t_tm_node *node, void *command);
 
-typedef enum cmd_flag { NO_ARGS, FREE_NB_ARGS, MANY_ARGS } t_cmd_flag;
+/* RAW_ARGS: arguments aren't program names and are parsed by the handler */
+typedef enum cmd_flag { NO_ARGS, FREE_NB_ARGS, MANY_ARGS, RAW_ARGS } t_cmd_flag;
 
 typedef struct s_tm_cmd {
     const cmd_handler handler;      /* handler for the command 'name' */
@@ -24,7 +25,13 @@ typedef enum e_client_ev {
     CLIENT_EV_START,
     CLIENT_EV_STOP,
     CLIENT_EV_RESTART,
+    CLIENT_EV_SCALE,
     CLIENT_EV_RELOAD,
+    CLIENT_EV_REOPEN,
+    CLIENT_EV_TRACE,
+    CLIENT_EV_EVENTS,
+    CLIENT_EV_STATS,
+    CLIENT_EV_DEBUG,
     CLIENT_EV_EXIT,
     CLIENT_EV_HELP,
     CLIENT_EV_MAX
@@ -48,4 +55,9 @@ typedef enum e_cmd_err {
 
 #define CMD_ERR_BUFSZ (32) /* buffer size to store error names */
 
+#define LOGROTATE_INTERVAL (5) /* seconds between two log size checks */
+
+/* raised by the exec pipe of a child once it execs, or fails to (F_SETSIG) */
+#define EXEC_SIGNAL (SIGRTMIN)
+
 #endif
@@ -0,0 +1,122 @@
+#include "san_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#include "parsing.h"
+#include "taskmaster.h"
+
+static uint32_t check_hash(const char *path, t_san_check_kind kind) {
+  return tm_hash_str(path) ^ kind;
+}
+
+/* double the hash table & rehash every check */
+static int32_t pool_grow(t_san_pool *pool) {
+  uint32_t size = pool->slots ? (pool->mask + 1) * 2 : 64, slot;
+  uint32_t *slots = calloc(size, sizeof(*slots));
+  t_san_check *checks;
+
+  if (!slots) return EXIT_FAILURE;
+  checks = realloc(pool->checks, (size / 2) * sizeof(*checks));
+  if (!checks) {
+    free(slots);
+    return EXIT_FAILURE;
+  }
+  pool->checks = checks, pool->cap = size / 2;
+  free(pool->slots);
+  pool->slots = slots, pool->mask = size - 1;
+  for (uint32_t i = 0; i < pool->nb; i++) {
+    slot = check_hash(checks[i].path, checks[i].kind) & pool->mask;
+    while (slots[slot]) slot = (slot + 1) & pool->mask;
+    slots[slot] = i + 1;
+  }
+  return EXIT_SUCCESS;
+}
+
+int32_t san_pool_add(t_san_pool *pool, const char *path,
+                     t_san_check_kind kind) {
+  uint32_t slot;
+  t_san_check *check;
+
+  if (pool->nb == pool->cap && pool_grow(pool)) return -1;
+  slot = check_hash(path, kind) & pool->mask;
+  while (pool->slots[slot]) {
+    check = &pool->checks[pool->slots[slot] - 1];
+    if (check->kind == kind && !strcmp(check->path, path))
+      return pool->slots[slot] - 1; /* shared with a previous program */
+    slot = (slot + 1) & pool->mask;
+  }
+  pool->checks[pool->nb] = (t_san_check){.path = path, .kind = kind, .fd = -1};
+  pool->slots[slot] = ++pool->nb;
+  return pool->nb - 1;
+}
+
+static void run_check(t_san_check *check) {
+  struct stat statbuf;
+
+  if (check->kind == SAN_CHECK_STAT) {
+    if (stat(check->path, &statbuf) == -1)
+      check->err = errno;
+    else
+      check->mode = statbuf.st_mode;
+  } else {
+    check->fd = open(check->path, O_WRONLY | O_CREAT | O_APPEND, LOGFILE_PERM);
+    if (check->fd == -1) check->err = errno;
+  }
+}
+
+static void *worker_routine(void *arg) {
+  t_san_pool *pool = arg;
+  uint32_t i;
+
+  while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->nb)
+    run_check(&pool->checks[i]);
+  return NULL;
+}
+
+/* the calling thread works along the pool. Signals are blocked while workers
+ * are created so that they are always handled by the calling thread. */
+void san_pool_run(t_san_pool *pool) {
+  pthread_t threads[SAN_POOL_THREADS_MAX];
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t nb = 0, max;
+  sigset_t all, old;
+
+  pool->next = 0;
+  max = (cpus > 0 && cpus < SAN_POOL_THREADS_MAX) ? cpus : SAN_POOL_THREADS_MAX;
+  if (pool->nb <= SAN_POOL_INLINE_MAX) max = 1;
+  if (max > pool->nb) max = pool->nb;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  while (nb + 1 < max &&
+         !pthread_create(&threads[nb], NULL, worker_routine, pool))
+    nb++;
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  worker_routine(pool);
+  while (nb) pthread_join(threads[--nb], NULL);
+}
+
+const t_san_check *san_pool_get(const t_san_pool *pool, int32_t id) {
+  return &pool->checks[id];
+}
+
+int32_t san_pool_fd(t_san_pool *pool, int32_t id) {
+  t_san_check *check = &pool->checks[id];
+
+  if (check->fd == -1) return -1;
+  if (check->claimed) return dup(check->fd);
+  check->claimed = true;
+  return check->fd;
+}
+
+void san_pool_destroy(t_san_pool *pool) {
+  for (uint32_t i = 0; i < pool->nb; i++)
+    if (pool->checks[i].fd > 0 && !pool->checks[i].claimed)
+      close(pool->checks[i].fd);
+  DESTROY_PTR(pool->checks);
+  DESTROY_PTR(pool->slots);
+  pool->nb = pool->cap = pool->mask = 0;
+}
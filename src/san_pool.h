@@ -0,0 +1,56 @@
+#ifndef SAN_POOL_H
+#define SAN_POOL_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Filesystem checks of sanitize_config(), run on a bounded pool of threads.
+ * Checks are first registered, identical ones (same path & kind) being merged,
+ * then run all at once. Results are read back afterwards by the caller in its
+ * own order, so that error reporting stays deterministic.
+ */
+
+#define SAN_POOL_THREADS_MAX (32)
+#define SAN_POOL_INLINE_MAX (16) /* fewer checks are run without threads */
+
+typedef enum e_san_check_kind {
+  SAN_CHECK_STAT,   /* stat() the path */
+  SAN_CHECK_APPEND, /* open() the path as an O_APPEND log file */
+} t_san_check_kind;
+
+typedef struct s_san_check {
+  const char *path; /* not owned, must outlive the pool */
+  t_san_check_kind kind;
+  int32_t err;     /* errno of the check, 0 on success */
+  mode_t mode;     /* st_mode of a successful stat */
+  int32_t fd;      /* fd of a successful open */
+  bool claimed;    /* fd has been given away by san_pool_fd() */
+} t_san_check;
+
+typedef struct s_san_pool {
+  t_san_check *checks;
+  uint32_t nb;
+  uint32_t cap;
+  uint32_t *slots; /* hash table of check indexes + 1, 0 being empty */
+  uint32_t mask;
+  uint32_t next;   /* next check to run, shared by the workers */
+} t_san_pool;
+
+/* register a check, returns its id or -1 on error */
+int32_t san_pool_add(t_san_pool *pool, const char *path, t_san_check_kind kind);
+
+/* run every registered check */
+void san_pool_run(t_san_pool *pool);
+
+const t_san_check *san_pool_get(const t_san_pool *pool, int32_t id);
+
+/* returns the fd opened by a SAN_CHECK_APPEND check. The first caller gets
+ * the fd itself, next ones a dup() of it. */
+int32_t san_pool_fd(t_san_pool *pool, int32_t id);
+
+/* close the fds nobody claimed and free the pool */
+void san_pool_destroy(t_san_pool *pool);
+
+#endif
@@ -0,0 +1,195 @@
+#include "shared.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+
+#include "taskmaster.h"
+
+#define SHR_BUCKETS_MIN (256)
+
+typedef enum e_shr_kind {
+  SHR_STR,
+  SHR_STRV,
+  SHR_I16,
+} t_shr_kind;
+
+typedef struct s_shr {
+  struct s_shr *next; /* next block of the same bucket */
+  uint64_t hash;      /* hash of kind & content */
+  uint32_t refcnt;
+  uint32_t kind;
+  uint32_t len; /* length of the content */
+  char data[] __attribute__((aligned(sizeof(void *))));
+} t_shr;
+
+static struct {
+  t_shr **buckets;
+  uint32_t mask; /* number of buckets - 1 */
+  uint32_t nb;   /* live blocks */
+  pthread_mutex_t lock;
+} table = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/* set by shr_mask_signals() on the thread whose handlers drop references */
+static __thread bool table_masked;
+
+/* on the thread whose signal handlers drop references, signals are blocked
+ * while the lock is held. The others block every signal already */
+static void table_lock(sigset_t *old) {
+  sigset_t all;
+
+  if (table_masked) {
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, old);
+  }
+  pthread_mutex_lock(&table.lock);
+}
+
+static void table_unlock(const sigset_t *old) {
+  pthread_mutex_unlock(&table.lock);
+  if (table_masked) pthread_sigmask(SIG_SETMASK, old, NULL);
+}
+
+void shr_mask_signals(void) { table_masked = true; }
+
+static t_shr *get_shr(const void *ptr) {
+  return (t_shr *)((char *)ptr - offsetof(t_shr, data));
+}
+
+/* double the buckets, or create the first ones */
+static int32_t table_grow(void) {
+  uint32_t size = table.buckets ? (table.mask + 1) * 2 : SHR_BUCKETS_MIN;
+  t_shr **buckets = calloc(size, sizeof(*buckets)), *shr, *next;
+
+  if (!buckets) return EXIT_FAILURE;
+  for (uint32_t i = 0; table.buckets && i <= table.mask; i++) {
+    for (shr = table.buckets[i]; shr; shr = next) {
+      next = shr->next;
+      shr->next = buckets[shr->hash & (size - 1)];
+      buckets[shr->hash & (size - 1)] = shr;
+    }
+  }
+  free(table.buckets);
+  table.buckets = buckets, table.mask = size - 1;
+  return EXIT_SUCCESS;
+}
+
+/* returns the live block holding content with one more reference, or a new
+ * one. *found tells which */
+static t_shr *intern(t_shr_kind kind, const void *content, uint32_t len,
+                     uint64_t hash, bool *found) {
+  t_shr *shr;
+
+  hash ^= (uint64_t)kind << 56;
+  if (table.nb >= table.mask && table_grow()) return NULL;
+  for (shr = table.buckets[hash & table.mask]; shr; shr = shr->next) {
+    if (shr->hash == hash && shr->kind == kind && shr->len == len &&
+        (!len || !memcmp(shr->data, content, len))) {
+      shr->refcnt++;
+      *found = true;
+      return shr;
+    }
+  }
+  if (!(shr = malloc(sizeof(*shr) + len))) return NULL;
+  *shr = (t_shr){.hash = hash, .refcnt = 1, .kind = kind, .len = len};
+  if (len) memcpy(shr->data, content, len);
+  shr->next = table.buckets[hash & table.mask];
+  table.buckets[hash & table.mask] = shr;
+  table.nb++;
+  *found = false;
+  return shr;
+}
+
+static void unref(void *ptr) {
+  t_shr *shr, **link;
+
+  if (!ptr || --(shr = get_shr(ptr))->refcnt) return;
+  for (link = &table.buckets[shr->hash & table.mask]; *link != shr;
+       link = &(*link)->next)
+    ;
+  *link = shr->next;
+  table.nb--;
+  if (shr->kind == SHR_STRV)
+    for (char **strv = (char **)shr->data; *strv; strv++) unref(*strv);
+  free(shr);
+}
+
+static char *intern_str(const char *str) {
+  uint32_t len = strlen(str) + 1;
+  bool found;
+  t_shr *shr = intern(SHR_STR, str, len, tm_hash_bytes(str, len), &found);
+
+  return shr ? shr->data : NULL;
+}
+
+char *shr_str(const char *str) {
+  sigset_t old;
+  char *ret;
+
+  if (!str) return NULL;
+  table_lock(&old);
+  ret = intern_str(str);
+  table_unlock(&old);
+  return ret;
+}
+
+/* the content of a strv is the pointers to its interned strings, NULL
+ * included: equal arrays hold the same pointers. Its hash is computed from
+ * the hashes of its strings, so that it doesn't depend on addresses */
+char **shr_strv(char *const *strv, uint32_t nb) {
+  char **ptrs = malloc((nb + 1) * sizeof(*ptrs));
+  uint64_t hash = tm_hash_bytes(&nb, sizeof(nb)), str_hash;
+  uint32_t i = 0;
+  bool found;
+  t_shr *shr = NULL;
+  sigset_t old;
+
+  if (!ptrs) return NULL;
+  table_lock(&old);
+  for (; i < nb; i++) {
+    if (!(ptrs[i] = intern_str(strv[i] ? strv[i] : ""))) goto end;
+    str_hash = shr_hash(ptrs[i]);
+    hash = tm_hash_bytes(&str_hash, sizeof(str_hash)) ^ (hash * 31);
+  }
+  ptrs[nb] = NULL;
+  shr = intern(SHR_STRV, ptrs, (nb + 1) * sizeof(*ptrs), hash, &found);
+  if (shr && !found) i = 0; /* the new block owns the string references */
+end:
+  while (i) unref(ptrs[--i]);
+  table_unlock(&old);
+  free(ptrs);
+  return shr ? (char **)shr->data : NULL;
+}
+
+int16_t *shr_i16(const int16_t *array, uint32_t nb) {
+  uint32_t len = nb * sizeof(*array);
+  bool found;
+  t_shr *shr;
+  sigset_t old;
+
+  table_lock(&old);
+  shr = intern(SHR_I16, array, len, tm_hash_bytes(array, len), &found);
+  table_unlock(&old);
+  return shr ? (int16_t *)shr->data : NULL;
+}
+
+uint64_t shr_hash(const void *ptr) { return ptr ? get_shr(ptr)->hash : 0; }
+
+void *shr_ref(void *ptr) {
+  sigset_t old;
+
+  if (!ptr) return NULL;
+  table_lock(&old);
+  get_shr(ptr)->refcnt++;
+  table_unlock(&old);
+  return ptr;
+}
+
+void shr_unref(void *ptr) {
+  sigset_t old;
+
+  if (!ptr) return;
+  table_lock(&old);
+  unref(ptr);
+  table_unlock(&old);
+}
@@ -0,0 +1,45 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <inttypes.h>
+
+/*
+ * Shared storage of program fields.
+ * Names, cmd, env arrays, exitcodes, log paths & workingdir are immutable
+ * reference counted blocks, hash-consed in a table: building a value identical
+ * to a live one returns the live block with one more reference, so that
+ * programs sharing a template, an anchor or just the same settings store them
+ * once, across reload generations too. The strings of an array are interned
+ * on their own, so that arrays differing by one entry share the others. Two
+ * shared values are equal if and only if they are the same pointer. A block
+ * is never modified in place: changing a field means building a new block &
+ * dropping the reference on the old one.
+ * The table is locked, so that the reload thread can build a generation while
+ * the main thread drops references, signal handlers included.
+ */
+
+/* the signal handlers of the calling thread drop references from now on:
+ * signals are blocked on it while the table is locked */
+void shr_mask_signals(void);
+
+/* shared copy of str */
+char *shr_str(const char *str);
+
+/* shared NULL terminated copy of the nb strings of strv */
+char **shr_strv(char *const *strv, uint32_t nb);
+
+/* shared copy of the nb integers of array */
+int16_t *shr_i16(const int16_t *array, uint32_t nb);
+
+/* hash of the content of a shared block, computed once at creation. Stable
+ * across runs: it doesn't depend on addresses. 0 for NULL */
+uint64_t shr_hash(const void *ptr);
+
+/* add a reference to a shared block, returns it. NULL is ignored */
+void *shr_ref(void *ptr);
+
+/* drop a reference to a shared block, which is freed with the last one. NULL
+ * is ignored */
+void shr_unref(void *ptr);
+
+#endif
@@ -0,0 +1,330 @@
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shared.h"
+
+#define SNAPSHOT_PERM (0644)
+
+/* growable output buffer, offsets are relative to its start */
+typedef struct s_snap_buf {
+  uint8_t *data;
+  size_t len;
+  size_t cap;
+  bool err;
+} t_snap_buf;
+
+/* ================================== key =================================== */
+
+int32_t snapshot_key(const t_tm_node *node, t_snapshot_key *key) {
+  struct stat statbuf;
+  void *map = NULL;
+  int32_t fd;
+
+  if (!node->config_file_stream || !node->config_file_name)
+    return EXIT_FAILURE;
+  fd = fileno(node->config_file_stream);
+  if (fstat(fd, &statbuf) == -1 || !S_ISREG(statbuf.st_mode))
+    return EXIT_FAILURE;
+  if (statbuf.st_size) {
+    map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return EXIT_FAILURE;
+  }
+  key->path_hash = tm_hash_str(node->config_file_name);
+  key->hash = tm_hash_bytes(map, statbuf.st_size);
+  key->size = statbuf.st_size;
+  key->mtime_sec = statbuf.st_mtim.tv_sec;
+  key->mtime_nsec = statbuf.st_mtim.tv_nsec;
+  if (map) munmap(map, statbuf.st_size);
+  return EXIT_SUCCESS;
+}
+
+/* ================================= save =================================== */
+
+/* append len bytes of src aligned on align, returns their offset */
+static uint32_t buf_put(t_snap_buf *buf, const void *src, size_t len,
+                        size_t align) {
+  size_t off = (buf->len + align - 1) & ~(align - 1), cap = buf->cap;
+  uint8_t *data;
+
+  if (buf->err) return 0;
+  while (off + len > cap) cap = cap ? cap * 2 : 4096;
+  if (off + len > UINT32_MAX) {
+    buf->err = true;
+    return 0;
+  }
+  if (cap != buf->cap) {
+    if (!(data = realloc(buf->data, cap))) {
+      buf->err = true;
+      return 0;
+    }
+    buf->data = data, buf->cap = cap;
+  }
+  if (src)
+    memcpy(buf->data + off, src, len);
+  else
+    memset(buf->data + off, 0, len);
+  memset(buf->data + buf->len, 0, off - buf->len); /* padding */
+  buf->len = off + len;
+  return off;
+}
+
+static uint32_t put_str(t_snap_buf *buf, const char *str) {
+  if (!str) return 0;
+  return buf_put(buf, str, strlen(str) + 1, 1);
+}
+
+/* store an array of nb strings (NULL entries allowed) */
+static uint32_t put_str_array(t_snap_buf *buf, char *const *arr, uint32_t nb) {
+  uint32_t off, str_off;
+
+  if (!arr) return 0;
+  off = buf_put(buf, NULL, nb * sizeof(uint32_t), sizeof(uint32_t));
+  for (uint32_t i = 0; i < nb && !buf->err; i++) {
+    str_off = put_str(buf, arr[i]);
+    if (!buf->err) memcpy(buf->data + off + i * sizeof(uint32_t), &str_off,
+                          sizeof(str_off));
+  }
+  return off;
+}
+
+static void put_pgm(t_snap_buf *buf, uint32_t rec_off, const t_pgm_usr *usr) {
+  t_snapshot_pgm rec = {0};
+
+  rec.name = put_str(buf, usr->name);
+  rec.std_out = put_str(buf, usr->std_out);
+  rec.std_err = put_str(buf, usr->std_err);
+  rec.workingdir = put_str(buf, usr->workingdir);
+  while (usr->cmd && usr->cmd[rec.cmd_nb]) rec.cmd_nb++;
+  rec.cmd = put_str_array(buf, usr->cmd, rec.cmd_nb);
+  rec.env_nb = usr->env.array_size;
+  rec.env = put_str_array(buf, usr->env.array_val, rec.env_nb);
+  rec.exitcodes_nb = usr->exitcodes.array_size;
+  if (usr->exitcodes.array_val)
+    rec.exitcodes = buf_put(buf, usr->exitcodes.array_val,
+                            rec.exitcodes_nb * sizeof(int16_t),
+                            sizeof(int16_t));
+  rec.out_maxbytes = usr->out_rotate.maxbytes;
+  rec.out_backups = usr->out_rotate.backups;
+  rec.out_compress = usr->out_rotate.compress;
+  rec.err_maxbytes = usr->err_rotate.maxbytes;
+  rec.err_backups = usr->err_rotate.backups;
+  rec.err_compress = usr->err_rotate.compress;
+  rec.numprocs = usr->numprocs;
+  rec.max_unavailable = usr->max_unavailable;
+  rec.max_surge = usr->max_surge;
+  rec.umask = usr->umask;
+  rec.autorestart = usr->autorestart;
+  rec.startretries = usr->startretries;
+  rec.autostart = usr->autostart;
+  rec.stopsignal = usr->stopsignal;
+  rec.starttime = usr->starttime;
+  rec.stoptime = usr->stoptime;
+  if (!buf->err) memcpy(buf->data + rec_off, &rec, sizeof(rec));
+}
+
+/* write into a temporary file renamed over path, so that a concurrent start
+ * never maps a partial snapshot */
+static int32_t write_snapshot(const char *path, const t_snap_buf *buf) {
+  char tmp[PATH_MAX];
+  int32_t fd;
+  ssize_t wr = 0;
+
+  snprintf(tmp, PATH_MAX, "%s.%d", path, getpid());
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, SNAPSHOT_PERM);
+  if (fd == -1) return EXIT_FAILURE;
+  for (size_t off = 0; off < buf->len && wr >= 0; off += wr)
+    wr = write(fd, buf->data + off, buf->len - off);
+  if (close(fd) == -1 || wr < 0 || rename(tmp, path) == -1) {
+    unlink(tmp);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int32_t snapshot_save(const t_tm_node *node, const char *path,
+                      const t_snapshot_key *key) {
+  t_snap_buf buf = {0};
+  t_snapshot_hdr hdr = {.version = SNAPSHOT_VERSION, .key = *key};
+  uint32_t rec_off, i = 0;
+  int32_t ret = EXIT_FAILURE;
+
+  memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  for (t_pgm *pgm = node->head; pgm; pgm = pgm->privy.next) hdr.pgm_nb++;
+  buf_put(&buf, NULL, sizeof(hdr), 8);
+  rec_off = buf_put(&buf, NULL, hdr.pgm_nb * sizeof(t_snapshot_pgm), 8);
+  for (t_pgm *pgm = node->head; pgm; pgm = pgm->privy.next, i++)
+    put_pgm(&buf, rec_off + i * sizeof(t_snapshot_pgm), &pgm->usr);
+  if (buf.err) goto end;
+  hdr.size = buf.len;
+  hdr.checksum = tm_hash_bytes(buf.data + sizeof(hdr), buf.len - sizeof(hdr));
+  memcpy(buf.data, &hdr, sizeof(hdr));
+  ret = write_snapshot(path, &buf);
+end:
+  free(buf.data);
+  return ret;
+}
+
+/* ================================= load =================================== */
+
+/* returns a copy of the string at off, checking it lies in the snapshot */
+static char *get_str(const uint8_t *map, size_t size, uint32_t off,
+                     bool *err) {
+  char *str;
+
+  if (!off || *err) return NULL;
+  if (off >= size || !memchr(map + off, 0, size - off)) {
+    *err = true;
+    return NULL;
+  }
+  if (!(str = strdup((const char *)map + off))) *err = true;
+  return str;
+}
+
+/* returns a NULL terminated copy of the string array at off */
+static char **get_str_array(const uint8_t *map, size_t size, uint32_t off,
+                            uint32_t nb, bool *err) {
+  char **arr;
+  uint32_t str_off;
+
+  if (!off || *err) return NULL;
+  if (off + (uint64_t)nb * sizeof(uint32_t) > size ||
+      !(arr = calloc(nb + 1, sizeof(*arr)))) {
+    *err = true;
+    return NULL;
+  }
+  for (uint32_t i = 0; i < nb; i++) {
+    memcpy(&str_off, map + off + i * sizeof(uint32_t), sizeof(str_off));
+    arr[i] = get_str(map, size, str_off, err);
+  }
+  return arr;
+}
+
+/* returns a shared copy of the string at off */
+static char *get_shared_str(const uint8_t *map, size_t size, uint32_t off,
+                            bool *err) {
+  char *str;
+
+  if (!off || *err) return NULL;
+  if (off >= size || !memchr(map + off, 0, size - off)) {
+    *err = true;
+    return NULL;
+  }
+  if (!(str = shr_str((const char *)map + off))) *err = true;
+  return str;
+}
+
+/* returns a shared copy of the string array at off */
+static char **get_shared_str_array(const uint8_t *map, size_t size,
+                                   uint32_t off, uint32_t nb, bool *err) {
+  char **arr = get_str_array(map, size, off, nb, err), **shared = NULL;
+
+  if (arr && !*err && !(shared = shr_strv(arr, nb))) *err = true;
+  for (uint32_t i = 0; arr && i < nb; i++) free(arr[i]);
+  free(arr);
+  return shared;
+}
+
+static t_pgm *get_pgm(const uint8_t *map, size_t size,
+                      const t_snapshot_pgm *rec) {
+  t_pgm *pgm = calloc(1, sizeof(*pgm));
+  t_pgm_usr *usr;
+  bool err = false;
+
+  if (!pgm) return NULL;
+  usr = &pgm->usr;
+  usr->name = get_shared_str(map, size, rec->name, &err);
+  usr->std_out = get_shared_str(map, size, rec->std_out, &err);
+  usr->std_err = get_shared_str(map, size, rec->std_err, &err);
+  usr->workingdir = get_shared_str(map, size, rec->workingdir, &err);
+  usr->cmd = get_shared_str_array(map, size, rec->cmd, rec->cmd_nb, &err);
+  usr->env.array_val =
+      get_shared_str_array(map, size, rec->env, rec->env_nb, &err);
+  usr->env.array_size = rec->env_nb;
+  if (rec->exitcodes && !err) {
+    if (rec->exitcodes + (uint64_t)rec->exitcodes_nb * sizeof(int16_t) > size ||
+        !(usr->exitcodes.array_val =
+              shr_i16((const int16_t *)(map + rec->exitcodes),
+                      rec->exitcodes_nb)))
+      err = true;
+    usr->exitcodes.array_size = rec->exitcodes_nb;
+  }
+  usr->out_rotate = (t_log_rotate){rec->out_maxbytes, rec->out_backups,
+                                   rec->out_compress};
+  usr->err_rotate = (t_log_rotate){rec->err_maxbytes, rec->err_backups,
+                                   rec->err_compress};
+  usr->numprocs = rec->numprocs;
+  usr->max_unavailable = rec->max_unavailable;
+  usr->max_surge = rec->max_surge;
+  usr->umask = rec->umask;
+  usr->autorestart = rec->autorestart;
+  usr->startretries = rec->startretries;
+  usr->autostart = rec->autostart;
+  usr->stopsignal = rec->stopsignal;
+  usr->starttime = rec->starttime;
+  usr->stoptime = rec->stoptime;
+  if (err || !usr->name) {
+    destroy_pgm(pgm);
+    return NULL;
+  }
+  return pgm;
+}
+
+static bool valid_snapshot(const uint8_t *map, size_t size,
+                           const t_snapshot_key *key) {
+  const t_snapshot_hdr *hdr = (const t_snapshot_hdr *)map;
+
+  return (size >= sizeof(*hdr) &&
+          !memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) &&
+          hdr->version == SNAPSHOT_VERSION && hdr->size == size &&
+          !memcmp(&hdr->key, key, sizeof(*key)) &&
+          sizeof(*hdr) + (uint64_t)hdr->pgm_nb * sizeof(t_snapshot_pgm) <=
+              size &&
+          hdr->checksum ==
+              tm_hash_bytes(map + sizeof(*hdr), size - sizeof(*hdr)));
+}
+
+int32_t snapshot_load(t_tm_node *node, const char *path,
+                      const t_snapshot_key *key) {
+  struct stat statbuf;
+  const t_snapshot_hdr *hdr;
+  t_snapshot_pgm rec;
+  t_pgm *pgm, *tail = NULL;
+  uint8_t *map;
+  int32_t fd, ret = EXIT_FAILURE;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) return EXIT_FAILURE;
+  if (fstat(fd, &statbuf) == -1 || !statbuf.st_size) {
+    close(fd);
+    return EXIT_FAILURE;
+  }
+  map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return EXIT_FAILURE;
+  if (!valid_snapshot(map, statbuf.st_size, key)) goto end;
+
+  hdr = (const t_snapshot_hdr *)map;
+  for (uint32_t i = 0; i < hdr->pgm_nb; i++) {
+    memcpy(&rec, map + sizeof(*hdr) + i * sizeof(rec), sizeof(rec));
+    if (!(pgm = get_pgm(map, statbuf.st_size, &rec))) {
+      destroy_pgm_list(node->head);
+      node->head = NULL, node->pgm_nb = 0;
+      goto end;
+    }
+    if (tail)
+      tail->privy.next = pgm;
+    else
+      node->head = pgm;
+    tail = pgm;
+    node->pgm_nb++;
+  }
+  fclose(node->config_file_stream);
+  node->config_file_stream = NULL;
+  ret = EXIT_SUCCESS;
+end:
+  munmap(map, statbuf.st_size);
+  return ret;
+}
@@ -0,0 +1,78 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "taskmaster.h"
+
+/*
+ * Compiled configuration snapshot.
+ * Once a configuration file has been loaded & validated, its program table is
+ * serialized into a flat binary file, keyed by the configuration file path,
+ * size, mtime & content hash. At next start, if the key still matches, the
+ * snapshot is mapped and the program table is rebuilt from it without going
+ * through libyaml. All offsets are relative to the start of the file, 0
+ * standing for NULL.
+ */
+
+#define SNAPSHOT_MAGIC "TMSNAP"
+#define SNAPSHOT_VERSION (3)
+
+typedef struct s_snapshot_key {
+  uint64_t path_hash;  /* configuration file name given to taskmaster */
+  uint64_t hash;       /* content of the configuration file */
+  uint64_t size;       /* size of the configuration file */
+  int64_t mtime_sec;   /* mtime of the configuration file */
+  int64_t mtime_nsec;
+} t_snapshot_key;
+
+typedef struct s_snapshot_hdr {
+  char magic[8];
+  uint32_t version;
+  uint32_t pgm_nb;     /* t_snapshot_pgm following the header */
+  t_snapshot_key key;
+  uint64_t size;       /* size of the whole file */
+  uint64_t checksum;   /* hash of everything after the header */
+} t_snapshot_hdr;
+
+typedef struct s_snapshot_pgm {
+  uint64_t out_maxbytes;
+  uint64_t err_maxbytes;
+  uint32_t name;       /* offset of strings */
+  uint32_t std_out;
+  uint32_t std_err;
+  uint32_t workingdir;
+  uint32_t cmd;        /* offset of an array of cmd_nb string offsets */
+  uint32_t cmd_nb;
+  uint32_t env;        /* offset of an array of env_nb string offsets */
+  uint32_t env_nb;
+  uint32_t exitcodes;  /* offset of an array of exitcodes_nb int16_t */
+  uint32_t exitcodes_nb;
+  uint32_t umask;
+  uint32_t autorestart;
+  uint32_t starttime;
+  uint32_t stoptime;
+  uint16_t numprocs;
+  uint16_t max_unavailable;
+  uint16_t max_surge;
+  uint8_t startretries;
+  uint8_t autostart;
+  uint8_t out_backups;
+  uint8_t err_backups;
+  uint8_t out_compress;
+  uint8_t err_compress;
+  t_signal stopsignal;
+} t_snapshot_pgm;
+
+/* fill key from the configuration stream of node, without moving it */
+int32_t snapshot_key(const t_tm_node *node, t_snapshot_key *key);
+
+/* load the program table of node from path if its key matches. The
+ * configuration stream is closed on success, like load_config_file() does.
+ * Returns 1 if the snapshot is missing, stale or corrupted. */
+int32_t snapshot_load(t_tm_node *node, const char *path,
+                      const t_snapshot_key *key);
+
+/* serialize the validated program table of node into path */
+int32_t snapshot_save(const t_tm_node *node, const char *path,
+                      const t_snapshot_key *key);
+
+#endif
@@ -0,0 +1,227 @@
+#include "status.h"
+
+#include <fnmatch.h>
+
+#include "metrics.h"
+#include "proc_sample.h"
+#include "strbuf.h"
+
+static const char st_names[PROC_ST_MAX + 1][16] = {"starting", "running",
+                                                   "terminating", "stopped"};
+
+static t_strbuf out; /* reused by every status */
+
+int32_t status_parse(char *args, t_status_query *query) {
+  char *arg, *save = NULL;
+  uint32_t max = 1;
+
+  *query = (t_status_query){.fmt = STATUS_FMT_TEXT, .state = STATUS_ANY};
+  if (!args) return EXIT_SUCCESS;
+  for (const char *c = args; *c; c++) max += *c == ' ';
+  if (!(query->patterns = malloc(max * sizeof(*query->patterns))))
+    return EXIT_FAILURE;
+  for (arg = strtok_r(args, " ", &save); arg;
+       arg = strtok_r(NULL, " ", &save)) {
+    if (!strcmp(arg, "--json") || !strcmp(arg, "--format=json")) {
+      query->fmt = STATUS_FMT_JSON;
+    } else if (!strcmp(arg, "--format=tsv")) {
+      query->fmt = STATUS_FMT_TSV;
+    } else if (!strcmp(arg, "--format=text")) {
+      query->fmt = STATUS_FMT_TEXT;
+    } else if (!strncmp(arg, "--state=", 8)) {
+      query->state = STATUS_ANY;
+      for (int32_t st = 0; st <= STATUS_STOPPED; st++)
+        if (!strcmp(arg + 8, st_names[st])) query->state = st;
+      if (query->state == STATUS_ANY) goto error;
+    } else if (arg[0] == '-') {
+      goto error;
+    } else {
+      query->patterns[query->pattern_nb++] = arg;
+    }
+  }
+  return EXIT_SUCCESS;
+error:
+  status_query_destroy(query);
+  return EXIT_FAILURE;
+}
+
+void status_query_destroy(t_status_query *query) {
+  DESTROY_PTR(query->patterns);
+  query->pattern_nb = 0;
+}
+
+/* ------------------------------- selection -------------------------------- */
+
+/* programs being replaced are only selected when no pattern is given */
+static bool select_pgm(const t_pgm *pgm, const t_status_query *query) {
+  if (!query->pattern_nb) return true;
+  if (pgm->privy.ev == PGM_EV_DEL) return false;
+  for (uint32_t i = 0; i < query->pattern_nb; i++)
+    if (!fnmatch(query->patterns[i], pgm->usr.name, 0)) return true;
+  return false;
+}
+
+static bool select_proc(const t_process *proc, const t_status_query *query) {
+  return query->state == STATUS_ANY || (int32_t)proc->state == query->state;
+}
+
+/* with a state filter, programs without any process in it are left out */
+static bool select_state(const t_pgm *pgm, const t_status_query *query) {
+  if (query->state == STATUS_ANY) return true;
+  if (query->state == STATUS_STOPPED) return !pgm->privy.proc_head;
+  for (t_process *proc = pgm->privy.proc_head; proc; proc = proc->next)
+    if (select_proc(proc, query)) return true;
+  return false;
+}
+
+/* a pattern without wildcard must name a program, as the names given to
+ * the other commands */
+static int32_t check_names(const t_tm_node *node, const t_status_query *query) {
+  const char *pattern;
+  const t_pgm *pgm;
+
+  for (uint32_t i = 0; i < query->pattern_nb; i++) {
+    pattern = query->patterns[i];
+    if (strpbrk(pattern, "*?[")) continue;
+    for (pgm = node->head; pgm; pgm = pgm->privy.next)
+      if (pgm->privy.ev != PGM_EV_DEL && !strcmp(pgm->usr.name, pattern))
+        break;
+    if (!pgm) return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/* -------------------------------- formats --------------------------------- */
+
+static void text_pgm(const t_pgm *pgm, const t_status_query *query) {
+  bool procs = query->pattern_nb || query->state != STATUS_ANY;
+
+  strbuf_printf(&out, "- [%d] %s: <%d/%d> started%s\n", pgm->privy.pgid,
+                pgm->usr.name, pgm->privy.proc_cnt, pgm->usr.numprocs,
+                pgm->privy.roll_to ? ", being replaced" : "");
+  for (t_process *proc = pgm->privy.proc_head; procs && proc;
+       proc = proc->next) {
+    if (!select_proc(proc, query)) continue;
+    strbuf_printf(&out, "pid <%d> - %s - restarted <%d/%d> times", proc->pid,
+                  st_names[proc->state], proc->restart_cnt - 1,
+                  pgm->usr.startretries);
+    proc_sample_print(&out, proc);
+    strbuf_printf(&out, "\n");
+  }
+}
+
+static void json_proc(const t_process *proc, int64_t now) {
+  const t_proc_res *res = &proc->res;
+
+  strbuf_printf(&out,
+                "{\"pid\":%d,\"state\":\"%s\",\"restarts\":%d,"
+                "\"state_seconds\":%.3f",
+                proc->pid, st_names[proc->state], proc->restart_cnt - 1,
+                (now - proc->since) / 1000.0);
+  if (res->n)
+    strbuf_printf(&out,
+                  ",\"cpu\":%.1f,\"cpu_avg\":%.1f,\"rss_kb\":%" PRIu64
+                  ",\"rss_avg_kb\":%.0f,\"threads\":%u,\"fds\":%u,"
+                  "\"ctxsw\":%" PRIu64 ",\"nvctxsw\":%" PRIu64,
+                  res->cpu, res->cpu_avg, res->rss_kb, res->rss_avg,
+                  res->threads, res->fds, res->vcsw, res->ivcsw);
+  strbuf_printf(&out, "}");
+}
+
+static void json_pgm(const t_pgm *pgm, const t_status_query *query,
+                     int64_t now, bool first) {
+  bool first_proc = true;
+
+  strbuf_printf(&out, "%s{\"name\":\"", first ? "" : ",");
+  strbuf_json_str(&out, pgm->usr.name);
+  strbuf_printf(&out,
+                "\",\"pgid\":%d,\"numprocs\":%u,\"procs\":%d,"
+                "\"replaced\":%s,\"processes\":[",
+                pgm->privy.pgid, pgm->usr.numprocs, pgm->privy.proc_cnt,
+                pgm->privy.roll_to ? "true" : "false");
+  for (t_process *proc = pgm->privy.proc_head; proc; proc = proc->next) {
+    if (!select_proc(proc, query)) continue;
+    if (!first_proc) strbuf_printf(&out, ",");
+    json_proc(proc, now);
+    first_proc = false;
+  }
+  strbuf_printf(&out, "]}");
+}
+
+/* program names are YAML keys & may hold anything but a NUL */
+static void tsv_name(const char *name) {
+  for (const char *c = name; *c; c++) {
+    if (*c == '\t')
+      strbuf_printf(&out, "\\t");
+    else if (*c == '\n')
+      strbuf_printf(&out, "\\n");
+    else if (*c == '\\')
+      strbuf_printf(&out, "\\\\");
+    else
+      strbuf_printf(&out, "%c", *c);
+  }
+}
+
+/* a row per process, or a stopped row for a program without any */
+static void tsv_pgm(const t_pgm *pgm, const t_status_query *query,
+                    int64_t now) {
+  const t_proc_res *res;
+
+  if (!pgm->privy.proc_head) {
+    tsv_name(pgm->usr.name);
+    strbuf_printf(&out, "\t%d\t%u\t0\t%s\t\t\t\t\t\t\t\t\t\t\n",
+                  pgm->privy.pgid, pgm->usr.numprocs,
+                  st_names[STATUS_STOPPED]);
+    return;
+  }
+  for (t_process *proc = pgm->privy.proc_head; proc; proc = proc->next) {
+    if (!select_proc(proc, query)) continue;
+    res = &proc->res;
+    tsv_name(pgm->usr.name);
+    strbuf_printf(&out, "\t%d\t%u\t%d\t%s\t%d\t%.3f", pgm->privy.pgid,
+                  pgm->usr.numprocs, proc->pid, st_names[proc->state],
+                  proc->restart_cnt - 1, (now - proc->since) / 1000.0);
+    if (res->n)
+      strbuf_printf(&out,
+                    "\t%.1f\t%.1f\t%" PRIu64 "\t%.0f\t%u\t%u\t%" PRIu64
+                    "\t%" PRIu64 "\n",
+                    res->cpu, res->cpu_avg, res->rss_kb, res->rss_avg,
+                    res->threads, res->fds, res->vcsw, res->ivcsw);
+    else
+      strbuf_printf(&out, "\t\t\t\t\t\t\t\t\n");
+  }
+}
+
+int32_t status_write(FILE *stream, const t_tm_node *node,
+                     const t_status_query *query) {
+  int64_t now = metrics_now_ms();
+  bool first = true;
+
+  if (check_names(node, query)) return EXIT_FAILURE;
+  out.len = 0, out.err = false;
+  if (query->fmt == STATUS_FMT_JSON) strbuf_printf(&out, "{\"programs\":[");
+  if (query->fmt == STATUS_FMT_TSV)
+    strbuf_printf(&out,
+                  "program\tpgid\tnumprocs\tpid\tstate\trestarts\t"
+                  "state_seconds\tcpu\tcpu_avg\trss_kb\trss_avg_kb\tthreads\t"
+                  "fds\tctxsw\tnvctxsw\n");
+  for (const t_pgm *pgm = node->head; pgm; pgm = pgm->privy.next) {
+    if (!select_pgm(pgm, query) || !select_state(pgm, query)) continue;
+    if (query->fmt == STATUS_FMT_JSON)
+      json_pgm(pgm, query, now, first);
+    else if (query->fmt == STATUS_FMT_TSV)
+      tsv_pgm(pgm, query, now);
+    else
+      text_pgm(pgm, query);
+    first = false;
+  }
+  if (query->fmt == STATUS_FMT_JSON) strbuf_printf(&out, "]}\n");
+  if (out.err) {
+    DESTROY_PTR(out.data);
+    out.cap = out.len = 0;
+    return EXIT_FAILURE;
+  }
+  fwrite(out.data, 1, out.len, stream);
+  fflush(stream);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,43 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include "taskmaster.h"
+
+/*
+ * status command output.
+ * The programs selected by name patterns & process state are rendered in a
+ * buffer kept from a call to the next, then written in one call: as the
+ * lines of the interactive shell, as JSON or as a tab separated table with a
+ * row per process, for scripts.
+ */
+
+typedef enum e_status_fmt {
+  STATUS_FMT_TEXT,
+  STATUS_FMT_JSON,
+  STATUS_FMT_TSV,
+} t_status_fmt;
+
+#define STATUS_ANY (-1)            /* no filter on the state */
+#define STATUS_STOPPED PROC_ST_MAX /* programs without processes */
+
+typedef struct s_status_query {
+  t_status_fmt fmt;
+  int32_t state;    /* STATUS_ANY, a t_proc_state or STATUS_STOPPED */
+  char **patterns;  /* fnmatch() patterns of program names */
+  uint32_t pattern_nb; /* none: every program */
+} t_status_query;
+
+/* fill query from the arguments of status, which are split in place:
+ * [--json | --format=text|json|tsv] [--state=<state>] [pattern ...].
+ * Returns EXIT_FAILURE on a bad argument */
+int32_t status_parse(char *args, t_status_query *query);
+
+void status_query_destroy(t_status_query *query);
+
+/* write the status of the programs of node selected by query to stream.
+ * Returns EXIT_FAILURE if a pattern without wildcard names no program, or if
+ * the output can't be allocated */
+int32_t status_write(FILE *stream, const t_tm_node *node,
+                     const t_status_query *query);
+
+#endif
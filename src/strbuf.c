@@ -0,0 +1,39 @@
+#include "strbuf.h"
+
+#include <stdarg.h>
+
+void strbuf_printf(t_strbuf *buf, const char *format, ...) {
+  va_list args;
+  size_t cap;
+  char *data;
+  int32_t len;
+
+  while (!buf->err) {
+    va_start(args, format);
+    len = vsnprintf(buf->data + buf->len, buf->cap - buf->len, format, args);
+    va_end(args);
+    if (len < 0) {
+      buf->err = true;
+    } else if ((size_t)len < buf->cap - buf->len) {
+      buf->len += len;
+      return;
+    }
+    cap = buf->cap ? buf->cap * 2 : STRBUF_MIN;
+    while (cap - buf->len <= (size_t)len) cap *= 2;
+    if (!(data = realloc(buf->data, cap)))
+      buf->err = true;
+    else
+      buf->data = data, buf->cap = cap;
+  }
+}
+
+void strbuf_json_str(t_strbuf *buf, const char *str) {
+  for (const char *c = str; *c; c++) {
+    if (*c == '\\' || *c == '"')
+      strbuf_printf(buf, "\\%c", *c);
+    else if ((unsigned char)*c < 0x20)
+      strbuf_printf(buf, "\\u%04x", *c);
+    else
+      strbuf_printf(buf, "%c", *c);
+  }
+}
@@ -0,0 +1,26 @@
+#ifndef STRBUF_H
+#define STRBUF_H
+
+#include "taskmaster.h"
+
+/*
+ * Growing string buffer, for output rendered at once & written in one call.
+ * An allocation failure sets err & drops whatever is appended afterwards.
+ */
+
+#define STRBUF_MIN (4096)
+
+typedef struct s_strbuf {
+  char *data;
+  size_t len;
+  size_t cap;
+  bool err; /* an allocation failed, data is dropped */
+} t_strbuf;
+
+void strbuf_printf(t_strbuf *buf, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* append str as the content of a JSON string, quotes excluded */
+void strbuf_json_str(t_strbuf *buf, const char *str);
+
+#endif
@@ -0,0 +1,64 @@
+#include "trace.h"
+
+#include <stdarg.h>
+
+#include "ft_log.h"
+#include "taskmaster.h"
+
+#define TRACE_FMT_BUF_SZ (256)
+
+uint32_t tm_trace_mask;
+
+static const char trace_names[TRACE_SUBSYS_NB][TRACE_NAME_BUF_SZ] = {
+    "timer\0",
+    "reaper\0",
+    "reload\0",
+    "cli\0",
+};
+
+void tm_trace_emit(uint32_t subsys, const char *format, ...) {
+  char fmt[TRACE_FMT_BUF_SZ];
+  va_list args;
+  int32_t i = 0;
+
+  while (i < TRACE_SUBSYS_NB - 1 && !(subsys & (1 << i))) i++;
+  snprintf(fmt, sizeof(fmt), "[%s] %s", trace_names[i], format);
+  va_start(args, format);
+  ft_vlog(FT_LOG_DEBUG, fmt, args);
+  va_end(args);
+}
+
+static uint32_t find_subsys(const char *name, size_t len) {
+  if (len == 3 && !strncmp(name, "all", 3)) return TRACE_ALL;
+  for (int32_t i = 0; i < TRACE_SUBSYS_NB; i++)
+    if (strlen(trace_names[i]) == len && !strncmp(trace_names[i], name, len))
+      return (1 << i);
+  return 0;
+}
+
+int32_t tm_trace_set(const char *names, bool on) {
+  uint32_t mask = 0, subsys;
+  size_t len;
+
+  while (*names) {
+    len = strcspn(names, ", ");
+    if (!(subsys = find_subsys(names, len))) return EXIT_FAILURE;
+    mask |= subsys;
+    names += len;
+    names += strspn(names, ", ");
+  }
+  if (on)
+    tm_trace_mask |= mask;
+  else
+    tm_trace_mask &= ~mask;
+  return EXIT_SUCCESS;
+}
+
+void tm_trace_status(char *buf, size_t size) {
+  size_t len = 0;
+
+  buf[0] = 0;
+  for (int32_t i = 0; i < TRACE_SUBSYS_NB && len < size; i++)
+    len += snprintf(buf + len, size - len, "%s: %s\n", trace_names[i],
+                    (tm_trace_mask & (1 << i)) ? "on" : "off");
+}
@@ -0,0 +1,54 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Static tracepoints. In the 'prod' target (PRODUCTION) a tracepoint compiles
+ * to nothing: arguments are type-checked but never evaluated. Otherwise it is a
+ * single unlikely branch on tm_trace_mask, and the message is only formatted
+ * and logged at FT_LOG_DEBUG level when its subsystem is enabled, either at
+ * launch with the TM_TRACE environment variable (ex: TM_TRACE=timer,reload)
+ * or at runtime with the 'trace' command.
+ */
+
+typedef enum e_trace_subsys {
+  TRACE_TIMER = (1 << 0),  /* timers add, fire & deletion */
+  TRACE_REAPER = (1 << 1), /* children status collection */
+  TRACE_RELOAD = (1 << 2), /* configuration reload decisions */
+  TRACE_CLI = (1 << 3),    /* client commands */
+  TRACE_SUBSYS_NB = 4,
+  TRACE_ALL = (1 << TRACE_SUBSYS_NB) - 1,
+} t_trace_subsys;
+
+#define TRACE_NAME_BUF_SZ (16) /* buffer size to store a subsystem name */
+
+extern uint32_t tm_trace_mask; /* enabled subsystems */
+
+#ifdef PRODUCTION
+#define TM_TRACE(subsys, ...)                    \
+  do {                                           \
+    if (0) tm_trace_emit((subsys), __VA_ARGS__); \
+  } while (0)
+#else
+#define TM_TRACE(subsys, ...)                          \
+  do {                                                 \
+    if (__builtin_expect(tm_trace_mask & (subsys), 0)) \
+      tm_trace_emit((subsys), __VA_ARGS__);            \
+  } while (0)
+#endif
+
+/* format & log a tracepoint, prefixed with its subsystem name */
+void tm_trace_emit(uint32_t subsys, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* enable ('on') or disable a comma separated list of subsystem names, or
+ * 'all'. Returns 1 if a name is unknown */
+int32_t tm_trace_set(const char *names, bool on);
+
+/* write each subsystem name and state into buf */
+void tm_trace_status(char *buf, size_t size);
+
+#endif
@@ -0,0 +1,353 @@
+#include "bench.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_STOP_TIMEOUT_MS (10000)
+
+static int usage(const t_bench *bench, const char *name) {
+  fprintf(stderr, "Usage: %s -t taskmaster -d daemon [-r runs] %s\n  %s\n",
+          name, bench->args, bench->help);
+  return EXIT_FAILURE;
+}
+
+int bench_main(const t_bench *bench, int ac, char **av) {
+  const char *bin = NULL, *daemon = NULL;
+  int opt, runs = 1, first = 1, fails = 0, ok;
+  char desc[128], opts[64];
+
+  snprintf(opts, sizeof(opts), "t:d:r:%s", bench->opts ? bench->opts : "");
+  while ((opt = getopt(ac, av, opts)) != -1) {
+    if (opt == 't')
+      bin = optarg;
+    else if (opt == 'd')
+      daemon = optarg;
+    else if (opt == 'r' && (runs = atoi(optarg)) > 0)
+      continue;
+    else if (opt != '?' && bench->opt && !bench->opt(bench->arg, opt, optarg))
+      continue;
+    else
+      return usage(bench, av[0]);
+  }
+  if (!bin || !daemon || optind == ac) return usage(bench, av[0]);
+  printf("[");
+  for (int i = optind; i < ac; i++) {
+    for (int r = 0; r < runs; r++) {
+      if (bench->init(bench->arg, av[i], desc, sizeof(desc)))
+        return usage(bench, av[0]);
+      fprintf(stderr, "%s: %s, run %d/%d\n", bench->name, desc, r + 1, runs);
+      ok = !bench->run(bench->arg, bin, daemon);
+      fails += !ok;
+      printf("%s\n  ", first ? "" : ",");
+      bench->print(bench->arg, ok);
+      fflush(stdout);
+      first = 0;
+    }
+  }
+  printf("\n]\n");
+  return fails ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int bench_nxm(const char *av, int *programs, int *procs) {
+  if (sscanf(av, "%dx%d", programs, procs) != 2 || *programs <= 0 ||
+      *procs <= 0)
+    return -1;
+  return 0;
+}
+
+int64_t bench_now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+int bench_tm_init(t_bench_tm *tm) {
+  *tm = (t_bench_tm){.pid = -1, .leader = -1, .master = -1};
+  strcpy(tm->dir, "/tmp/tm_bench.XXXXXX");
+  if (!mkdtemp(tm->dir)) return -1;
+  snprintf(tm->config, sizeof(tm->config), "%s/config.yaml", tm->dir);
+  snprintf(tm->sock, sizeof(tm->sock), "%s/metrics.sock", tm->dir);
+  return 0;
+}
+
+int bench_tm_config(const t_bench_tm *tm, const char *daemon, int programs,
+                    int procs, const char *extra) {
+  FILE *stream = fopen(tm->config, "w");
+
+  if (!stream) return -1;
+  fprintf(stream, "programs:\n");
+  for (int i = 0; i < programs; i++)
+    fprintf(stream,
+            "  bench_%05d:\n"
+            "    cmd: \"%s bench\"\n"
+            "    numprocs: %d\n"
+            "    autostart: true\n"
+            "    starttime: 0\n"
+            "    stopsignal: SIGHUP\n"
+            "    stoptime: 1\n"
+            "    stdout: /dev/null\n"
+            "    stderr: /dev/null\n"
+            "%s",
+            i, daemon, procs, extra ? extra : "");
+  return fclose(stream);
+}
+
+static int connect_sock(const t_bench_tm *tm) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (fd == -1) return -1;
+  strncpy(addr.sun_path, tm->sock, sizeof(addr.sun_path) - 1);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* taskmaster can't be a session leader, which the child of forkpty is: it
+ * forks taskmaster, sends its pid & waits for it */
+static void run_tm(t_bench_tm *tm, char *const argv[], int pipefd[2]) {
+  pid_t pid = fork();
+  int status = 127;
+
+  if (!pid) {
+    close(pipefd[0]);
+    close(pipefd[1]);
+    if (chdir(tm->dir) == -1) _exit(127);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+  write(pipefd[1], &pid, sizeof(pid));
+  if (pid > 0) waitpid(pid, &status, 0);
+  _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 127);
+}
+
+int bench_tm_start(t_bench_tm *tm, const char *bin, char *const args[]) {
+  char *argv[32] = {(char *)bin, "-f", tm->config, "-m", tm->sock, "-n"};
+  int argc = 6, fd, pipefd[2];
+
+  for (int i = 0; args && args[i] && argc < 31; i++) argv[argc++] = args[i];
+  if (pipe2(pipefd, O_CLOEXEC) == -1) return -1;
+  tm->start_us = bench_now_us();
+  tm->leader = forkpty(&tm->master, NULL, NULL, NULL);
+  if (!tm->leader) run_tm(tm, argv, pipefd);
+  close(pipefd[1]);
+  if (tm->leader == -1 ||
+      read(pipefd[0], &tm->pid, sizeof(tm->pid)) != sizeof(tm->pid))
+    tm->pid = -1;
+  close(pipefd[0]);
+  while (tm->pid > 0 &&
+         bench_now_us() - tm->start_us < BENCH_TIMEOUT_MS * 1000LL) {
+    bench_tm_pump(tm, 1);
+    if ((fd = connect_sock(tm)) != -1) {
+      close(fd);
+      return 0;
+    }
+    if (waitpid(tm->leader, NULL, WNOHANG) == tm->leader) {
+      tm->leader = -1;
+      return -1;
+    }
+  }
+  return -1;
+}
+
+/* ft_readline asks for the cursor position twice before each prompt: where
+ * it is, then at the right margin. Input typed before the second answer would
+ * be read as part of it */
+void bench_tm_pump(t_bench_tm *tm, int ms) {
+  struct pollfd pfd = {.fd = tm->master, .events = POLLIN};
+  char buf[65536];
+  ssize_t len;
+
+  while (poll(&pfd, 1, ms) > 0) {
+    if ((len = read(tm->master, buf, sizeof(buf) - 1)) <= 0) return;
+    buf[len] = 0;
+    for (char *esc = buf; (esc = memchr(esc, '\x1b', buf + len - esc)); esc++) {
+      if (!strncmp(esc, "\x1b[999C", 6)) tm->margin = true;
+      if (strncmp(esc, "\x1b[6n", 4)) continue;
+      write(tm->master, "\x1b[1;1R", 6);
+      tm->prompt = tm->margin;
+      tm->margin = false;
+    }
+    ms = 0;
+  }
+}
+
+void bench_tm_cmd(t_bench_tm *tm, const char *line) {
+  tm->prompt = false;
+  write(tm->master, line, strlen(line));
+  write(tm->master, "\r", 1); /* the terminal is raw */
+}
+
+static void remove_dir(const char *path) {
+  DIR *dir = opendir(path);
+  struct dirent *ent;
+
+  if (!dir) return;
+  while ((ent = readdir(dir)))
+    if (ent->d_name[0] != '.') unlinkat(dirfd(dir), ent->d_name, 0);
+  closedir(dir);
+  rmdir(path);
+}
+
+/* the line editor flushes the input typed ahead of its prompt: exit is typed
+ * again until taskmaster is gone */
+void bench_tm_stop(t_bench_tm *tm) {
+  int64_t start = bench_now_us(), typed = 0;
+
+  while (tm->leader > 0 && waitpid(tm->leader, NULL, WNOHANG) != tm->leader) {
+    if (bench_now_us() - start > BENCH_STOP_TIMEOUT_MS * 1000LL) {
+      fprintf(stderr, "bench: taskmaster didn't exit, killed\n");
+      if (tm->pid > 0) kill(tm->pid, SIGKILL);
+      kill(tm->leader, SIGKILL);
+      waitpid(tm->leader, NULL, 0);
+      break;
+    }
+    if (bench_now_us() - typed > 200000) {
+      bench_tm_cmd(tm, "exit");
+      typed = bench_now_us();
+    }
+    bench_tm_pump(tm, 10);
+  }
+  if (tm->master != -1) close(tm->master);
+  tm->pid = -1, tm->leader = -1, tm->master = -1;
+  remove_dir(tm->dir);
+}
+
+/* the server answers once the request is over: an empty line, then EOF.
+ * The metrics are rendered between two commands, so the terminal is drained
+ * meanwhile not to block one writing its output */
+char *bench_scrape(t_bench_tm *tm) {
+  size_t len = 0, cap = 65536;
+  char *body = malloc(cap), *tmp;
+  int fd = connect_sock(tm);
+  struct pollfd pfd[2] = {{.fd = fd, .events = POLLIN},
+                          {.fd = tm->master, .events = POLLIN}};
+  ssize_t ret;
+
+  if (fd == -1 || !body) goto error;
+  if (write(fd, "\n\n", 2) != 2) goto error;
+  shutdown(fd, SHUT_WR);
+  while (poll(pfd, 2, -1) > 0) {
+    if (pfd[1].revents & POLLHUP) pfd[1].fd = -1; /* taskmaster is gone */
+    if (pfd[1].revents & POLLIN) bench_tm_pump(tm, 0);
+    if (!pfd[0].revents) continue;
+    if ((ret = read(fd, body + len, cap - len - 1)) <= 0) break;
+    len += ret;
+    if (cap - len > 1) continue;
+    if (!(tmp = realloc(body, cap *= 2))) goto error;
+    body = tmp;
+  }
+  body[len] = 0;
+  close(fd);
+  return body;
+error:
+  if (fd != -1) close(fd);
+  free(body);
+  return NULL;
+}
+
+double bench_metric(const char *body, const char *name, const char *filter) {
+  size_t name_len = strlen(name);
+  const char *line, *end, *value;
+  double sum = -1;
+  char buf[512];
+
+  for (line = body; line && *line; line = end ? end + 1 : NULL) {
+    end = strchr(line, '\n');
+    if (strncmp(line, name, name_len) ||
+        (line[name_len] != '{' && line[name_len] != ' '))
+      continue;
+    snprintf(buf, sizeof(buf), "%.*s",
+             (int)(end ? (size_t)(end - line) : strlen(line)), line);
+    if (filter && !strstr(buf, filter)) continue;
+    if (!(value = strrchr(buf, ' '))) continue;
+    sum = (sum < 0 ? 0 : sum) + strtod(value + 1, NULL);
+  }
+  return sum;
+}
+
+int bench_usage(pid_t pid, double *cpu_ms, long *rss_kb, long *hwm_kb) {
+  unsigned long utime, stime;
+  char path[64], buf[4096], *fields, *line;
+  ssize_t len;
+  int fd;
+
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  if ((fd = open(path, O_RDONLY)) == -1) return -1;
+  len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0) return -1;
+  buf[len] = 0;
+  if (!(fields = strrchr(buf, ')')) ||
+      sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+             &utime, &stime) != 2)
+    return -1;
+  *cpu_ms = (utime + stime) * 1000.0 / sysconf(_SC_CLK_TCK);
+  snprintf(path, sizeof(path), "/proc/%d/status", pid);
+  if ((fd = open(path, O_RDONLY)) == -1) return -1;
+  len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0) return -1;
+  buf[len] = 0;
+  *rss_kb = (line = strstr(buf, "VmRSS:")) ? strtol(line + 6, NULL, 10) : 0;
+  *hwm_kb = (line = strstr(buf, "VmHWM:")) ? strtol(line + 6, NULL, 10) : 0;
+  return 0;
+}
+
+/* the command name in /proc/<pid>/stat may hold spaces & parentheses */
+int bench_children(pid_t ppid, t_bench_child *children, int max) {
+  DIR *dir = opendir("/proc");
+  char path[64], buf[512], *fields;
+  struct dirent *ent;
+  int nb = 0, fd, ppid_read;
+  ssize_t len;
+  t_bench_child child;
+
+  if (!dir) return -1;
+  while (nb < max && (ent = readdir(dir))) {
+    if ((child.pid = atoi(ent->d_name)) <= 0) continue;
+    snprintf(path, sizeof(path), "/proc/%d/stat", child.pid);
+    if ((fd = open(path, O_RDONLY)) == -1) continue;
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) continue;
+    buf[len] = 0;
+    if (!(fields = strrchr(buf, ')')) ||
+        sscanf(fields + 2, "%c %d %d", &child.state, &ppid_read,
+               &child.pgid) != 3 ||
+        ppid_read != ppid)
+      continue;
+    if (children) children[nb] = child;
+    nb++;
+  }
+  closedir(dir);
+  return nb;
+}
+
+long bench_count_lines(const char *path, const char *needle) {
+  FILE *stream = fopen(path, "r");
+  char *line = NULL;
+  size_t cap = 0;
+  long nb = 0;
+
+  if (!stream) return -1;
+  while (getline(&line, &cap, stream) != -1) nb += !!strstr(line, needle);
+  free(line);
+  fclose(stream);
+  return nb;
+}
@@ -0,0 +1,107 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * Benchmark harness.
+ * taskmaster needs a terminal: it's run on a pseudo-terminal whose output is
+ * drained (and whose cursor position queries are answered) by
+ * bench_tm_pump(), in a scratch directory holding its configuration, logs &
+ * metrics socket. Measurements are read from the metrics socket, and from
+ * /proc for the supervisor itself.
+ */
+
+#define BENCH_TIMEOUT_MS (60000) /* a run taking longer is reported failed */
+
+typedef struct s_bench_tm {
+  char dir[64];     /* scratch directory, cwd of taskmaster */
+  char config[96];  /* <dir>/config.yaml */
+  char sock[96];    /* <dir>/metrics.sock */
+  pid_t pid;        /* taskmaster */
+  pid_t leader;     /* session leader on the pseudo-terminal, its parent */
+  int master;       /* pseudo-terminal of taskmaster */
+  bool margin;      /* the line editor's cursor went to the right margin */
+  bool prompt;      /* a prompt was drawn since the last line typed: the line
+                       editor flushes the input typed ahead of it only */
+  int64_t start_us; /* fork of taskmaster */
+} t_bench_tm;
+
+/* a benchmark run by bench_main(), its callbacks are passed arg */
+typedef struct s_bench {
+  const char *name;  /* prefix of the progress lines */
+  const char *args;  /* usage of the arguments, a run of each */
+  const char *help;  /* what a run does */
+  const char *opts;  /* getopt() options of the benchmark, may be NULL */
+  void *arg;
+  /* an option of opts. Returns -1 if its argument val is invalid */
+  int (*opt)(void *arg, int opt, const char *val);
+  /* reset the result for a run of the argument av & describe it in desc.
+   * Returns -1 if av is invalid */
+  int (*init)(void *arg, const char *av, char *desc, size_t size);
+  /* run bin with daemon. Returns -1 if the run failed */
+  int (*run)(void *arg, const char *bin, const char *daemon);
+  /* print the result of the run as a JSON object */
+  void (*print)(const void *arg, int ok);
+} t_bench;
+
+/* parse -t taskmaster -d daemon [-r runs] & the options of bench, then run
+ * bench runs times for each argument, printing a JSON array with a result per
+ * run. Returns the exit status: a failure if any run failed */
+int bench_main(const t_bench *bench, int ac, char **av);
+
+/* parse an NxM argument: N programs of M procs. Returns -1 if it's invalid */
+int bench_nxm(const char *av, int *programs, int *procs);
+
+/* monotonic clock in us */
+int64_t bench_now_us(void);
+
+typedef struct s_bench_child {
+  pid_t pid;
+  pid_t pgid;
+  char state; /* from /proc/<pid>/stat, Z for a zombie */
+} t_bench_child;
+
+/* create the scratch directory of tm. Returns -1 on failure */
+int bench_tm_init(t_bench_tm *tm);
+
+/* write the configuration of tm: programs of procs processes of daemon,
+ * with extra lines of settings (may be NULL). Returns -1 on failure */
+int bench_tm_config(const t_bench_tm *tm, const char *daemon, int programs,
+                    int procs, const char *extra);
+
+/* run bin with the configuration of tm, its metrics socket & args (NULL
+ * terminated, may be NULL), then wait for the socket. Returns -1 on failure */
+int bench_tm_start(t_bench_tm *tm, const char *bin, char *const args[]);
+
+/* drain the terminal for up to ms */
+void bench_tm_pump(t_bench_tm *tm, int ms);
+
+/* type a command line */
+void bench_tm_cmd(t_bench_tm *tm, const char *line);
+
+/* exit taskmaster, killed if it doesn't within 10 s, & remove the scratch
+ * directory */
+void bench_tm_stop(t_bench_tm *tm);
+
+/* scrape the metrics, NULL on failure. To free */
+char *bench_scrape(t_bench_tm *tm);
+
+/* sum of the samples of metric name whose labels hold filter (may be NULL),
+ * -1 if there is none */
+double bench_metric(const char *body, const char *name, const char *filter);
+
+/* CPU time in ms, current & peak RSS in kB of pid */
+int bench_usage(pid_t pid, double *cpu_ms, long *rss_kb, long *hwm_kb);
+
+/* fill children (may be NULL to count them) with up to max children of ppid,
+ * returns their number or -1 on failure */
+int bench_children(pid_t ppid, t_bench_child *children, int max);
+
+/* lines of the file at path holding needle, -1 on failure */
+long bench_count_lines(const char *path, const char *needle);
+
+#endif
@@ -0,0 +1,387 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "taskmaster.h"
+
+/*
+ * Configuration loading at scale. Configurations of N programs are generated
+ * in a shape (-g prints one), then loaded in process by the functions of a
+ * reload, each timed on its own: load_config_file(), sanitize_config(),
+ * fulfill_config(), then the diff of notify_reload() against a second
+ * generation where programs are changed, removed & added: the name maps of
+ * both generations and the join on them. Allocations are counted by the
+ * allocator below, and peak RSS is reset before each phase. Prints a JSON
+ * array with a result per run.
+ */
+
+#define SHAPE_ENV_NB (32)      /* env vars of an env shaped program */
+#define SHAPE_EXITCODES_NB (64) /* exitcodes of an exitcodes shaped one */
+#define SHAPE_ARGV_NB (64)     /* arguments of an argv shaped one */
+#define DIFF_CHANGE (10)       /* 1 program in 10 changed, hard & soft */
+#define DIFF_MOVE (20)         /* 1 in 20 removed, as many added */
+
+typedef enum e_shape {
+  SHAPE_PLAIN,
+  SHAPE_ENV,
+  SHAPE_EXITCODES,
+  SHAPE_ARGV,
+  SHAPE_MIXED,
+  SHAPE_NB,
+} t_shape;
+
+static const char shape_names[SHAPE_NB][16] = {"plain", "env", "exitcodes",
+                                               "argv", "mixed"};
+
+typedef enum e_phase {
+  PHASE_LOAD,
+  PHASE_SANITIZE,
+  PHASE_FULFILL,
+  PHASE_MAP,
+  PHASE_JOIN,
+  PHASE_NB,
+} t_phase;
+
+static const char phase_names[PHASE_NB][16] = {"load", "sanitize", "fulfill",
+                                               "map", "join"};
+
+typedef struct s_phase_res {
+  double ms;
+  uint64_t allocs, bytes; /* allocations, bytes asked */
+  long hwm_kb;            /* peak RSS */
+} t_phase_res;
+
+typedef struct s_result {
+  int programs;
+  t_shape shape;
+  long file_kb;
+  t_phase_res phases[PHASE_NB];
+  size_t held_kb; /* heap held by a loaded generation */
+  int added, removed, hard, soft;
+  long fd_limit, fd_need; /* skipped: the hard fd limit is below the need */
+} t_result;
+
+/* ------------------------------- allocator -------------------------------- */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t allocs, alloc_bytes; /* updated by the sanitize pool too */
+
+static void count(size_t size) {
+  __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+  count(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  count(nmemb * size);
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  count(size);
+  return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t align, size_t size) {
+  count(size);
+  return __libc_memalign(align, size);
+}
+
+int posix_memalign(void **ptr, size_t align, size_t size) {
+  count(size);
+  return (*ptr = __libc_memalign(align, size)) ? 0 : ENOMEM;
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+  count(size);
+  return __libc_memalign(align, size);
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+
+/* -------------------------------- generator ------------------------------- */
+
+/* variant 1 is the generation reloaded over variant 0 */
+static void gen_pgm(FILE *stream, t_shape shape, int i, int variant) {
+  bool hard = variant && i % DIFF_CHANGE == 0;
+  bool soft = variant && i % DIFF_CHANGE == 1;
+
+  if (shape == SHAPE_MIXED) shape = i % SHAPE_MIXED;
+  fprintf(stream, "  pgm_%06d:\n    cmd: \"/bin/sleep %d", i, hard ? 2 : 1);
+  for (int j = 0; shape == SHAPE_ARGV && j < SHAPE_ARGV_NB; j++)
+    fprintf(stream, " --argument-%02d=value-%d", j, i);
+  fprintf(stream,
+          "\"\n"
+          "    numprocs: 1\n"
+          "    autostart: false\n"
+          "    starttime: %d\n"
+          "    stoptime: 1\n",
+          soft ? 2 : 1);
+  if (shape == SHAPE_ENV) {
+    fprintf(stream, "    env:\n");
+    for (int j = 0; j < SHAPE_ENV_NB; j++)
+      fprintf(stream, "      VARIABLE_%02d: \"value of variable %d for %d\"\n",
+              j, j, i);
+  } else if (shape == SHAPE_EXITCODES) {
+    fprintf(stream, "    exitcodes:\n");
+    for (int j = 0; j < SHAPE_EXITCODES_NB; j++)
+      fprintf(stream, "      - %d\n", (i + j) % 256);
+  }
+}
+
+static void gen_config(FILE *stream, t_shape shape, int programs, int variant) {
+  fprintf(stream, "programs:\n");
+  for (int i = 0; i < programs; i++)
+    if (!variant || i % DIFF_MOVE != DIFF_MOVE - 1)
+      gen_pgm(stream, shape, i, variant);
+  for (int i = 0; variant && i < programs / DIFF_MOVE; i++)
+    gen_pgm(stream, shape, programs + i, variant);
+}
+
+static int write_config(const char *path, t_shape shape, int programs,
+                        int variant, long *size_kb) {
+  FILE *stream = fopen(path, "w");
+
+  if (!stream) return -1;
+  gen_config(stream, shape, programs, variant);
+  if (size_kb) *size_kb = ftell(stream) / 1024;
+  return fclose(stream);
+}
+
+/* --------------------------------- phases --------------------------------- */
+
+/* VmHWM is reset to the current RSS */
+static void phase_start(t_phase_res *res) {
+  int fd = open("/proc/self/clear_refs", O_WRONLY);
+
+  if (fd != -1) {
+    write(fd, "5", 1);
+    close(fd);
+  }
+  res->allocs = allocs, res->bytes = alloc_bytes;
+  res->ms = bench_now_us() / 1000.0;
+}
+
+static void phase_end(t_phase_res *res) {
+  double cpu_ms;
+  long rss_kb;
+
+  res->ms = bench_now_us() / 1000.0 - res->ms;
+  res->allocs = allocs - res->allocs, res->bytes = alloc_bytes - res->bytes;
+  bench_usage(getpid(), &cpu_ms, &rss_kb, &res->hwm_kb);
+}
+
+/* load, sanitize & fulfill, as a reload thread does. Phases are only
+ * recorded if res isn't NULL */
+static int load(t_tm_node *node, const char *path, t_result *res) {
+  t_phase_res dummy[PHASE_NB];
+  t_phase_res *phases = res ? res->phases : dummy;
+
+  *node = (t_tm_node){.tm_name = "bench_config"};
+  if (!(node->config_file_name = strdup(path)) ||
+      !(node->config_file_stream = fopen(path, "r")))
+    return -1;
+  phase_start(&phases[PHASE_LOAD]);
+  if (load_config_file(node)) return -1;
+  phase_end(&phases[PHASE_LOAD]);
+  phase_start(&phases[PHASE_SANITIZE]);
+  if (sanitize_config(node)) return -1;
+  phase_end(&phases[PHASE_SANITIZE]);
+  phase_start(&phases[PHASE_FULFILL]);
+  if (fulfill_config(node)) return -1;
+  phase_end(&phases[PHASE_FULFILL]);
+  return 0;
+}
+
+/* counts the decisions of the join of notify_reload(), without acting on
+ * them */
+static bool count_diff(t_pgm *pgm, t_pgm *pgm_new, t_pgm_diff diff,
+                       void *arg) {
+  t_result *res = arg;
+
+  UNUSED_PARAM(pgm);
+  UNUSED_PARAM(pgm_new);
+  res->added += diff == PGM_DIFF_ADD;
+  res->removed += diff == PGM_DIFF_DEL;
+  res->hard += diff == PGM_DIFF_HARD;
+  res->soft += diff == PGM_DIFF_SOFT;
+  return false;
+}
+
+/* fulfill_config() opens 2 fds per program, for its stdout & stderr, all
+ * held at once. The soft limit is raised up to the hard one: raising the hard
+ * one needs privileges. Returns 1 if it isn't enough, the size being skipped */
+static int raise_fd_limit(t_result *res) {
+  struct rlimit lim;
+  rlim_t need = res->programs * 2 + 64;
+
+  if (getrlimit(RLIMIT_NOFILE, &lim) == -1) return -1;
+  if (lim.rlim_cur >= need) return 0;
+  if (lim.rlim_max < need) {
+    res->fd_limit = lim.rlim_max, res->fd_need = need;
+    return 1;
+  }
+  lim.rlim_cur = need;
+  return setrlimit(RLIMIT_NOFILE, &lim);
+}
+
+/* the fds of a measured generation aren't needed, so that the next one can
+ * open its own */
+static void close_logs(t_tm_node *node) {
+  for (t_pgm *pgm = node->head; pgm; pgm = pgm->privy.next) {
+    if (pgm->privy.log.out > 0) close(pgm->privy.log.out);
+    if (pgm->privy.log.err > 0) close(pgm->privy.log.err);
+    pgm->privy.log.out = pgm->privy.log.err = -1;
+  }
+}
+
+static int run(const char *dir, t_result *res) {
+  t_tm_node node = {0}, newnode = {0};
+  t_pgm_map old_map = {0}, new_map = {0};
+  char path[128], new_path[128];
+  size_t heap;
+  int ret = -1;
+
+  snprintf(path, sizeof(path), "%s/config.yaml", dir);
+  snprintf(new_path, sizeof(new_path), "%s/config_new.yaml", dir);
+  if ((ret = raise_fd_limit(res))) {
+    if (ret == 1)
+      fprintf(stderr, "bench-config: %d programs: skipped, %ld fds needed, "
+              "hard limit %ld\n", res->programs, res->fd_need, res->fd_limit);
+    else
+      fprintf(stderr, "bench-config: %d programs: fd limit: %s\n",
+              res->programs, strerror(errno));
+    return ret == 1 ? 0 : -1;
+  }
+  ret = -1;
+  if (write_config(path, res->shape, res->programs, 0, &res->file_kb) ||
+      write_config(new_path, res->shape, res->programs, 1, NULL))
+    goto end;
+  malloc_trim(0);
+  heap = mallinfo2().uordblks;
+  if (load(&node, path, res)) goto end;
+  res->held_kb = (mallinfo2().uordblks - heap) / 1024;
+  close_logs(&node);
+  if (load(&newnode, new_path, NULL)) goto end;
+  close_logs(&newnode);
+  phase_start(&res->phases[PHASE_MAP]);
+  if (pgm_map_init(&new_map, newnode.head) ||
+      pgm_map_init(&old_map, node.head))
+    goto end;
+  phase_end(&res->phases[PHASE_MAP]);
+  phase_start(&res->phases[PHASE_JOIN]);
+  pgm_join(node.head, &old_map, &newnode.head, &new_map, count_diff, res);
+  phase_end(&res->phases[PHASE_JOIN]);
+  ret = 0;
+end:
+  pgm_map_destroy(&old_map);
+  pgm_map_destroy(&new_map);
+  destroy_taskmaster(&node);
+  destroy_taskmaster(&newnode);
+  unlink(path);
+  unlink(new_path);
+  return ret;
+}
+
+static void print_result(const t_result *res, int ok, int first) {
+  const t_phase_res *phase;
+
+  if (res->fd_limit) {
+    printf("%s\n  {\"programs\": %d, \"shape\": \"%s\", \"ok\": true, "
+           "\"skipped\": \"fd limit\", \"fd_limit\": %ld, \"fd_need\": %ld}",
+           first ? "" : ",", res->programs, shape_names[res->shape],
+           res->fd_limit, res->fd_need);
+    fflush(stdout);
+    return;
+  }
+  printf("%s\n  {\"programs\": %d, \"shape\": \"%s\", \"ok\": %s, "
+         "\"file_kb\": %ld, \"held_kb\": %zu, \"added\": %d, \"removed\": %d, "
+         "\"hard\": %d, \"soft\": %d",
+         first ? "" : ",", res->programs, shape_names[res->shape],
+         ok ? "true" : "false", res->file_kb, res->held_kb, res->added,
+         res->removed, res->hard, res->soft);
+  for (int i = 0; i < PHASE_NB; i++) {
+    phase = &res->phases[i];
+    printf(",\n   \"%s\": {\"ms\": %.2f, \"allocs\": %" PRIu64
+           ", \"alloc_kb\": %" PRIu64 ", \"peak_rss_kb\": %ld}",
+           phase_names[i], phase->ms, phase->allocs, phase->bytes / 1024,
+           phase->hwm_kb);
+  }
+  printf("}");
+  fflush(stdout);
+}
+
+static int usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [-r runs] [-s shape] N ...\n"
+          "       %s -g shape N\n"
+          "  times reloading configurations of N programs in shape, or print "
+          "one\n  shapes: plain, env, exitcodes, argv, mixed\n",
+          name, name);
+  return EXIT_FAILURE;
+}
+
+static int parse_shape(const char *arg, t_shape *shape) {
+  for (int i = 0; i < SHAPE_NB; i++) {
+    if (!strcmp(arg, shape_names[i])) {
+      *shape = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int main(int ac, char **av) {
+  int opt, runs = 1, first = 1, fails = 0, ok, programs;
+  t_shape shape = SHAPE_MIXED;
+  bool gen = false;
+  t_bench_tm tm;
+  t_result res;
+
+  while ((opt = getopt(ac, av, "g:s:r:")) != -1) {
+    if ((opt == 'g' || opt == 's') && !parse_shape(optarg, &shape))
+      gen |= opt == 'g';
+    else if (opt == 'r' && (runs = atoi(optarg)) > 0)
+      continue;
+    else
+      return usage(av[0]);
+  }
+  if (optind == ac) return usage(av[0]);
+  if (gen) {
+    if ((programs = atoi(av[optind])) <= 0) return usage(av[0]);
+    gen_config(stdout, shape, programs, 0);
+    return EXIT_SUCCESS;
+  }
+  if (bench_tm_init(&tm) || chdir(tm.dir) == -1) return EXIT_FAILURE;
+  printf("[");
+  for (int i = optind; i < ac; i++) {
+    for (int r = 0; r < runs; r++) {
+      res = (t_result){.programs = atoi(av[i]), .shape = shape};
+      if (res.programs <= 0) return usage(av[0]);
+      fprintf(stderr, "bench-config: %d %s programs, run %d/%d\n",
+              res.programs, shape_names[shape], r + 1, runs);
+      ok = !run(tm.dir, &res);
+      fails += !ok;
+      print_result(&res, ok, first);
+      first = 0;
+    }
+  }
+  printf("\n]\n");
+  bench_tm_stop(&tm);
+  return fails ? EXIT_FAILURE : EXIT_SUCCESS;
+}
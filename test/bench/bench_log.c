@@ -0,0 +1,290 @@
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "ft_log.h"
+#include "hist.h"
+
+/*
+ * Logging cost: ft_log() is called with the arguments of the spawn & exit
+ * paths (a pgid, a program name, a pid & a status) at paced rates, 0 being as
+ * fast as possible, for each level & message size. The log is a file on a
+ * tmpfs, truncated above 10 MiB, or a FIFO drained slowly by a reader,
+ * standing for a full disk or a slow network filesystem. Each call is timed:
+ * calls & ns per call at the tail, messages per second achieved. ft_log()
+ * opens its file once per process, so a run is done by a child. Prints a JSON
+ * array with a result per run.
+ */
+
+#define ROTATE_BYTES (10 * 1024 * 1024) /* as taskmaster's log */
+#define SLOW_CHUNK (4096)               /* read by the slow reader at once */
+#define SLOW_CHUNK_MS (16)              /* between two reads: 256 KiB/s */
+#define MSG_MAX (511)                   /* longer messages are truncated */
+#define LIST_MAX (16)                   /* levels, sizes & rates */
+
+typedef enum e_target { TG_TMPFS, TG_SLOW, TG_NB } t_target;
+
+static const char *const tg_names[TG_NB] = {"tmpfs", "slow"};
+
+static const struct {
+  const char *name;
+  int level;
+} levels[] = {{"err", FT_LOG_ERR},
+              {"warning", FT_LOG_WARNING},
+              {"info", FT_LOG_INFO},
+              {"debug", FT_LOG_DEBUG}};
+
+typedef struct s_result {
+  t_target target;
+  int level; /* index in levels */
+  int size;  /* bytes of message */
+  int rate;  /* calls per second asked, 0: as fast as possible */
+  long msgs;
+  double elapsed_s;
+  unsigned long long bytes; /* written, headers included */
+  double avg_ns;
+  uint64_t p50_ns, p99_ns, p999_ns, max_ns;
+} t_result;
+
+typedef struct s_params {
+  const char *dir; /* of the log, a tmpfs */
+  int duration_ms; /* of a run */
+  int levels[LIST_MAX], level_nb;
+  int sizes[LIST_MAX], size_nb;
+  int rates[LIST_MAX], rate_nb;
+} t_params;
+
+static int64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t ns) {
+  struct timespec ts = {.tv_sec = ns / 1000000000LL,
+                        .tv_nsec = ns % 1000000000LL};
+
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/* the FIFO is read by chunks, with a pause after each, until EOF */
+static pid_t slow_reader(const char *path) {
+  pid_t pid = fork();
+  char buf[SLOW_CHUNK];
+  int fd;
+
+  if (pid) return pid;
+  if ((fd = open(path, O_RDONLY)) == -1) _exit(EXIT_FAILURE);
+  while (read(fd, buf, sizeof(buf)) > 0)
+    sleep_until(now_ns() + SLOW_CHUNK_MS * 1000000LL);
+  _exit(EXIT_SUCCESS);
+}
+
+/* the calls of the exit path, with a program name sized for msg bytes */
+static void log_calls(const t_params *params, t_result *res) {
+  int name_len = res->size - snprintf(NULL, 0, "(%d)  <%d> exited with "
+                                      "status %d", 42000, 42001, 0);
+  int64_t start, end, next, t0, dt, total = 0;
+  char name[MSG_MAX + 1];
+  t_hist *hist = NULL;
+
+  name_len = name_len < 1 ? 1 : name_len;
+  memset(name, 'a', name_len);
+  name[name_len] = 0;
+  start = now_ns();
+  end = start + params->duration_ms * 1000000LL;
+  for (long i = 0; (t0 = now_ns()) < end; i++) {
+    if (res->rate) {
+      if ((next = start + i * 1000000000LL / res->rate) >= end) break;
+      if (t0 < next) sleep_until(next);
+      t0 = now_ns();
+    }
+    ft_log(levels[res->level].level, "(%d) %s <%d> exited with status %d",
+           42000, name, 42001 + (int)(i & 0xfff), (int)(i & 0xff));
+    dt = now_ns() - t0;
+    hist_record(&hist, dt);
+    total += dt;
+    res->msgs++;
+  }
+  res->elapsed_s = (now_ns() - start) / 1e9;
+  res->bytes = ft_log_bytes();
+  if (!hist) return;
+  res->avg_ns = (double)total / res->msgs;
+  res->p50_ns = hist_quantile(hist, 0.5);
+  res->p99_ns = hist_quantile(hist, 0.99);
+  res->p999_ns = hist_quantile(hist, 0.999);
+  res->max_ns = hist->max;
+  free(hist);
+}
+
+/* in a child, which sends its result back through a pipe */
+static int run(const t_params *params, const char *path, t_result *res) {
+  int pipefd[2], status = -1;
+  pid_t pid;
+
+  if (pipe(pipefd) == -1) return -1;
+  if (!(pid = fork())) {
+    close(pipefd[0]);
+    if (ft_openlog(strdup("bench_log"), path) ||
+        (res->target == TG_TMPFS && ft_log_rotate(ROTATE_BYTES, 0, NULL)))
+      _exit(EXIT_FAILURE);
+    log_calls(params, res);
+    _exit(write(pipefd[1], res, sizeof(*res)) == sizeof(*res)
+              ? EXIT_SUCCESS
+              : EXIT_FAILURE);
+  }
+  close(pipefd[1]);
+  if (pid == -1 || read(pipefd[0], res, sizeof(*res)) != sizeof(*res))
+    res->msgs = 0;
+  close(pipefd[0]);
+  if (pid != -1) waitpid(pid, &status, 0);
+  return WIFEXITED(status) && !WEXITSTATUS(status) && res->msgs ? 0 : -1;
+}
+
+/* the log of the tmpfs target is a fresh file in dir, the one of the slow
+ * target a FIFO in the scratch directory, read meanwhile */
+static int run_target(const t_params *params, const t_bench_tm *scratch,
+                      t_result *res) {
+  char path[128];
+  pid_t reader = -1;
+  int ret, fd;
+
+  if (res->target == TG_TMPFS) {
+    snprintf(path, sizeof(path), "%s/bench_log.XXXXXX", params->dir);
+    if ((fd = mkstemp(path)) == -1) return -1;
+    close(fd);
+  } else {
+    snprintf(path, sizeof(path), "%s/bench_log.fifo", scratch->dir);
+    if (mkfifo(path, 0600) == -1 || (reader = slow_reader(path)) == -1) {
+      unlink(path);
+      return -1;
+    }
+  }
+  ret = run(params, path, res);
+  if (reader > 0) waitpid(reader, NULL, 0);
+  unlink(path);
+  return ret;
+}
+
+static void print_result(const t_result *res, int ok, int first) {
+  printf("%s\n  {\"target\": \"%s\", \"level\": \"%s\", \"size\": %d, "
+         "\"rate\": %d, \"ok\": %s",
+         first ? "" : ",", tg_names[res->target], levels[res->level].name,
+         res->size, res->rate, ok ? "true" : "false");
+  if (ok)
+    printf(", \"msgs\": %ld, \"msgs_per_sec\": %.0f, \"mb_per_sec\": %.2f, "
+           "\"ns_per_call\": %.0f, \"p50_ns\": %" PRIu64
+           ", \"p99_ns\": %" PRIu64 ", \"p999_ns\": %" PRIu64
+           ", \"max_ns\": %" PRIu64,
+           res->msgs, res->msgs / res->elapsed_s,
+           res->bytes / res->elapsed_s / (1024 * 1024), res->avg_ns,
+           res->p50_ns, res->p99_ns, res->p999_ns, res->max_ns);
+  printf("}");
+  fflush(stdout);
+}
+
+static int usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [-o tmpfs_dir] [-T ms] [-l levels] [-s sizes] "
+          "[-R rates] tmpfs|slow ...\n"
+          "  times ft_log() calls for each level (err,warning,info,debug), "
+          "message size\n  & rate (calls per second, 0 unpaced), comma "
+          "separated\n",
+          name);
+  return EXIT_FAILURE;
+}
+
+/* comma separated list of ints, or of level names if names */
+static int parse_list(char *arg, int *list, int *nb, bool names) {
+  char *save = NULL;
+
+  *nb = 0;
+  for (char *tok = strtok_r(arg, ",", &save); tok;
+       tok = strtok_r(NULL, ",", &save)) {
+    if (*nb == LIST_MAX) return -1;
+    if (!names) {
+      if ((list[*nb] = atoi(tok)) < 0 || (!list[*nb] && *tok != '0'))
+        return -1;
+      (*nb)++;
+      continue;
+    }
+    list[*nb] = 0;
+    while (list[*nb] < (int)(sizeof(levels) / sizeof(*levels)) &&
+           strcmp(tok, levels[list[*nb]].name))
+      list[*nb]++;
+    if (list[*nb] == sizeof(levels) / sizeof(*levels)) return -1;
+    (*nb)++;
+  }
+  return *nb ? 0 : -1;
+}
+
+int main(int ac, char **av) {
+  t_params params = {.dir = "/dev/shm",
+                     .duration_ms = 1000,
+                     .levels = {2, 1},
+                     .level_nb = 2,
+                     .sizes = {64, 256},
+                     .size_nb = 2,
+                     .rates = {1000, 10000, 100000, 0},
+                     .rate_nb = 4};
+  int opt, runs = 1, first = 1, fails = 0, ok;
+  t_bench_tm scratch;
+  t_result res;
+
+  while ((opt = getopt(ac, av, "o:T:l:s:R:r:")) != -1) {
+    if (opt == 'o')
+      params.dir = optarg;
+    else if (opt == 'T' && (params.duration_ms = atoi(optarg)) > 0)
+      continue;
+    else if (opt == 'l' &&
+             !parse_list(optarg, params.levels, &params.level_nb, true))
+      continue;
+    else if (opt == 's' &&
+             !parse_list(optarg, params.sizes, &params.size_nb, false))
+      continue;
+    else if (opt == 'R' &&
+             !parse_list(optarg, params.rates, &params.rate_nb, false))
+      continue;
+    else if (opt == 'r' && (runs = atoi(optarg)) > 0)
+      continue;
+    else
+      return usage(av[0]);
+  }
+  if (optind == ac) return usage(av[0]);
+  if (bench_tm_init(&scratch)) return EXIT_FAILURE;
+  printf("[");
+  for (int i = optind; i < ac; i++) {
+    res = (t_result){0};
+    while (res.target < TG_NB && strcmp(av[i], tg_names[res.target]))
+      res.target++;
+    if (res.target == TG_NB) return usage(av[0]);
+    for (int l = 0; l < params.level_nb; l++) {
+      for (int s = 0; s < params.size_nb; s++) {
+        for (int r = 0; r < params.rate_nb * runs; r++) {
+          res = (t_result){.target = res.target,
+                           .level = params.levels[l],
+                           .size = params.sizes[s] > MSG_MAX ? MSG_MAX
+                                                             : params.sizes[s],
+                           .rate = params.rates[r / runs]};
+          fprintf(stderr, "bench-log: %s, %s, %d bytes, %d/s, run %d/%d\n",
+                  av[i], levels[res.level].name, res.size, res.rate,
+                  r % runs + 1, runs);
+          ok = !run_target(&params, &scratch, &res);
+          fails += !ok;
+          print_result(&res, ok, first);
+          first = 0;
+        }
+      }
+    }
+  }
+  printf("\n]\n");
+  bench_tm_stop(&scratch);
+  return fails ? EXIT_FAILURE : EXIT_SUCCESS;
+}
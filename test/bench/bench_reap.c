@@ -0,0 +1,169 @@
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+/*
+ * SIGCHLD storm: once the N programs of M processes of the test daemon run,
+ * their process groups are killed at once, the run being over when every exit
+ * has been reaped & logged. Reaped exits are counted from the metrics, logged
+ * ones from the log: any of them above N x M is a duplicated notification,
+ * below once the processes are gone a missed one, as is a child left unreaped.
+ * Prints a JSON array with a result per run, exits with a failure if any run
+ * failed.
+ */
+
+#define POLL_MS (5)     /* between two scrapes */
+#define SETTLE_MS (200) /* for late duplicates once the storm is over */
+#define EXIT_LOG "terminated with signal 9"
+
+typedef struct s_result {
+  int programs, procs;
+  double reaped_ms;               /* all exits reaped, processes gone */
+  double logged_ms;               /* all exits logged */
+  long reaped, logged, zombies;   /* zombies: children left unreaped */
+  double cpu_ms;                  /* supervisor CPU during the storm */
+  double notifications, notif_ms; /* SIGCHLD handler calls & time */
+  double reap_calls;              /* waitpid loops */
+} t_result;
+
+typedef struct s_costs {
+  double cpu_ms, notifications, notif_s, reap_calls;
+} t_costs;
+
+static int read_costs(const t_bench_tm *tm, const char *body, t_costs *costs) {
+  long rss, hwm;
+
+  costs->notifications = bench_metric(body, "taskmaster_handler_calls_total",
+                                      "\"pgm_notification\"");
+  costs->notif_s = bench_metric(body, "taskmaster_handler_seconds_total",
+                                "\"pgm_notification\"");
+  costs->reap_calls = bench_metric(body, "taskmaster_handler_calls_total",
+                                   "\"update_pgm_status\"");
+  return bench_usage(tm->pid, &costs->cpu_ms, &rss, &hwm);
+}
+
+/* the process groups of the programs are listed first, then killed in a row */
+static int storm(const t_bench_tm *tm, int total) {
+  t_bench_child *children = malloc(total * sizeof(*children));
+  int nb, groups = 0;
+
+  if (!children) return -1;
+  nb = bench_children(tm->pid, children, total);
+  for (int i = 0; i < nb; i++) {
+    int j = 0;
+
+    while (j < groups && children[j].pgid != children[i].pgid) j++;
+    if (j == groups) children[groups++].pgid = children[i].pgid;
+  }
+  for (int i = 0; i < groups; i++) kill(-children[i].pgid, SIGKILL);
+  free(children);
+  return nb;
+}
+
+static int wait_running(t_bench_tm *tm, int total, char **body) {
+  while (bench_now_us() - tm->start_us < BENCH_TIMEOUT_MS * 1000LL) {
+    bench_tm_pump(tm, POLL_MS);
+    free(*body);
+    if (!(*body = bench_scrape(tm))) continue;
+    if (bench_metric(*body, "taskmaster_program_processes",
+                     "state=\"running\"") >= total)
+      return 0;
+  }
+  return -1;
+}
+
+static void count_exits(t_bench_tm *tm, const char *body, t_result *res,
+                        const char *log, int total) {
+  res->reaped = bench_metric(body, "taskmaster_program_signaled_total",
+                             "signal=\"9\"");
+  res->logged = bench_count_lines(log, EXIT_LOG);
+  res->zombies = bench_children(tm->pid, NULL, total);
+}
+
+static int run(void *arg, const char *bin, const char *daemon) {
+  t_result *res = arg;
+  int total = res->programs * res->procs;
+  t_costs before, after;
+  int64_t start = 0;
+  t_bench_tm tm;
+  char *body = NULL, log[128];
+  int ret = -1;
+
+  if (bench_tm_init(&tm)) return -1;
+  snprintf(log, sizeof(log), "%s/taskmaster.log", tm.dir);
+  if (bench_tm_config(&tm, daemon, res->programs, res->procs,
+                      "    autorestart: false\n") ||
+      bench_tm_start(&tm, bin, (char *[]){"-p", "0", NULL}) ||
+      wait_running(&tm, total, &body) || read_costs(&tm, body, &before) ||
+      storm(&tm, total) != total)
+    goto end;
+  start = bench_now_us();
+  while (bench_now_us() - start < BENCH_TIMEOUT_MS * 1000LL) {
+    bench_tm_pump(&tm, POLL_MS);
+    free(body);
+    if (!(body = bench_scrape(&tm))) continue;
+    count_exits(&tm, body, res, log, total);
+    if (!res->reaped_ms && res->reaped >= total &&
+        !bench_metric(body, "taskmaster_program_processes", NULL))
+      res->reaped_ms = (bench_now_us() - start) / 1000.0;
+    if (!res->logged_ms && res->logged >= total)
+      res->logged_ms = (bench_now_us() - start) / 1000.0;
+    if (res->reaped_ms && res->logged_ms) break;
+  }
+  bench_tm_pump(&tm, SETTLE_MS);
+  free(body);
+  if (!(body = bench_scrape(&tm)) || read_costs(&tm, body, &after)) goto end;
+  count_exits(&tm, body, res, log, total);
+  res->cpu_ms = after.cpu_ms - before.cpu_ms;
+  res->notifications = after.notifications - before.notifications;
+  res->notif_ms = (after.notif_s - before.notif_s) * 1000;
+  res->reap_calls = after.reap_calls - before.reap_calls;
+  ret = res->reaped == total && res->logged == total && !res->zombies ? 0 : -1;
+end:
+  free(body);
+  bench_tm_stop(&tm);
+  return ret;
+}
+
+static void print_result(const void *arg, int ok) {
+  const t_result *res = arg;
+  long total = (long)res->programs * res->procs;
+
+  printf("{\"programs\": %d, \"procs\": %d, \"ok\": %s, "
+         "\"reaped_ms\": %.1f, \"logged_ms\": %.1f, \"reaped\": %ld, "
+         "\"logged\": %ld, \"duplicated\": %ld, \"missed\": %ld, "
+         "\"unreaped\": %ld, \"supervisor_cpu_ms\": %.0f, "
+         "\"notifications\": %.0f, \"notification_ms\": %.1f, "
+         "\"reap_loops\": %.0f}",
+         res->programs, res->procs, ok ? "true" : "false",
+         res->reaped_ms, res->logged_ms, res->reaped, res->logged,
+         res->reaped > total ? res->reaped - total : 0,
+         res->reaped < total ? total - res->reaped : 0, res->zombies,
+         res->cpu_ms, res->notifications, res->notif_ms, res->reap_calls);
+}
+
+static int init(void *arg, const char *av, char *desc, size_t size) {
+  t_result *res = arg;
+
+  *res = (t_result){0};
+  if (bench_nxm(av, &res->programs, &res->procs)) return -1;
+  snprintf(desc, size, "%d programs x %d procs", res->programs, res->procs);
+  return 0;
+}
+
+int main(int ac, char **av) {
+  t_result res;
+  const t_bench bench = {
+      .name = "bench-reap",
+      .args = "NxM ...",
+      .help = "kills at once N programs of M procs of daemon run by taskmaster",
+      .arg = &res,
+      .init = init,
+      .run = run,
+      .print = print_result};
+
+  return bench_main(&bench, ac, av);
+}
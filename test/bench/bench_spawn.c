@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+/*
+ * Spawn throughput: taskmaster starts N programs of M processes of the test
+ * daemon, the run is over once they are all running (starttime is 0). Prints
+ * a JSON array with a result per run.
+ */
+
+#define POLL_MS (5) /* between two scrapes */
+
+typedef struct s_result {
+  int programs, procs;
+  double spawned_ms; /* all procs forked & exec'd */
+  double running_ms; /* all procs running */
+  double cpu_ms;     /* supervisor CPU time */
+  long rss_kb, hwm_kb;
+  double p50_us, p99_us, avg_us; /* fork to exec, as seen by the parent */
+} t_result;
+
+static int run(void *arg, const char *bin, const char *daemon) {
+  t_result *res = arg;
+  double total = (double)res->programs * res->procs, spawned, running;
+  t_bench_tm tm;
+  char *body = NULL;
+  int ret = -1;
+
+  if (bench_tm_init(&tm)) return -1;
+  if (bench_tm_config(&tm, daemon, res->programs, res->procs, NULL) ||
+      bench_tm_start(&tm, bin, (char *[]){"-p", "0", NULL}))
+    goto end;
+  while (bench_now_us() - tm.start_us < BENCH_TIMEOUT_MS * 1000LL) {
+    bench_tm_pump(&tm, POLL_MS);
+    free(body);
+    if (!(body = bench_scrape(&tm))) continue;
+    spawned = bench_metric(body, "taskmaster_program_spawns_total", NULL);
+    running = bench_metric(body, "taskmaster_program_processes",
+                           "state=\"running\"");
+    if (!res->spawned_ms && spawned >= total)
+      res->spawned_ms = (bench_now_us() - tm.start_us) / 1000.0;
+    if (running < total) continue;
+    res->running_ms = (bench_now_us() - tm.start_us) / 1000.0;
+    ret = bench_usage(tm.pid, &res->cpu_ms, &res->rss_kb, &res->hwm_kb);
+    res->p50_us = 1e6 * bench_metric(body, "taskmaster_latency_seconds",
+                                     "fork_exec\",quantile=\"0.5\"");
+    res->p99_us = 1e6 * bench_metric(body, "taskmaster_latency_seconds",
+                                     "fork_exec\",quantile=\"0.99\"");
+    res->avg_us = 1e6 * bench_metric(body, "taskmaster_latency_seconds_sum",
+                                     "fork_exec") /
+                  total;
+    break;
+  }
+end:
+  free(body);
+  bench_tm_stop(&tm);
+  return ret;
+}
+
+static void print_result(const void *arg, int ok) {
+  const t_result *res = arg;
+  double total = (double)res->programs * res->procs;
+
+  printf("{\"programs\": %d, \"procs\": %d, \"ok\": %s", res->programs,
+         res->procs, ok ? "true" : "false");
+  if (ok)
+    printf(", \"spawned_ms\": %.1f, \"running_ms\": %.1f, "
+           "\"forks_per_sec\": %.0f, \"supervisor_cpu_ms\": %.0f, "
+           "\"supervisor_rss_kb\": %ld, \"supervisor_hwm_kb\": %ld, "
+           "\"spawn_p50_us\": %.0f, \"spawn_p99_us\": %.0f, "
+           "\"spawn_avg_us\": %.0f",
+           res->spawned_ms, res->running_ms, total * 1000 / res->spawned_ms,
+           res->cpu_ms, res->rss_kb, res->hwm_kb, res->p50_us, res->p99_us,
+           res->avg_us);
+  printf("}");
+}
+
+static int init(void *arg, const char *av, char *desc, size_t size) {
+  t_result *res = arg;
+
+  *res = (t_result){0};
+  if (bench_nxm(av, &res->programs, &res->procs)) return -1;
+  snprintf(desc, size, "%d programs x %d procs", res->programs, res->procs);
+  return 0;
+}
+
+int main(int ac, char **av) {
+  t_result res;
+  const t_bench bench = {
+      .name = "bench-spawn",
+      .args = "NxM ...",
+      .help = "runs taskmaster with N programs of M procs of daemon",
+      .arg = &res,
+      .init = init,
+      .run = run,
+      .print = print_result};
+
+  return bench_main(&bench, ac, av);
+}
@@ -0,0 +1,258 @@
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+/*
+ * Timer accuracy: N programs of the test daemon get start timers due 1 to S
+ * seconds after their spawn, then are stopped from the CLI: the daemon ignores
+ * their SIGTERM, so their stop timers, due 1 to S seconds later, kill them.
+ * taskmaster measures how late or early each timer fired from the instant it
+ * is due (taskmaster_timer_drift_seconds). A scenario runs the timers alone
+ * (idle), along a SIGCHLD storm of short lived processes restarted as soon as
+ * they exit (storm) or along a CLI kept busy with status commands (cli).
+ * Prints a JSON array with a result per scenario run, exits with a failure if
+ * a timer didn't fire, fired twice or a program wasn't killed.
+ */
+
+#define POLL_MS (20)     /* between two scrapes & commands */
+#define PROMPT_MS (1000) /* a line is typed anyway once a prompt is late */
+#define STOP_BATCH (16)  /* programs per stop command */
+#define STORM_PGM (4)    /* programs of the storm */
+#define STORM_PROCS (30) /* processes per storm program, exiting every 0.5 s */
+#define KILL_LOG "didn't terminated correctly"
+
+typedef enum e_scenario { SC_IDLE, SC_STORM, SC_CLI, SC_NB } t_scenario;
+
+static const char *const sc_names[SC_NB] = {"idle", "storm", "cli"};
+
+typedef struct s_drift {
+  double cnt, p50, p90, p99, max, sum; /* s */
+} t_drift;
+
+typedef struct s_result {
+  int programs, spread;
+  t_scenario scenario;
+  double timers;         /* fired, counted from the drift histograms */
+  t_drift late, early;   /* fire time minus due time, either way */
+  double lag_p99;        /* SIGALRM handler lag, s */
+  long killed;           /* programs killed by their stop timer */
+  double start_failures; /* start timers fired short of numprocs */
+  double storm_restarts; /* load: storm processes reaped & restarted */
+  long commands;         /* load: status commands typed */
+} t_result;
+
+/* the result of a run & the options it's run with */
+typedef struct s_args {
+  int programs, spread; /* -n & -s */
+  t_result res;
+} t_args;
+
+typedef struct s_run {
+  t_bench_tm tm;
+  t_result *res;
+  int stopped;    /* programs whose stop command was typed */
+  bool stop;      /* the stop commands are due */
+  bool last_stop; /* the last line typed was a stop command */
+  int64_t typed;  /* us the last line was typed */
+} t_run;
+
+static int write_config(const t_bench_tm *tm, const char *daemon,
+                        const t_result *res) {
+  FILE *stream = fopen(tm->config, "w");
+
+  if (!stream) return -1;
+  fprintf(stream, "programs:\n");
+  for (int i = 0; i < res->programs; i++)
+    fprintf(stream,
+            "  timer_%05d:\n"
+            "    cmd: \"%s bench\"\n"
+            "    numprocs: 1\n"
+            "    autostart: true\n"
+            "    starttime: %d\n"
+            "    stopsignal: SIGTERM\n"
+            "    stoptime: %d\n"
+            "    stdout: /dev/null\n"
+            "    stderr: /dev/null\n",
+            i, daemon, 1 + i % res->spread,
+            1 + i / res->spread % res->spread);
+  for (int i = 0; res->scenario == SC_STORM && i < STORM_PGM; i++)
+    fprintf(stream,
+            "  storm_%d:\n"
+            "    cmd: \"/bin/sleep 0.5\"\n"
+            "    numprocs: %d\n"
+            "    autostart: true\n"
+            "    autorestart: true\n"
+            "    startretries: 128\n"
+            "    starttime: 0\n"
+            "    stopsignal: SIGTERM\n"
+            "    stoptime: 1\n",
+            i, STORM_PROCS);
+  return fclose(stream);
+}
+
+static void type_stop(t_run *run) {
+  char line[STOP_BATCH * 16 + 8] = "stop";
+  size_t len = 4;
+
+  for (int i = 0; i < STOP_BATCH && run->stopped < run->res->programs; i++)
+    len += snprintf(line + len, sizeof(line) - len, " timer_%05d",
+                    run->stopped++);
+  bench_tm_cmd(&run->tm, line);
+}
+
+/* a line is typed once the previous one is read: the stop commands when
+ * due, in turn with status commands with a busy CLI */
+static void load(t_run *run) {
+  t_result *res = run->res;
+  bool stop = run->stop && run->stopped < res->programs;
+
+  if (!stop && res->scenario != SC_CLI) return;
+  if (!run->tm.prompt && bench_now_us() - run->typed < PROMPT_MS * 1000LL)
+    return;
+  if ((run->last_stop = stop && (!run->last_stop || res->scenario != SC_CLI))) {
+    type_stop(run);
+  } else {
+    bench_tm_cmd(&run->tm, "status");
+    res->commands++;
+  }
+  run->typed = bench_now_us();
+}
+
+static double fired(const char *body) {
+  return bench_metric(body, "taskmaster_timer_drift_seconds_count", NULL);
+}
+
+/* load & scrape until timers fired */
+static int wait_timers(t_run *run, double timers, char **body) {
+  int64_t start = bench_now_us();
+
+  while (bench_now_us() - start < BENCH_TIMEOUT_MS * 1000LL) {
+    load(run);
+    bench_tm_pump(&run->tm, POLL_MS);
+    free(*body);
+    if ((*body = bench_scrape(&run->tm)) && fired(*body) >= timers) return 0;
+  }
+  return -1;
+}
+
+static void read_drift(const char *body, const char *side, t_drift *drift) {
+  static const char *const q[] = {"0.5", "0.9", "0.99", "1"};
+  double *dst[] = {&drift->p50, &drift->p90, &drift->p99, &drift->max};
+  char filter[64];
+
+  for (int i = 0; i < 4; i++) {
+    snprintf(filter, sizeof(filter), "side=\"%s\",quantile=\"%s\"", side,
+             q[i]);
+    *dst[i] = bench_metric(body, "taskmaster_timer_drift_seconds", filter);
+  }
+  snprintf(filter, sizeof(filter), "side=\"%s\"", side);
+  drift->cnt = bench_metric(body, "taskmaster_timer_drift_seconds_count",
+                            filter);
+  drift->sum = bench_metric(body, "taskmaster_timer_drift_seconds_sum", filter);
+  if (drift->cnt < 0) *drift = (t_drift){0};
+}
+
+static int run(void *arg, const char *bin, const char *daemon) {
+  t_result *res = &((t_args *)arg)->res;
+  t_run run = {.res = res, .typed = bench_now_us()};
+  /* the storm programs start with a timer due at once */
+  double untimed = res->scenario == SC_STORM ? STORM_PGM : 0;
+  char *body = NULL, log[128];
+  int ret = -1;
+
+  if (bench_tm_init(&run.tm)) return -1;
+  snprintf(log, sizeof(log), "%s/taskmaster.log", run.tm.dir);
+  if (write_config(&run.tm, daemon, res) ||
+      bench_tm_start(&run.tm, bin, (char *[]){"-p", "0", NULL}) ||
+      wait_timers(&run, res->programs + untimed, &body))
+    goto end;
+  res->start_failures =
+      bench_metric(body, "taskmaster_program_start_failures_total", "timer_");
+  run.stop = true;
+  /* a timer left pending past the last one would fire later, to be caught */
+  if (wait_timers(&run, 2 * res->programs + untimed, &body)) goto end;
+  bench_tm_pump(&run.tm, 2 * POLL_MS);
+  free(body);
+  if (!(body = bench_scrape(&run.tm))) goto end;
+  read_drift(body, "late", &res->late);
+  read_drift(body, "early", &res->early);
+  res->timers = res->late.cnt + res->early.cnt - untimed;
+  res->lag_p99 = bench_metric(body, "taskmaster_event_loop_lag_seconds",
+                              "quantile=\"0.99\"");
+  res->killed = bench_count_lines(log, KILL_LOG);
+  if (res->scenario == SC_STORM)
+    res->storm_restarts =
+        bench_metric(body, "taskmaster_program_restarts_total", "storm_");
+  ret = res->timers == 2 * res->programs && res->killed == res->programs &&
+                !res->start_failures &&
+                !bench_metric(body, "taskmaster_timers_pending", NULL)
+            ? 0
+            : -1;
+end:
+  free(body);
+  bench_tm_stop(&run.tm);
+  return ret;
+}
+
+static void print_drift(const char *side, const t_drift *drift) {
+  printf(",\n   \"%s\": {\"n\": %.0f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, "
+         "\"p99_ms\": %.3f, \"max_ms\": %.3f, \"avg_ms\": %.3f}",
+         side, drift->cnt, drift->p50 * 1e3, drift->p90 * 1e3,
+         drift->p99 * 1e3, drift->max * 1e3,
+         drift->cnt ? drift->sum * 1e3 / drift->cnt : 0);
+}
+
+static void print_result(const void *arg, int ok) {
+  const t_result *res = &((const t_args *)arg)->res;
+
+  printf("{\"scenario\": \"%s\", \"programs\": %d, \"spread_s\": %d, "
+         "\"ok\": %s, \"timers\": %.0f, \"killed\": %ld, "
+         "\"start_failures\": %.0f, \"storm_restarts\": %.0f, "
+         "\"commands\": %ld, \"lag_p99_ms\": %.3f",
+         sc_names[res->scenario], res->programs,
+         res->spread, ok ? "true" : "false", res->timers, res->killed,
+         res->start_failures, res->storm_restarts, res->commands,
+         res->lag_p99 * 1e3);
+  print_drift("late", &res->late);
+  print_drift("early", &res->early);
+  printf("}");
+}
+
+static int opt(void *arg, int opt, const char *val) {
+  t_args *args = arg;
+
+  if (opt == 'n') return (args->programs = atoi(val)) > 0 ? 0 : -1;
+  return (args->spread = atoi(val)) > 0 ? 0 : -1;
+}
+
+static int init(void *arg, const char *av, char *desc, size_t size) {
+  t_args *args = arg;
+  t_result *res = &args->res;
+
+  *res = (t_result){.programs = args->programs, .spread = args->spread};
+  while (res->scenario < SC_NB && strcmp(av, sc_names[res->scenario]))
+    res->scenario++;
+  if (res->scenario == SC_NB) return -1;
+  snprintf(desc, size, "%s, %d programs", av, res->programs);
+  return 0;
+}
+
+int main(int ac, char **av) {
+  t_args args = {.programs = 1000, .spread = 4};
+  const t_bench bench = {
+      .name = "bench-timer",
+      .args = "[-n programs] [-s spread] idle|storm|cli ...",
+      .help = "fires a start & a stop timer of programs of daemon, due 1 to "
+              "spread s later",
+      .opts = "n:s:",
+      .arg = &args,
+      .opt = opt,
+      .init = init,
+      .run = run,
+      .print = print_result};
+
+  return bench_main(&bench, ac, av);
+}
@@ -0,0 +1,51 @@
+/*
+ * tm_lzcat: stream the content of taskmaster compressed logs (*.lz) to stdout.
+ * usage: tm_lzcat [-c] [file ...]
+ * Without file, reads stdin. With -c, compresses instead of decompressing.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ft_lz.h"
+
+static int process(int fd, const char *name, int compress) {
+  int ret;
+
+  if (compress)
+    ret = ft_lz_compress_fd(fd, STDOUT_FILENO, NULL, NULL);
+  else
+    ret = ft_lz_decompress_fd(fd, STDOUT_FILENO);
+  if (ret) fprintf(stderr, "tm_lzcat: %s: corrupted or truncated\n", name);
+  return ret;
+}
+
+int main(int ac, char **av) {
+  int opt, fd, compress = 0, ret = EXIT_SUCCESS;
+
+  while ((opt = getopt(ac, av, "c")) != -1) {
+    switch (opt) {
+      case 'c':
+        compress = 1;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-c] [file ...]\n", av[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (optind == ac) return process(STDIN_FILENO, "stdin", compress);
+  for (int i = optind; i < ac; i++) {
+    if ((fd = open(av[i], O_RDONLY)) == -1) {
+      fprintf(stderr, "tm_lzcat: %s: %s\n", av[i], strerror(errno));
+      ret = EXIT_FAILURE;
+      continue;
+    }
+    if (process(fd, av[i], compress)) ret = EXIT_FAILURE;
+    close(fd);
+  }
+  return ret;
+}